@@ -0,0 +1,63 @@
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Large enough that a region holds only a few of them
+typedef struct Blob {
+  char data[1024];
+} Blob;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void empty(CigSystemCtx *ctx, double dt) {}
+
+int main(int argc, char **argv) {
+  const size_t steps = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+  const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  CigWorld *w = cig_world_init();
+  if (!w)
+    return EXIT_FAILURE;
+
+  CigTypeDesc blob_desc = {"blob", sizeof(Blob), _Alignof(Blob)};
+  CigSystemDesc empty_desc = {"empty", "blob", empty, .read_only = 1};
+  if (cig_world_register_type(w, &blob_desc) ||
+      cig_world_register_system(w, &empty_desc))
+    return EXIT_FAILURE;
+
+  // Every step hands out a few dozen regions that do next to nothing, so the
+  // time is spent waking the workers and waiting for them
+  if (!cig_world_spawn(w, 256, "blob"))
+    return EXIT_FAILURE;
+
+  printf("threads  ns/step  p99 ns\n");
+  for (long threads = 1; threads <= cpus; threads *= 2) {
+    if (cig_world_set_threads(w, threads, NULL))
+      return EXIT_FAILURE;
+
+    // Let the workers start before timing
+    for (size_t i = 0; i < 1000; i++)
+      cig_world_step(w, 0);
+    cig_world_reset_latency(w);
+
+    const double start = now();
+    for (size_t i = 0; i < steps; i++)
+      if (cig_world_step(w, 0))
+        return EXIT_FAILURE;
+    const double elapsed = now() - start;
+
+    CigLatency latency;
+    cig_world_get_step_latency(w, &latency);
+    printf("%7ld  %7.0f  %6llu\n", threads, elapsed / steps * 1e9,
+           (unsigned long long)latency.p99);
+  }
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+typedef struct Health {
+  int current, max;
+} Health;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t file_size(const char *path) {
+  struct stat st;
+  return stat(path, &st) ? 0 : st.st_size;
+}
+
+static CigWorld *create_world() {
+  CigWorld *w = cig_world_init();
+  if (!w)
+    return NULL;
+
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2)};
+  CigTypeDesc health_desc = {"health", sizeof(Health), _Alignof(Health)};
+  CigTypeDesc velocity_desc = {"velocity", sizeof(Vec2), _Alignof(Vec2)};
+  if (cig_world_register_type(w, &vec2_desc) ||
+      cig_world_register_type(w, &health_desc) ||
+      cig_world_register_type(w, &velocity_desc)) {
+    cig_world_deinit(w);
+    return NULL;
+  }
+
+  return w;
+}
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  const char *raw_path = "snapshot_bench.raw";
+  const char *path = "snapshot_bench.bin";
+
+  CigWorld *w = create_world();
+  if (!w)
+    return EXIT_FAILURE;
+
+  // Entities laid out on a grid, most of them at full health and at rest
+  const CigEntity *e = cig_world_spawn(w, count, "vec2, health, velocity");
+  if (!e)
+    return EXIT_FAILURE;
+  for (size_t i = 0; i < count; i++) {
+    *(Vec2 *)cig_world_get_component(w, e[i], "vec2") =
+        (Vec2){(float)(i % 1000), (float)(i / 1000)};
+    *(Health *)cig_world_get_component(w, e[i], "health") =
+        (Health){i % 64 ? 100 : rand() % 100, 100};
+    if (i % 16 == 0)
+      *(Vec2 *)cig_world_get_component(w, e[i], "velocity") =
+          (Vec2){(float)rand() / RAND_MAX, (float)rand() / RAND_MAX};
+  }
+
+  double start = now();
+  if (cig_export_wait(
+          cig_world_export(w, "vec2, health, velocity", raw_path)))
+    return EXIT_FAILURE;
+  const double raw_time = now() - start;
+
+  start = now();
+  if (cig_world_snapshot(w, path))
+    return EXIT_FAILURE;
+  const double write_time = now() - start;
+
+  CigWorld *restored = create_world();
+  if (!restored)
+    return EXIT_FAILURE;
+
+  start = now();
+  if (cig_world_restore(restored, path))
+    return EXIT_FAILURE;
+  const double read_time = now() - start;
+
+  const size_t raw_size = file_size(raw_path);
+  const size_t size = file_size(path);
+  const double bytes = (double)raw_size;
+
+  printf("entities:  %zu\n", count);
+  printf("raw:       %zu bytes, %.1f MB/s\n", raw_size, bytes / raw_time / 1e6);
+  printf("snapshot:  %zu bytes (%.1f%%)\n", size, 100.0 * size / raw_size);
+  printf("encode:    %.1f MB/s\n", bytes / write_time / 1e6);
+  printf("decode:    %.1f MB/s\n", bytes / read_time / 1e6);
+
+  cig_world_deinit(restored);
+  cig_world_deinit(w);
+  remove(raw_path);
+  remove(path);
+  return EXIT_SUCCESS;
+}
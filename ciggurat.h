@@ -7,32 +7,212 @@
 typedef struct CigWorld CigWorld;
 typedef uint64_t CigEntity;
 typedef struct CigSystemCtx CigSystemCtx;
+typedef struct CigExport CigExport;
+typedef struct CigSharedView CigSharedView;
 
 typedef void (*CigSystemFunc)(CigSystemCtx *ctx, double dt);
+typedef void (*CigTaskFunc)(void *user_data);
+typedef uint64_t (*CigGroupFunc)(const void *value, void *user_data);
+
+typedef enum CigZoneState {
+  CIG_ZONE_RESIDENT,
+  CIG_ZONE_PAGING_OUT,
+  CIG_ZONE_PAGED_OUT,
+  CIG_ZONE_PAGING_IN,
+} CigZoneState;
+
+typedef enum CigKeyKind {
+  CIG_KEY_INT32,
+  CIG_KEY_INT64,
+  CIG_KEY_UINT32,
+  CIG_KEY_UINT64,
+  CIG_KEY_FLOAT,
+  CIG_KEY_DOUBLE,
+} CigKeyKind;
+
+typedef struct CigFieldDesc {
+  char *identifier;
+  // Where the field is within the type
+  size_t offset, size;
+} CigFieldDesc;
 
 typedef struct CigTypeDesc {
   char *identifier;
   size_t size, alignment;
+  // Optional fields, they can be requested on their own as "type.field". When
+  // they cover every byte of the type it can be split into a column per field.
+  CigFieldDesc *fields;
+  size_t field_count;
 } CigTypeDesc;
 
+typedef struct CigColumnDesc {
+  // The type of the components in the column
+  char *identifier;
+  const void *data;
+  // Bytes between consecutive components, 0 when they are packed
+  size_t stride;
+} CigColumnDesc;
+
+typedef struct CigSharedRun {
+  // The first component of the run
+  const void *data;
+  size_t count;
+  // Bytes between consecutive components
+  size_t stride;
+} CigSharedRun;
+
+typedef struct CigSystemStats {
+  // How many times the system ran and the families it ran on in total, a fused
+  // chain is counted by its head
+  uint64_t runs, families;
+  // Hardware counters, only collected while enabled
+  uint64_t cycles, instructions, cache_misses, branch_misses;
+} CigSystemStats;
+
+typedef struct CigLatency {
+  // How many durations were recorded, the percentiles and the maximum are in
+  // nanoseconds
+  uint64_t count;
+  uint64_t p50, p99, p999, max;
+} CigLatency;
+
+typedef struct CigReductionDesc {
+  // Size and alignment of the accumulator type
+  size_t size, alignment;
+  // Resets an accumulator to the identity of `combine`
+  void (*init)(void *acc);
+  // Folds the accumulator `src` into `dst`
+  void (*combine)(void *dst, const void *src);
+} CigReductionDesc;
+
 typedef struct CigSystemDesc {
   char *identifier;
   char *requirements;
   CigSystemFunc func;
   void *user_data;
+  // Optional identifier of a system with the same requirements, this system
+  // is then run on each region straight after it during `cig_world_step()`
+  char *fuse_after;
+  // Optional reduction, each worker running the system gets its own
+  // accumulator and they are combined in order after the run
+  CigReductionDesc *reduction;
+  // Set when the system only reads components, it can then run on chunks
+  // shared with a forked world without copying them
+  int read_only;
+  // Set when the system extracts the final state of a step, it runs after the
+  // other systems and only reads. When the world is pipelined it runs on a
+  // frozen copy of the step alongside the next `cig_world_step()`.
+  int extract;
+  // Optional, the chunks of a grouped storage are skipped unless it returns
+  // non-zero for their group
+  int (*group_filter)(uint64_t group, void *user_data);
 } CigSystemDesc;
 
+typedef struct CigGroupDesc {
+  // The "type" or "type.field" the group of a family is computed from
+  char *field;
+  CigGroupFunc func;
+  void *user_data;
+} CigGroupDesc;
+
+typedef struct CigIndexDesc {
+  char *identifier;
+  // The "type" or "type.field" the entities are ordered by. Values written
+  // through a pointer are only seen if it was asked for since the last range.
+  char *field;
+  CigKeyKind kind;
+} CigIndexDesc;
+
+typedef struct CigIndexRange {
+  // Where the range is up to in the index, it is only valid until the world
+  // is changed
+  const CigWorld *w;
+  const void *index;
+  size_t next[2];
+  uint64_t max;
+} CigIndexRange;
+
+typedef struct CigTaskDesc {
+  char *identifier;
+  CigTaskFunc func;
+  void *user_data;
+  // Optional comma separated identifiers of the systems and tasks that have to
+  // finish first in each `cig_world_step()`, they must already be registered.
+  // Tasks run alongside the systems so they must not use the world.
+  char *after;
+} CigTaskDesc;
+
 void cig_world_deinit(CigWorld *w);
 CigWorld *cig_world_init();
+CigWorld *cig_world_init_shared(const char *name, size_t size);
+CigWorld *cig_world_fork(const CigWorld *w);
 int cig_world_register_type(CigWorld *w, CigTypeDesc *desc);
 int cig_world_register_system(CigWorld *w, CigSystemDesc *desc);
+int cig_world_register_task(CigWorld *w, CigTaskDesc *desc);
+int cig_world_set_layout(CigWorld *w, const char *types, size_t block_width,
+                         int split_fields);
+int cig_world_enable_layout_tuning(CigWorld *w, int enable);
+int cig_world_tune_layouts(CigWorld *w, size_t max_storages);
+int cig_world_set_grouping(CigWorld *w, const char *types,
+                           CigGroupDesc *desc);
+int cig_world_regroup(CigWorld *w);
 const CigEntity *cig_world_spawn(CigWorld *w, size_t count, const char *types);
+const CigEntity *cig_world_spawn_columns(CigWorld *w, size_t count,
+                                         const CigColumnDesc *columns,
+                                         size_t column_count);
+int cig_world_despawn_query(CigWorld *w, const char *requirements);
+int cig_world_import(CigWorld *w, const char *path);
+int cig_world_journal_open(CigWorld *w, const char *path);
+int cig_world_journal_sync(CigWorld *w);
+int cig_world_journal_close(CigWorld *w);
+int cig_world_replay(CigWorld *w, const char *path);
+int cig_world_snapshot(const CigWorld *w, const char *path);
+int cig_world_restore(CigWorld *w, const char *path);
+int cig_world_publish(CigWorld *w);
+int cig_world_merge(CigWorld *dst, CigWorld *src, CigEntity *first);
+int cig_world_page_out(CigWorld *w, const char *zone, const char *path);
+int cig_world_page_in(CigWorld *w, const char *zone);
+int cig_world_poll_zones(CigWorld *w);
+CigZoneState cig_world_zone_state(const CigWorld *w, const char *zone);
+CigExport *cig_world_export(const CigWorld *w, const char *requirements,
+                            const char *path);
+int cig_export_wait(CigExport *export);
 void *cig_world_get_component(const CigWorld *w, const CigEntity e,
                               const char *type_str);
+int cig_world_set_component(CigWorld *w, const CigEntity e,
+                            const char *type_str, const void *data);
 int cig_world_run(const CigWorld *w, const char *identifier, double delta_time);
 int cig_world_step(const CigWorld *w, double delta_time);
+int cig_world_set_threads(CigWorld *w, size_t count, const int *cpus);
+int cig_world_set_deterministic(CigWorld *w, int enable);
+int cig_world_set_pipelined(CigWorld *w, int enable);
+void cig_world_wait_extraction(CigWorld *w);
+size_t cig_query_count(const CigWorld *w, const char *requirements);
+int cig_world_register_index(CigWorld *w, CigIndexDesc *desc);
+int cig_world_index_range(const CigWorld *w, const char *identifier,
+                          const void *min, const void *max,
+                          CigIndexRange *range);
+int cig_index_next(CigIndexRange *range, CigEntity *e, void **component);
+const void *cig_world_get_reduction(const CigWorld *w, const char *identifier);
+int cig_world_enable_counters(CigWorld *w, int enable);
+int cig_world_get_system_stats(const CigWorld *w, const char *identifier,
+                               CigSystemStats *result);
+void cig_world_print_system_stats(const CigWorld *w);
+void cig_world_get_step_latency(const CigWorld *w, CigLatency *result);
+int cig_world_get_system_latency(const CigWorld *w, const char *identifier,
+                                 CigLatency *result);
+void cig_world_reset_latency(CigWorld *w);
+
+CigSharedView *cig_shared_open(const char *name);
+void cig_shared_close(CigSharedView *view);
+uint64_t cig_shared_begin(const CigSharedView *view);
+int cig_shared_validate(const CigSharedView *view, uint64_t sequence);
+size_t cig_shared_runs(const CigSharedView *view, const char *type,
+                       CigSharedRun *runs, size_t capacity);
 
 void *cig_system_get_component(const CigSystemCtx *ctx, size_t idx);
 void *cig_system_get_user_data(const CigSystemCtx *ctx);
+void *cig_system_get_accumulator(const CigSystemCtx *ctx);
+uint64_t cig_system_get_group(const CigSystemCtx *ctx);
 
 #endif
@@ -0,0 +1,225 @@
+/**
+ * src/column_codec.c
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "column_codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Values are bit-packed in blocks of up to this many values sharing a width
+#define BLOCK_SIZE 128
+// Shorter runs of zeros are cheaper to leave in the block
+#define MIN_ZERO_RUN 16
+
+// The first byte of a lane says how its values were transformed before packing
+enum column_mode {
+  MODE_PLAIN,
+  // Each value is the zigzagged difference from the one before
+  MODE_DELTA,
+};
+
+static uint32_t zigzag(uint32_t delta) {
+  return (delta << 1) ^ (0 - (delta >> 31));
+}
+
+static uint32_t unzigzag(uint32_t value) {
+  return (value >> 1) ^ (0 - (value & 1));
+}
+
+static unsigned bit_width(uint32_t value) {
+  return value ? 32 - __builtin_clz(value) : 0;
+}
+
+static uint32_t mapped(const uint32_t *values, size_t i,
+                       enum column_mode mode) {
+  if (mode == MODE_PLAIN)
+    return values[i];
+  return zigzag(values[i] - (i > 0 ? values[i - 1] : 0));
+}
+
+// Estimates the packed bits of a lane, zero runs are ignored
+static size_t estimate(const uint32_t *values, size_t count,
+                       enum column_mode mode) {
+  size_t bits = 0;
+  for (size_t i = 0; i < count; i += BLOCK_SIZE) {
+    const size_t n = count - i < BLOCK_SIZE ? count - i : BLOCK_SIZE;
+
+    uint32_t any = 0;
+    for (size_t j = i; j < i + n; j++)
+      any |= mapped(values, j, mode);
+    bits += bit_width(any) * n;
+  }
+
+  return bits;
+}
+
+static size_t zero_run(const uint32_t *values, size_t i, size_t count,
+                       enum column_mode mode) {
+  size_t n = 0;
+  while (i + n < count && mapped(values, i + n, mode) == 0)
+    n++;
+  return n;
+}
+
+static uint8_t *put_varint(uint8_t *dest, uint64_t value) {
+  while (value >= 0x80) {
+    *dest++ = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  *dest++ = (uint8_t)value;
+  return dest;
+}
+
+static int get_varint(const uint8_t **src, const uint8_t *end,
+                      uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (*src == end)
+      return EXIT_FAILURE;
+
+    const uint8_t byte = *(*src)++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return EXIT_SUCCESS;
+  }
+
+  return EXIT_FAILURE;
+}
+
+size_t column_encode_bound(size_t count) {
+  // Every block is either full, ends the lane or is followed by a zero run,
+  // each needs an op byte and a varint
+  const size_t blocks = count / BLOCK_SIZE + count / MIN_ZERO_RUN + 2;
+  return 1 + count * sizeof(uint32_t) + blocks * 2 * 11;
+}
+
+// A lane is the mode byte followed by ops, each op is a bit width byte and a
+// varint count of values. A width of 0 is a run of zeros, otherwise the values
+// follow packed at that width, least significant bit first.
+size_t column_encode(const uint32_t *values, size_t count, uint8_t *dest) {
+  const enum column_mode mode =
+      estimate(values, count, MODE_DELTA) < estimate(values, count, MODE_PLAIN)
+          ? MODE_DELTA
+          : MODE_PLAIN;
+
+  uint8_t *out = dest;
+  *out++ = mode;
+
+  size_t i = 0;
+  while (i < count) {
+    const size_t zeros = zero_run(values, i, count, mode);
+    if (zeros >= MIN_ZERO_RUN) {
+      *out++ = 0;
+      out = put_varint(out, zeros);
+      i += zeros;
+      continue;
+    }
+
+    // The block stops short of the next long run of zeros
+    size_t n = 0;
+    uint32_t any = 0;
+    while (i + n < count && n < BLOCK_SIZE) {
+      const uint32_t value = mapped(values, i + n, mode);
+      if (value == 0 && n > 0 &&
+          zero_run(values, i + n, count, mode) >= MIN_ZERO_RUN)
+        break;
+
+      any |= value;
+      n++;
+    }
+
+    const unsigned width = bit_width(any);
+    *out++ = width;
+    out = put_varint(out, n);
+
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    for (size_t j = i; j < i + n && width > 0; j++) {
+      acc |= (uint64_t)mapped(values, j, mode) << bits;
+      bits += width;
+      while (bits >= 8) {
+        *out++ = (uint8_t)acc;
+        acc >>= 8;
+        bits -= 8;
+      }
+    }
+    if (bits > 0)
+      *out++ = (uint8_t)acc;
+
+    i += n;
+  }
+
+  return out - dest;
+}
+
+int column_decode(const uint8_t *src, size_t size, uint32_t *values,
+                  size_t count) {
+  const uint8_t *end = src + size;
+  if (src == end || *src > MODE_DELTA)
+    return EXIT_FAILURE;
+  const enum column_mode mode = *src++;
+
+  size_t i = 0;
+  while (i < count) {
+    uint64_t n;
+    if (src == end)
+      return EXIT_FAILURE;
+    const unsigned width = *src++;
+    if (width > 32 || get_varint(&src, end, &n) || n > count - i)
+      return EXIT_FAILURE;
+
+    if (width == 0) {
+      memset(values + i, 0, n * sizeof(uint32_t));
+      i += n;
+      continue;
+    }
+
+    if ((n * width + 7) / 8 > (size_t)(end - src))
+      return EXIT_FAILURE;
+
+    const uint64_t mask = ((uint64_t)1 << width) - 1;
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    for (size_t j = i; j < i + n; j++) {
+      while (bits < width) {
+        acc |= (uint64_t)*src++ << bits;
+        bits += 8;
+      }
+      values[j] = acc & mask;
+      acc >>= width;
+      bits -= width;
+    }
+
+    i += n;
+  }
+
+  if (mode == MODE_DELTA) {
+    uint32_t prev = 0;
+    for (size_t j = 0; j < count; j++) {
+      prev += unzigzag(values[j]);
+      values[j] = prev;
+    }
+  }
+
+  return src == end ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,40 @@
+/**
+ * src/column_codec.h
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CIG_COLUMN_CODEC_H
+#define CIG_COLUMN_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The most bytes `column_encode()` writes for `count` values
+size_t column_encode_bound(size_t count);
+
+// Encodes a lane of `count` values into `dest`, returns the bytes written
+size_t column_encode(const uint32_t *values, size_t count, uint8_t *dest);
+
+// Decodes exactly `count` values from the `size` bytes at `src`
+int column_decode(const uint8_t *src, size_t size, uint32_t *values,
+                  size_t count);
+
+#endif
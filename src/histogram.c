@@ -0,0 +1,99 @@
+/**
+ * src/histogram.c
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "histogram.h"
+
+#include <stddef.h>
+
+static size_t bucket_of(uint64_t value) {
+  if (value < HISTOGRAM_SUB_COUNT)
+    return value;
+
+  // Keep the top `HISTOGRAM_SUB_BITS + 1` bits of the value
+  const unsigned shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  const uint64_t sub = (value >> shift) - HISTOGRAM_SUB_COUNT;
+  return ((size_t)(shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+// The largest value that lands in the bucket
+static uint64_t bucket_max(size_t bucket) {
+  if (bucket < HISTOGRAM_SUB_COUNT)
+    return bucket;
+
+  const unsigned shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+  const uint64_t sub = bucket & (HISTOGRAM_SUB_COUNT - 1);
+  return ((HISTOGRAM_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void histogram_record(struct histogram *histogram, uint64_t value) {
+  atomic_fetch_add_explicit(&histogram->counts[bucket_of(value)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+
+  uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  while (value > max &&
+         !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+    ;
+}
+
+uint64_t histogram_count(const struct histogram *histogram) {
+  struct histogram *h = (struct histogram *)histogram;
+  return atomic_load_explicit(&h->count, memory_order_relaxed);
+}
+
+uint64_t histogram_percentile(const struct histogram *histogram,
+                              double percentile) {
+  struct histogram *h = (struct histogram *)histogram;
+  const uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+  // Sum the buckets rather than trust `count`, they are not updated together
+  uint64_t total = 0;
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    total += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+  if (total == 0)
+    return 0;
+
+  uint64_t target = (uint64_t)(percentile / 100.0 * total + 0.5);
+  if (target == 0)
+    target = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    if (seen >= target) {
+      const uint64_t value = bucket_max(i);
+      return value < max ? value : max;
+    }
+  }
+
+  return max;
+}
+
+void histogram_reset(struct histogram *histogram) {
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    atomic_store_explicit(&histogram->counts[i], 0, memory_order_relaxed);
+  atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+  atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+/**
+ * src/histogram.h
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CIG_HISTOGRAM_H
+#define CIG_HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Each power of two is split into this many linear sub-buckets, so a recorded
+// value is off by at most 1/32 of itself
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+// A log-linear histogram that can be recorded to from any thread without locks
+struct histogram {
+  atomic_uint_least64_t counts[HISTOGRAM_BUCKETS];
+  atomic_uint_least64_t count, max;
+};
+
+void histogram_record(struct histogram *histogram, uint64_t value);
+uint64_t histogram_count(const struct histogram *histogram);
+
+// The smallest recorded value that `percentile` percent of values are at or
+// below, to the precision of its bucket
+uint64_t histogram_percentile(const struct histogram *histogram,
+                              double percentile);
+
+// Values recorded at the same time as the reset may survive it
+void histogram_reset(struct histogram *histogram);
+
+#endif
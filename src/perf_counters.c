@@ -0,0 +1,113 @@
+/**
+ * src/perf_counters.c
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// syscall() is not part of POSIX
+#define _GNU_SOURCE
+
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+static const uint64_t events[PERF_COUNTER_COUNT] = {
+    [PERF_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [PERF_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [PERF_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+    [PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+int perf_counters_open(struct perf_counters *result) {
+  *result = (struct perf_counters){0};
+  for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+    result->fds[i] = -1;
+    result->slots[i] = -1;
+  }
+
+  for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = events[i];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // Cycles lead the group, the other counters are optional
+    const int leader = result->fds[PERF_CYCLES];
+    result->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, leader,
+                             PERF_FLAG_FD_CLOEXEC);
+    if (result->fds[i] < 0) {
+      if (i == PERF_CYCLES) {
+        fprintf(stderr, "%s(): Hardware counters are not available.\n",
+                __func__);
+        return EXIT_FAILURE;
+      }
+      continue;
+    }
+
+    result->slots[i] = result->slot_count++;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+void perf_counters_close(struct perf_counters *counters) {
+  for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    if (counters->fds[i] >= 0)
+      close(counters->fds[i]);
+}
+
+int perf_counters_read(const struct perf_counters *counters,
+                       uint64_t values[PERF_COUNTER_COUNT]) {
+  // The number of counters followed by their values
+  uint64_t group[1 + PERF_COUNTER_COUNT];
+  const ssize_t size = sizeof(uint64_t) * (1 + counters->slot_count);
+  if (read(counters->fds[PERF_CYCLES], group, size) != size)
+    return EXIT_FAILURE;
+
+  for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+    values[i] = counters->slots[i] >= 0 ? group[1 + counters->slots[i]] : 0;
+
+  return EXIT_SUCCESS;
+}
+
+#else
+
+int perf_counters_open(struct perf_counters *result) {
+  fprintf(stderr, "%s(): Hardware counters need Linux.\n", __func__);
+  return EXIT_FAILURE;
+}
+
+void perf_counters_close(struct perf_counters *counters) {}
+
+int perf_counters_read(const struct perf_counters *counters,
+                       uint64_t values[PERF_COUNTER_COUNT]) {
+  return EXIT_FAILURE;
+}
+
+#endif
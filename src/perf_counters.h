@@ -0,0 +1,52 @@
+/**
+ * src/perf_counters.h
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CIG_PERF_COUNTERS_H
+#define CIG_PERF_COUNTERS_H
+
+#include <stdint.h>
+
+enum perf_counter {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_COUNTER_COUNT,
+};
+
+// Hardware counters of the thread that opened them, read as one group
+struct perf_counters {
+  int fds[PERF_COUNTER_COUNT];
+  // Where each counter is in a group read, -1 if it couldn't be opened
+  int slots[PERF_COUNTER_COUNT];
+  int slot_count;
+};
+
+int perf_counters_open(struct perf_counters *result);
+void perf_counters_close(struct perf_counters *counters);
+
+// Reads the running totals, counters that couldn't be opened read as 0
+int perf_counters_read(const struct perf_counters *counters,
+                       uint64_t values[PERF_COUNTER_COUNT]);
+
+#endif
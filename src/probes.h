@@ -0,0 +1,50 @@
+/**
+ * src/probes.h
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CIG_PROBES_H
+#define CIG_PROBES_H
+
+// Static tracepoints under the "ciggurat" provider, built in with the
+// enable-probes option. Each one is a single nop until a tracer attaches.
+// There is no provider file, so the names are kept as written, e.g.
+// `usdt:libciggurat.so:ciggurat:step_begin`.
+//   step_begin     world
+//   step_end       world, result
+//   system_begin   identifier, whether the fused chain runs
+//   system_end     identifier, families run
+//   spawn          world, count, type count, recycled ids
+//   storage_create storage, type count, family size, families per region
+//   region_alloc   storage, chunk
+#ifdef CIG_PROBES
+#include <sys/sdt.h>
+
+#define CIG_PROBE1(name, a) DTRACE_PROBE1(ciggurat, name, a)
+#define CIG_PROBE2(name, a, b) DTRACE_PROBE2(ciggurat, name, a, b)
+#define CIG_PROBE4(name, a, b, c, d) DTRACE_PROBE4(ciggurat, name, a, b, c, d)
+#else
+#define CIG_PROBE1(name, a)
+#define CIG_PROBE2(name, a, b)
+#define CIG_PROBE4(name, a, b, c, d)
+#endif
+
+#endif
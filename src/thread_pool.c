@@ -0,0 +1,341 @@
+/**
+ * src/thread_pool.c
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// syscall() and the affinity functions are not part of POSIX
+#define _GNU_SOURCE
+
+#include "thread_pool.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <time.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+// How many times a worker polls for a job before it parks, some tens of
+// microseconds, which covers the gap between the jobs of one step
+#define SPIN_COUNT 2000
+
+struct worker {
+  // Workers write their own state only, so each one gets a cache line
+  _Alignas(CACHE_LINE_SIZE) struct thread_pool *pool;
+  pthread_t thread;
+  size_t slot;
+};
+
+struct thread_pool {
+  // Bumped whenever a batch is queued or the pool stops, workers park on it
+  _Alignas(CACHE_LINE_SIZE) atomic_uint signal;
+  // How many workers are parked, the futex is only woken when there are any
+  atomic_uint sleepers;
+  atomic_int stop;
+
+  // Batches that still have indices to hand out
+  _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;
+  struct thread_pool_batch *head, *tail;
+
+  struct worker *workers;
+  size_t worker_count;
+};
+
+static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ volatile("yield");
+#endif
+}
+
+// Spins for a while before giving up the CPU to whoever it is waiting for
+static void backoff(size_t *spins) {
+  if ((*spins)++ < SPIN_COUNT)
+    cpu_relax();
+  else
+    sched_yield();
+}
+
+#ifdef __linux__
+
+static void futex_wait(atomic_uint *address, uint32_t value) {
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *address) {
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+#else
+
+// Without futexes parked workers poll every 50us
+static void futex_wait(atomic_uint *address, uint32_t value) {
+  if (atomic_load(address) == value)
+    nanosleep(&(struct timespec){0, 50000}, NULL);
+}
+
+static void futex_wake(atomic_uint *address) {}
+
+#endif
+
+static void queue_remove(struct thread_pool *pool,
+                         struct thread_pool_batch *batch) {
+  struct thread_pool_batch **link = &pool->head;
+  struct thread_pool_batch *previous = NULL;
+  while (*link != batch) {
+    previous = *link;
+    link = &previous->queued_next;
+  }
+
+  *link = batch->queued_next;
+  if (pool->tail == batch)
+    pool->tail = previous;
+}
+
+// Takes the next index of `batch`, or of the first queued batch when `batch`
+// is NULL, the batch leaves the queue along with its last index
+static struct thread_pool_batch *queue_take(struct thread_pool *pool,
+                                            struct thread_pool_batch *batch,
+                                            size_t *index) {
+  pthread_mutex_lock(&pool->mutex);
+  if (!batch)
+    batch = pool->head;
+  if (!batch || batch->next == batch->count) {
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+  }
+
+  *index = batch->next++;
+  if (batch->next == batch->count)
+    queue_remove(pool, batch);
+  pthread_mutex_unlock(&pool->mutex);
+
+  return batch;
+}
+
+static void queue_signal(struct thread_pool *pool) {
+  // The sleeper count and the signal are both sequentially consistent, so
+  // either a parking worker sees the new signal or it is seen as a sleeper
+  atomic_fetch_add(&pool->signal, 1);
+  if (atomic_load(&pool->sleepers) > 0)
+    futex_wake(&pool->signal);
+}
+
+static void batch_run(struct thread_pool_batch *batch, size_t index,
+                      size_t slot) {
+  batch->func(batch->arg, index, slot);
+
+  // The batch may be gone as soon as it is released
+  atomic_fetch_sub_explicit(&batch->remaining, 1, memory_order_release);
+}
+
+static void worker_wait(struct worker *worker, uint32_t seen) {
+  struct thread_pool *pool = worker->pool;
+
+  for (size_t i = 0; i < SPIN_COUNT; i++) {
+    if (atomic_load_explicit(&pool->signal, memory_order_acquire) != seen)
+      return;
+    cpu_relax();
+  }
+
+  atomic_fetch_add(&pool->sleepers, 1);
+  while (atomic_load(&pool->signal) == seen)
+    futex_wait(&pool->signal, seen);
+  atomic_fetch_sub(&pool->sleepers, 1);
+}
+
+static void *worker_thread(void *worker_ptr) {
+  struct worker *worker = worker_ptr;
+  struct thread_pool *pool = worker->pool;
+
+  for (;;) {
+    // Read before the queue is checked, so nothing queued after is missed
+    const uint32_t seen = atomic_load(&pool->signal);
+    if (atomic_load(&pool->stop))
+      break;
+
+    size_t index;
+    struct thread_pool_batch *batch = queue_take(pool, NULL, &index);
+    if (batch)
+      batch_run(batch, index, worker->slot);
+    else
+      worker_wait(worker, seen);
+  }
+
+  return NULL;
+}
+
+static void thread_pool_stop(struct thread_pool *pool, size_t started) {
+  atomic_store(&pool->stop, 1);
+  queue_signal(pool);
+
+  for (size_t i = 0; i < started; i++)
+    pthread_join(pool->workers[i].thread, NULL);
+}
+
+static int worker_pin(struct worker *worker, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(worker->thread, sizeof(set), &set)) {
+    fprintf(stderr, "%s(): Could not pin a worker to the CPU (%i).\n",
+            __func__, cpu);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+#else
+  fprintf(stderr, "%s(): Pinning workers needs Linux.\n", __func__);
+  return EXIT_FAILURE;
+#endif
+}
+
+struct thread_pool *thread_pool_init(size_t count, const int *cpus) {
+  struct thread_pool *result =
+      aligned_alloc(CACHE_LINE_SIZE, sizeof(struct thread_pool));
+  if (!result)
+    return NULL;
+  memset(result, 0, sizeof(struct thread_pool));
+
+  result->workers =
+      aligned_alloc(CACHE_LINE_SIZE, count * sizeof(struct worker));
+  if (!result->workers && count > 0) {
+    free(result);
+    return NULL;
+  }
+  result->worker_count = count;
+  pthread_mutex_init(&result->mutex, NULL);
+
+  size_t started = 0;
+  for (; started < count; started++) {
+    struct worker *worker = &result->workers[started];
+    *worker = (struct worker){.pool = result, .slot = started + 1};
+    if (pthread_create(&worker->thread, NULL, worker_thread, worker))
+      goto err;
+
+    if (cpus && cpus[started] >= 0 && worker_pin(worker, cpus[started])) {
+      started++;
+      goto err;
+    }
+  }
+
+  return result;
+
+err:
+  thread_pool_stop(result, started);
+  pthread_mutex_destroy(&result->mutex);
+  free(result->workers);
+  free(result);
+
+  return NULL;
+}
+
+void thread_pool_deinit(struct thread_pool *pool) {
+  if (pool == NULL)
+    return;
+
+  thread_pool_stop(pool, pool->worker_count);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->workers);
+  free(pool);
+}
+
+size_t thread_pool_slots(const struct thread_pool *pool) {
+  return pool->worker_count + 1;
+}
+
+void thread_pool_run(struct thread_pool *pool, thread_pool_func func,
+                     void *arg, size_t count) {
+  if (count == 0)
+    return;
+
+  struct thread_pool_batch batch = {.func = func, .arg = arg, .count = count};
+  atomic_init(&batch.remaining, count);
+
+  pthread_mutex_lock(&pool->mutex);
+  batch.queued_next = pool->head;
+  pool->head = &batch;
+  if (!pool->tail)
+    pool->tail = &batch;
+  pthread_mutex_unlock(&pool->mutex);
+  queue_signal(pool);
+
+  // Only the batch's own indices are taken, a long submitted batch would hold
+  // up the caller
+  size_t index;
+  while (queue_take(pool, &batch, &index))
+    batch_run(&batch, index, 0);
+
+  size_t spins = 0;
+  while (atomic_load_explicit(&batch.remaining, memory_order_acquire))
+    backoff(&spins);
+}
+
+void thread_pool_submit(struct thread_pool *pool,
+                        struct thread_pool_batch *batch) {
+  batch->next = 0;
+  batch->queued_next = NULL;
+  atomic_store_explicit(&batch->remaining, batch->count, memory_order_relaxed);
+  if (batch->count == 0)
+    return;
+
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->tail)
+    pool->tail->queued_next = batch;
+  else
+    pool->head = batch;
+  pool->tail = batch;
+  pthread_mutex_unlock(&pool->mutex);
+  queue_signal(pool);
+}
+
+void thread_pool_wait(struct thread_pool *pool, atomic_size_t *counter) {
+  size_t spins = 0;
+  while (atomic_load_explicit(counter, memory_order_acquire)) {
+    size_t index;
+    struct thread_pool_batch *batch = queue_take(pool, NULL, &index);
+    if (batch) {
+      batch_run(batch, index, 0);
+      spins = 0;
+    } else {
+      backoff(&spins);
+    }
+  }
+}
+
+void thread_pool_batch_wait(struct thread_pool_batch *batch) {
+  size_t spins = 0;
+  while (atomic_load_explicit(&batch->remaining, memory_order_acquire))
+    backoff(&spins);
+}
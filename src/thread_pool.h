@@ -0,0 +1,76 @@
+/**
+ * src/thread_pool.h
+ * Copyright (c) 2020 Matthew Murray <matt@compti.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CIG_THREAD_POOL_H
+#define CIG_THREAD_POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Called once for each index of a batch, `slot` is 0 on the thread that owns
+// the pool and 1 up to the worker count on the workers
+typedef void (*thread_pool_func)(void *arg, size_t index, size_t slot);
+
+// Work handed to the pool, `func` is called for every index below `count`
+struct thread_pool_batch {
+  thread_pool_func func;
+  void *arg;
+  size_t count;
+
+  // The next index to hand out, guarded by the pool's lock
+  size_t next;
+  // Indices that haven't finished, the pool is done with the batch once this
+  // reaches 0
+  atomic_size_t remaining;
+
+  struct thread_pool_batch *queued_next;
+};
+
+struct thread_pool;
+
+// Starts `count` workers, when `cpus` is not NULL each worker is pinned to the
+// CPU at its index, a negative CPU leaves the worker unpinned
+struct thread_pool *thread_pool_init(size_t count, const int *cpus);
+void thread_pool_deinit(struct thread_pool *pool);
+
+// The workers plus the thread that owns the pool
+size_t thread_pool_slots(const struct thread_pool *pool);
+
+// Runs `func` for every index below `count` on the workers and the calling
+// thread, returns once all of them have been run. The batch is handed out
+// ahead of any submitted ones.
+void thread_pool_run(struct thread_pool *pool, thread_pool_func func,
+                     void *arg, size_t count);
+
+// Queues the batch behind the others and returns, it can be called from any
+// thread including the workers
+void thread_pool_submit(struct thread_pool *pool,
+                        struct thread_pool_batch *batch);
+
+// Runs queued batches on the calling thread until `counter` reaches 0
+void thread_pool_wait(struct thread_pool *pool, atomic_size_t *counter);
+
+// Waits for the pool to be done with a submitted batch
+void thread_pool_batch_wait(struct thread_pool_batch *batch);
+
+#endif
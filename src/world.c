@@ -23,26 +23,62 @@
 #include <ciggurat.h>
 #include <mylib/mylib.h>
 
+#include "column_codec.h"
+#include "histogram.h"
+#include "perf_counters.h"
+#include "probes.h"
+#include "thread_pool.h"
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #define CHUNK_KB_SIZE 16
-#define CHUNK_BYTE_SIZE CHUNK_KB_SIZE * 1024
+#define CHUNK_BYTE_SIZE (CHUNK_KB_SIZE * 1024)
+
+#define CACHE_LINE_SIZE 64
+
+// How many chunks are written or read with a single system call when paging
+#define STREAM_IOV_COUNT 64
+
+// How many parts the regions of a storage are split into in deterministic
+// mode, each part is run with its own accumulator whatever the thread count
+#define DETERMINISTIC_PARTS 64
 
 struct entity_internal {
   // The storage that contains this entity's types. The storage also contains
   // the mask for the entity.
   struct storage *storage;
-  // A pointer to the entity's types in the storage.
-  void *ptr;
+  // The region that holds the entity's family and the family's index within
+  // the region.
+  struct region *region;
+  size_t index;
+};
+
+struct layout_field {
+  size_t offset, size;
 };
 
 struct storage_layout_type_desc {
   uint32_t id;
   size_t size;
-  size_t offset;
+  // Where the type is in a block and the bytes between the values of
+  // consecutive families within the block
+  size_t offset, stride;
+
+  // A split type has a column per field in its part of the block, its fields
+  // are at `first_field` in `storage_layout.fields`
+  size_t first_field, field_count;
 };
 
 struct storage_layout {
@@ -58,22 +94,102 @@ struct storage_layout {
 
   // The alignment for the family, derived from the widest type
   size_t alignment;
+
+  // How many families fit into a single region
+  size_t capacity;
+
+  // The offset in a region of the ids of the entities each family belongs to
+  size_t entities_offset;
+
+  // Families are grouped into blocks of `block_width` that are `block_size`
+  // bytes apart. A block of one family is the packed layout, wider blocks keep
+  // the values of each type next to each other.
+  size_t block_width, block_size;
+
+  // Set when the types with fields are split, contains the fields of every
+  // split type
+  int split_fields;
+  struct layout_field *fields;
+};
+
+// Where the values of a type are in a chunk, the value of family `i` is at
+// `offset + block_size * (i / block_width) + stride * (i % block_width)`
+struct column_layout {
+  size_t offset, stride, block_width, block_size;
+};
+
+struct shm_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t size;
+
+  // Odd while the world is being written, readers retry their reads unless it
+  // was even and unchanged throughout
+  atomic_uint_least64_t sequence;
+
+  // The directory of storages, see `shm_publish()`
+  uint64_t directory_offset, directory_capacity, directory_size;
+};
+
+// A named shared memory segment that the chunks of a world are allocated from
+struct shm_segment {
+  char *name;
+  void *ptr;
+  size_t size;
+  struct shm_header *header;
+
+  // Chunks are handed out from `first_chunk` onwards, freed chunks are reused
+  size_t first_chunk, chunk_count, next_chunk;
+  // Contains `void *`
+  Vector free_chunks;
+  // Chunks are freed by the I/O threads too
+  pthread_mutex_t mutex;
+
+  // Held by the world and by every chunk, the segment may outlive the world
+  // in a fork or an export
+  atomic_uint refs;
+};
+
+// The reference count of a chunk, it also tells where the chunk came from
+struct chunk_refs {
+  atomic_uint count;
+  // NULL when the chunk is on the heap
+  struct shm_segment *segment;
 };
 
 struct region {
+  // Families are packed from the start of the chunk, the ids of the entities
+  // they belong to are stored at `storage_layout.entities_offset`
   void *ptr;
   size_t count;
+
+  // How many regions share the chunk, forked worlds share a chunk until either
+  // of them writes to it
+  atomic_uint *refs;
+
+  // The `change_clock` when the region was last written to
+  uint64_t changed;
+
+  // The group the families of the region belong to in a grouped storage
+  uint64_t group;
+};
+
+struct region_span {
+  struct region *region;
+
+  // The first family in the region and how many families follow
+  size_t index, count;
 };
 
 struct storage_regions_request {
   // Pointer to the storage in context
   struct storage *storage;
 
-  // The requests regions
-  Vector regions;
+  // Contains `struct region_span`
+  Vector spans;
 
-  // The storage's unassigned Vector will be resized to this count on commit
-  size_t new_unassigned_count;
+  // How many regions were prepended to the storage for the request
+  size_t new_region_count;
 };
 
 struct storage {
@@ -84,11 +200,57 @@ struct storage {
   // Contains `struct region`
   LinkedList regions;
 
-  // Contains `void *`
+  // Contains empty `struct region` that can be reused
   Vector unassigned;
 
   // Contains systems that have matched with this storage.
   HashMap systems;
+
+  // How many entities are currently stored
+  size_t count;
+
+  // The segment new chunks are allocated from, NULL for the heap
+  struct shm_segment *segment;
+
+  // Keeps the families of each group in regions of their own, NULL unless the
+  // storage is grouped
+  struct grouping *grouping;
+};
+
+struct grouping {
+  CigGroupFunc func;
+  void *user_data;
+  // The type the group is computed from and where in it
+  int32_t id;
+  size_t offset;
+
+  // Regions written to at or after this `change_clock` are grouped again
+  uint64_t seen;
+};
+
+// How a system used a storage it matched, recorded while layout tuning is
+// enabled
+struct storage_access {
+  // A bit for each `idx` passed to `cig_system_get_component()`, the last bit
+  // also stands for every `idx` past it
+  atomic_uint_least64_t touched;
+  // The families the system ran on and the nanoseconds it took, a fused chain
+  // is timed by its head
+  uint64_t families, ns;
+};
+
+struct query {
+  // An array of type ids in the order in which they were requested
+  int32_t *types;
+
+  // The field requested of each type in `types`, -1 for the whole type
+  int32_t *fields;
+
+  // How many types are in `types`
+  size_t types_len;
+
+  // Requirements for a storage/entity to match
+  Bitset must_have, must_not_have;
 };
 
 struct system {
@@ -99,21 +261,232 @@ struct system {
   // which the types were defined
   int32_t *types;
 
+  // The field of each type the system operates on, -1 for the whole type
+  int32_t *fields;
+
   // How many types the system operates on
   size_t types_len;
 
   // Requirements for the system to match with a storage/entity
   Bitset must_have, must_not_have;
 
-  // Contains storages that have matched with this system
+  // Set when the system does not write to the components, so shared chunks do
+  // not have to be copied before running it
+  int read_only;
+
+  // Set when the system runs after the others, on a frozen copy of the chunks
+  // when the world is pipelined
+  int extract;
+
+  // Skips the regions of grouped storages it returns zero for, may be NULL
+  int (*group_filter)(uint64_t group, void *user_data);
+
+  // Contains storages that have matched with this system, each with its
+  // `struct storage_access`
   HashMap storages;
 
   CigSystemFunc func;
 
   void *user_data;
 
-  // An array of offsets to be set running the system
-  size_t *offsets;
+  // Arrays of offsets and strides to be set running the system
+  size_t *offsets, *strides;
+
+  // The next system to run on each region straight after this one
+  struct system *fused_next;
+
+  // Set when the system is run as part of another system's fused chain
+  int fused;
+
+  // Optional reduction, `accumulators` holds a private copy for each slot,
+  // each padded out to `accumulator_stride` so that no two slots share a
+  // cache line
+  CigReductionDesc reduction;
+  void *accumulators;
+  size_t accumulator_stride;
+  size_t accumulator_count;
+
+  // The combined accumulators from the last run
+  void *reduction_result;
+
+  // Written while the system runs, so it is kept out of line
+  CigSystemStats *stats;
+  // Durations of the runs in nanoseconds
+  struct histogram *latency;
+
+  // Contains `struct task *` that run after this system in a step
+  Vector tasks;
+};
+
+struct zone_page {
+  // The region in the world, its chunk is NULL while it is paged out
+  struct region *region;
+
+  // The chunk while it is in flight
+  void *ptr;
+  atomic_uint *refs;
+  size_t alignment;
+  struct shm_segment *segment;
+};
+
+struct zone {
+  // The id of the tag type that marks the entities in the zone
+  int32_t id;
+
+  // The file that the zone's chunks are paged out to
+  char *path;
+
+  CigZoneState state;
+
+  // Contains `struct zone_page`, in the order the chunks are in the file
+  Vector pages;
+
+  // The thread doing the I/O, `done` is set once it has finished and `failed`
+  // is set if any of the I/O failed
+  pthread_t thread;
+  int has_thread;
+  atomic_int done;
+  int failed;
+};
+
+struct export_column {
+  const char *identifier;
+  uint64_t size;
+  struct column_layout layout;
+};
+
+struct export_section {
+  // Contains `struct export_column`
+  Vector columns;
+
+  // Contains `struct region`, each holding a reference to its chunk
+  Vector regions;
+};
+
+typedef struct CigExport {
+  char *path;
+
+  // Contains `struct export_section`
+  Vector sections;
+
+  pthread_t thread;
+  int failed;
+} CigExport;
+
+struct byte_buffer {
+  uint8_t *data;
+  size_t len, capacity;
+};
+
+struct journal {
+  int fd;
+
+  // Records are appended to `active` by the simulation thread, a commit moves
+  // them to `committed` where the writer thread takes them from. The writer
+  // owns `writing`.
+  struct byte_buffer active, committed, writing;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  // Commits are numbered, every commit up to `durable` has been synced
+  uint64_t commits, durable;
+  int stop;
+  // Set if a record could not be buffered or written
+  atomic_int failed;
+};
+
+struct task {
+  char *identifier;
+  CigTaskFunc func;
+  void *user_data;
+  // The systems and tasks it runs after, kept for forks
+  char *after;
+
+  // How many systems and tasks it runs after, and how many of those haven't
+  // finished in the current step
+  size_t dependency_count;
+  atomic_size_t pending;
+
+  // Contains `struct task *` that run after this task
+  Vector dependents;
+
+  struct task_graph *graph;
+  struct thread_pool_batch batch;
+};
+
+struct task_graph {
+  // Contains `struct task *` in the order they were registered
+  Vector tasks;
+
+  // The tasks that haven't finished in the current step
+  atomic_size_t left;
+
+  // The pool of the current step, NULL when the tasks run on the calling
+  // thread as soon as they are ready
+  struct thread_pool *pool;
+};
+
+// The regions of a storage that an extraction system runs on
+struct extract_section {
+  // Only the layout is read, it doesn't change
+  const struct storage *storage;
+  // The offsets and strides of the system's types in the storage
+  size_t *offsets, *strides;
+  // Contains `struct region`, each holding a reference to its chunk
+  Vector regions;
+};
+
+struct extract_job {
+  struct system *system;
+  // Contains `struct extract_section`
+  Vector sections;
+};
+
+struct index_entry {
+  uint64_t key;
+  CigEntity entity;
+  // Only the entry with the sequence of the entity's record is current
+  uint64_t sequence;
+};
+
+struct index_record {
+  // The key of the entity's current entry, there is none while the sequence
+  // is 0
+  uint64_t key, sequence;
+};
+
+// Entities ordered by a numeric field, kept as a large sorted run and a small
+// one of the changes since they were last merged
+struct field_index {
+  char *identifier;
+  // The "type" or "type.field" of the key
+  char *field;
+  int32_t id;
+  size_t offset;
+  CigKeyKind kind;
+
+  // Contains `struct index_entry` sorted by key then entity
+  Vector entries, recent;
+  // Contains `struct index_record` for each entity
+  Vector records;
+  uint64_t sequence;
+
+  // Regions written to at or after this `change_clock` are read again
+  uint64_t seen;
+};
+
+// The extraction of the last step, running alongside the next one
+struct pipeline {
+  // Contains `struct extract_job`, one for each extraction system
+  Vector jobs;
+  double delta_time;
+
+  // The jobs that haven't finished
+  atomic_size_t left;
+  struct thread_pool_batch batch;
+  int running;
 };
 
 typedef struct CigWorld {
@@ -123,6 +496,13 @@ typedef struct CigWorld {
   HashMap storages;
   // Holds all of the registered systems
   HashMap systems;
+  // Contains `struct system *`, the systems in the order they were registered,
+  // which is the order they are run in
+  Vector system_order;
+  // Contains `struct storage *`, the storages created since the systems were
+  // last matched with them. Matched in bulk by `world_match_storages()`,
+  // behind a pointer as that happens in `cig_world_step()`.
+  Vector *unmatched;
 
   // Keep track of the next Entity ID to use
   CigEntity next_entity;
@@ -132,40 +512,237 @@ typedef struct CigWorld {
   Vector unassigned;
   // Runtime allocated array of the last entities that were spawned
   CigEntity *last_spawned;
+
+  // Contains `struct zone *`
+  Vector zones;
+
+  // The journal of changes, NULL unless one is open
+  struct journal *journal;
+
+  // The segment readers in other processes map, NULL unless the world is
+  // shared
+  struct shm_segment *shm;
+
+  // Read around every system run, NULL unless enabled
+  struct perf_counters *counters;
+
+  // Durations of `cig_world_step()` in nanoseconds
+  struct histogram *step_latency;
+
+  // Runs the regions of a storage in parallel, NULL when systems only run on
+  // the calling thread
+  struct thread_pool *pool;
+
+  // Tasks that run alongside the systems, NULL until one is registered
+  struct task_graph *tasks;
+
+  // Extraction of a step runs during the next step, NULL unless pipelined
+  struct pipeline *pipeline;
+
+  // Set while the systems record how they use each storage for
+  // `cig_world_tune_layouts()`
+  int tuning;
+
+  // Set when a step must give the same results whatever the number of threads
+  int deterministic;
+
+  // Contains `struct field_index *`
+  Vector indexes;
 } CigWorld;
 
 typedef struct CigSystemCtx {
-  // Pointer to the components
+  // Pointer to the block of the family and the family's lane in the block
   void *ptr;
-  // The offsets for types being operated on
-  const size_t *offsets;
+  size_t lane;
+  // The offsets and strides for types being operated on
+  const size_t *offsets, *strides;
 
   void *user_data;
+
+  // The private accumulator for the slot that is running the system
+  void *accumulator;
+
+  // Where the components asked for are recorded, NULL unless tuning
+  atomic_uint_least64_t *touched;
+
+  // The group of the region, 0 unless the storage is grouped
+  uint64_t group;
 } CigSystemCtx;
 
-static int region_init(struct region *result, size_t alignment) {
-  *result = (struct region){0};
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t round_up(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+static void shm_segment_release(struct shm_segment *segment) {
+  if (atomic_fetch_sub(&segment->refs, 1) > 1)
+    return;
+
+  munmap(segment->ptr, segment->size);
+  vector_deinit(&segment->free_chunks);
+  pthread_mutex_destroy(&segment->mutex);
+  free(segment->name);
+  free(segment);
+}
+
+// Marks the segment as being written until the next `shm_publish()`
+static void shm_begin_write(struct shm_segment *segment) {
+  uint_least64_t sequence = atomic_load(&segment->header->sequence);
+  while (!(sequence & 1) &&
+         !atomic_compare_exchange_weak(&segment->header->sequence, &sequence,
+                                       sequence + 1))
+    ;
+}
+
+static void *shm_alloc_chunk(struct shm_segment *segment, size_t alignment) {
+  // Chunks are only aligned to the pages of the mapping
+  if (alignment > (size_t)sysconf(_SC_PAGESIZE))
+    return NULL;
+
+  void *result = NULL;
+  pthread_mutex_lock(&segment->mutex);
+  const size_t free_count = vector_len(&segment->free_chunks);
+  if (free_count > 0) {
+    result = *(void **)vector_get(&segment->free_chunks, free_count - 1);
+    vector_resize(&segment->free_chunks, free_count - 1);
+  } else if (segment->next_chunk < segment->chunk_count) {
+    result = segment->ptr + segment->first_chunk +
+             CHUNK_BYTE_SIZE * segment->next_chunk++;
+  }
+  pthread_mutex_unlock(&segment->mutex);
+
+  if (!result)
+    fprintf(stderr, "%s(): The segment (%s) is full.\n", __func__,
+            segment->name);
+  return result;
+}
+
+// Allocates a chunk with a reference count of 1 from the segment, or from the
+// heap when `segment` is NULL
+static int chunk_alloc(struct shm_segment *segment, size_t alignment,
+                       void **ptr, atomic_uint **refs) {
+  struct chunk_refs *chunk_refs = malloc(sizeof(struct chunk_refs));
+  if (!chunk_refs)
+    return EXIT_FAILURE;
+
   // TODO The allocation size can be less depending on the family_size
-  result->ptr = aligned_alloc(alignment, CHUNK_BYTE_SIZE);
+  *ptr = segment ? shm_alloc_chunk(segment, alignment)
+                 : aligned_alloc(alignment, CHUNK_BYTE_SIZE);
+  if (!*ptr) {
+    free(chunk_refs);
+    return EXIT_FAILURE;
+  }
+
+  atomic_init(&chunk_refs->count, 1);
+  chunk_refs->segment = segment;
+  if (segment) {
+    shm_begin_write(segment);
+    atomic_fetch_add(&segment->refs, 1);
+  }
+
+  *refs = &chunk_refs->count;
+  return EXIT_SUCCESS;
+}
+
+static struct shm_segment *chunk_segment(atomic_uint *refs) {
+  return ((struct chunk_refs *)refs)->segment;
+}
+
+// Frees a chunk once its last reference has been dropped
+static void chunk_free(void *ptr, atomic_uint *refs) {
+  struct shm_segment *segment = chunk_segment(refs);
+  free(refs);
+
+  if (!segment) {
+    free(ptr);
+    return;
+  }
+
+  shm_begin_write(segment);
+  pthread_mutex_lock(&segment->mutex);
+  if (vector_append(&segment->free_chunks, &ptr))
+    fprintf(stderr, "%s(): Leaking a chunk of (%s).\n", __func__,
+            segment->name);
+  pthread_mutex_unlock(&segment->mutex);
+  shm_segment_release(segment);
+}
+
+static int region_init(struct region *result, const struct storage *storage) {
+  *result = (struct region){0};
+  if (chunk_alloc(storage->segment, storage->layout.alignment, &result->ptr,
+                  &result->refs))
+    return EXIT_FAILURE;
+
+  // The whole chunk is written out by exports, zones and shared segments, so
+  // unused capacity and padding can't be left holding stale bytes
   memset(result->ptr, 0, CHUNK_BYTE_SIZE);
-  return result->ptr == NULL ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  CIG_PROBE2(region_alloc, storage, result->ptr);
+  return EXIT_SUCCESS;
 }
 
 static void region_deinit(struct region *region) {
-  if (region == NULL)
+  // Paged out regions have no chunk
+  if (region == NULL || region->refs == NULL)
+    return;
+
+  // The chunk is only freed along with the last region that shares it
+  if (atomic_fetch_sub(region->refs, 1) > 1)
     return;
-  free(region->ptr);
+
+  chunk_free(region->ptr, region->refs);
+}
+
+// Stamped on the regions as they are written to, indexes read again the
+// regions stamped since they were last brought up to date
+static atomic_uint_least64_t change_clock = 1;
+
+// Gives the region a private copy of its chunk if it is shared with a forked
+// world, or if the chunk isn't from the storage's allocator. This must be
+// called before anything is written to the region.
+static int region_make_unique(struct region *region,
+                              const struct storage *storage) {
+  if (!region->ptr)
+    return EXIT_FAILURE;
+
+  region->changed = atomic_load_explicit(&change_clock, memory_order_relaxed);
+
+  if (storage->segment)
+    shm_begin_write(storage->segment);
+
+  if (atomic_load(region->refs) == 1 &&
+      chunk_segment(region->refs) == storage->segment)
+    return EXIT_SUCCESS;
+
+  void *ptr;
+  atomic_uint *refs;
+  if (chunk_alloc(storage->segment, storage->layout.alignment, &ptr, &refs))
+    return EXIT_FAILURE;
+
+  memcpy(ptr, region->ptr, CHUNK_BYTE_SIZE);
+
+  // Drop the reference to the shared chunk
+  region_deinit(region);
+  region->ptr = ptr;
+  region->refs = refs;
+
+  return EXIT_SUCCESS;
 }
 
-static const CigTypeDesc *get_type(CigWorld *w, int32_t id) {
+static const CigTypeDesc *get_type(const CigWorld *w, int32_t id) {
   return vector_get_const(&w->types, id);
 }
 
-static size_t get_size(CigWorld *w, int32_t id) {
+static size_t get_size(const CigWorld *w, int32_t id) {
   return get_type(w, id)->size;
 }
 
-static size_t get_alignment(CigWorld *w, int32_t id) {
+static size_t get_alignment(const CigWorld *w, int32_t id) {
   return get_type(w, id)->alignment;
 }
 
@@ -183,6 +760,75 @@ static int32_t get_id(const CigWorld *w, const char *type_str) {
   return -1;
 }
 
+static void type_deinit(CigTypeDesc *type) {
+  for (size_t i = 0; type->fields && i < type->field_count; i++)
+    free(type->fields[i].identifier);
+  free(type->fields);
+  free(type->identifier);
+}
+
+static int32_t type_find_field(const CigTypeDesc *type, const char *str) {
+  for (size_t i = 0; i < type->field_count; i++)
+    if (strcmp(type->fields[i].identifier, str) == 0)
+      return i;
+
+  return -1;
+}
+
+// Finds the type of "type" or "type.field", `field` is -1 for the whole type
+static int32_t get_field_id(const CigWorld *w, const char *str,
+                            int32_t *field) {
+  *field = -1;
+  const char *dot = strchr(str, '.');
+  if (!dot)
+    return get_id(w, str);
+
+  char *type_str = strndup(str, dot - str);
+  if (!type_str)
+    return -1;
+
+  const int32_t id = get_id(w, type_str);
+  free(type_str);
+  if (id < 0)
+    return -1;
+
+  *field = type_find_field(get_type(w, id), dot + 1);
+  if (*field < 0) {
+#ifdef DEBUG
+    printf("%s(): Could not find a field matching (%s).\n", __func__, str);
+#endif
+    return -1;
+  }
+
+  return id;
+}
+
+// The identifier of a field as it is requested, "type.field"
+static char *get_field_name(const CigTypeDesc *type, size_t field) {
+  const char *identifier = type->fields[field].identifier;
+  const size_t len = strlen(type->identifier) + strlen(identifier) + 2;
+  char *result = malloc(len);
+  if (result)
+    snprintf(result, len, "%s.%s", type->identifier, identifier);
+  return result;
+}
+
+// A type can be split when its fields don't overlap and cover every byte
+static int type_is_splittable(const CigTypeDesc *type) {
+  size_t covered = 0;
+  for (size_t i = 0; i < type->field_count; i++) {
+    const CigFieldDesc *a = &type->fields[i];
+    for (size_t j = 0; j < i; j++) {
+      const CigFieldDesc *b = &type->fields[j];
+      if (a->offset < b->offset + b->size && b->offset < a->offset + a->size)
+        return 0;
+    }
+    covered += a->size;
+  }
+
+  return type->field_count > 1 && covered == type->size;
+}
+
 static int calculate_layout(CigWorld *w, struct storage_layout *layout,
                             Bitset mask) {
 
@@ -267,46 +913,267 @@ static int calculate_layout(CigWorld *w, struct storage_layout *layout,
            layout->types[i].id, layout->types[i].size, layout->types[i].offset);
 #endif
   }
+
+  // Leave room for the id of each family's entity, with slack for aligning
+  // the ids after the families
+  layout->capacity = (CHUNK_BYTE_SIZE - sizeof(CigEntity)) /
+                     (layout->family_size + sizeof(CigEntity));
+  layout->entities_offset =
+      round_up(layout->capacity * layout->family_size, _Alignof(CigEntity));
+
+  // Every family is a block of its own and no type is split
+  layout->block_width = 1;
+  layout->block_size = layout->family_size;
+  for (size_t i = 0; i < layout->count; i++) {
+    layout->types[i].stride = layout->family_size;
+    layout->types[i].first_field = 0;
+    layout->types[i].field_count = 0;
+  }
+
 #ifdef DEBUG
-  printf("%s(): family size: %zu, alignment: %zu\n", __func__,
-         layout->family_size, layout->alignment);
+  printf("%s(): family size: %zu, alignment: %zu, capacity: %zu\n", __func__,
+         layout->family_size, layout->alignment, layout->capacity);
 #endif
 
   return EXIT_SUCCESS;
 }
 
-static uint32_t system_hash(const void *system_ptr) {
-  const struct system *system = *(struct system **)system_ptr;
-  return fnv1a_32_hash((const uint8_t *)system->identifier,
-                       strlen(system->identifier) + 1);
+static void layout_deinit(struct storage_layout *layout) {
+  free(layout->fields);
+  free(layout->types);
 }
 
-static int system_eql(const void *a_ptr, const void *b_ptr) {
-  const struct system *a = *(const struct system **)a_ptr;
-  const struct system *b = *(const struct system **)b_ptr;
-  return strcmp(a->identifier, b->identifier) == 0;
-}
+static int layout_clone(const struct storage_layout *layout,
+                        struct storage_layout *result) {
+  size_t field_count = 0;
+  for (size_t i = 0; i < layout->count; i++)
+    field_count += layout->types[i].field_count;
+
+  *result = *layout;
+  result->types = malloc(layout->count * sizeof(*layout->types));
+  result->fields = malloc(field_count * sizeof(*layout->fields));
+  if (!result->types || (!result->fields && field_count > 0)) {
+    layout_deinit(result);
+    return EXIT_FAILURE;
+  }
 
-static int storage_init(CigWorld *w, struct storage *result, Bitset mask) {
-  *result = (struct storage){0};
+  memcpy(result->types, layout->types, layout->count * sizeof(*layout->types));
+  if (field_count > 0)
+    memcpy(result->fields, layout->fields,
+           field_count * sizeof(*layout->fields));
 
-  result->regions = linked_list_init();
+  return EXIT_SUCCESS;
+}
 
-  if (vector_init(&result->unassigned, sizeof(struct region)))
-    goto err;
+// Whether chunks of the two layouts are read the same way
+static int layout_eql(const struct storage_layout *a,
+                      const struct storage_layout *b) {
+  if (a->count != b->count || a->block_width != b->block_width ||
+      a->block_size != b->block_size || a->split_fields != b->split_fields ||
+      a->entities_offset != b->entities_offset)
+    return 0;
 
-  if (hash_map_init(&result->systems, system_hash, system_eql,
-                    sizeof(struct system *), 0))
-    goto err;
+  for (size_t i = 0; i < a->count; i++)
+    if (a->types[i].id != b->types[i].id ||
+        a->types[i].offset != b->types[i].offset ||
+        a->types[i].stride != b->types[i].stride ||
+        a->types[i].field_count != b->types[i].field_count)
+      return 0;
 
-  if (calculate_layout(w, &result->layout, mask))
-    goto err;
+  return 1;
+}
 
-  result->mask = mask;
+// Groups the families of a packed layout into blocks of `width`, each type
+// then has `width` values side by side in every block. With `split` set, the
+// types that can be split have `width` values of each field side by side
+// instead.
+static int layout_tile(const CigWorld *w, struct storage_layout *layout,
+                       size_t width, int split) {
+  size_t field_count = 0;
+  for (size_t i = 0; split && i < layout->count; i++) {
+    const CigTypeDesc *type = get_type(w, layout->types[i].id);
+    if (type_is_splittable(type))
+      field_count += type->field_count;
+  }
 
-  return EXIT_SUCCESS;
+  struct layout_field *fields =
+      malloc(field_count * sizeof(struct layout_field));
+  if (!fields && field_count > 0)
+    return EXIT_FAILURE;
 
-err:
+  field_count = 0;
+  size_t block_size = 0;
+  for (size_t i = 0; i < layout->count; i++) {
+    const CigTypeDesc *type = get_type(w, layout->types[i].id);
+    block_size = round_up(block_size, type->alignment);
+    layout->types[i].offset = block_size;
+    layout->types[i].stride = type->size;
+    block_size += type->size * width;
+
+    layout->types[i].first_field = field_count;
+    layout->types[i].field_count = 0;
+    if (!split || !type_is_splittable(type))
+      continue;
+
+    for (size_t j = 0; j < type->field_count; j++)
+      fields[field_count++] = (struct layout_field){
+          .offset = type->fields[j].offset, .size = type->fields[j].size};
+    layout->types[i].field_count = type->field_count;
+  }
+  block_size = round_up(block_size, layout->alignment);
+
+  // Leave room for the ids of a whole block of families
+  const size_t blocks = (CHUNK_BYTE_SIZE - sizeof(CigEntity)) /
+                        (block_size + sizeof(CigEntity) * width);
+  if (blocks == 0) {
+    fprintf(stderr, "%s(): A block of (%zu) families doesn't fit a chunk.\n",
+            __func__, width);
+    free(fields);
+    return EXIT_FAILURE;
+  }
+
+  free(layout->fields);
+  layout->fields = fields;
+  layout->split_fields = split;
+  layout->block_width = width;
+  layout->block_size = block_size;
+  layout->capacity = blocks * width;
+  layout->entities_offset = round_up(blocks * block_size, _Alignof(CigEntity));
+
+#ifdef DEBUG
+  printf("%s(): block width: %zu, block size: %zu, capacity: %zu\n", __func__,
+         width, block_size, layout->capacity);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+static struct column_layout layout_column(const struct storage_layout *layout,
+                                          size_t index) {
+  return (struct column_layout){.offset = layout->types[index].offset,
+                                .stride = layout->types[index].stride,
+                                .block_width = layout->block_width,
+                                .block_size = layout->block_size};
+}
+
+// The column of the byte at `offset` in the values of a type and how many bytes
+// from it are in the same column. The bytes of a split type are in a column per
+// field, a whole type has one column for the rest of the value.
+static struct column_layout layout_bytes(const struct storage_layout *layout,
+                                         size_t index, size_t offset,
+                                         size_t *len) {
+  const struct storage_layout_type_desc *type = &layout->types[index];
+  struct column_layout column = layout_column(layout, index);
+
+  for (size_t i = 0; i < type->field_count; i++) {
+    const struct layout_field *field = &layout->fields[type->first_field + i];
+    if (offset >= field->offset && offset < field->offset + field->size) {
+      column.offset +=
+          column.block_width * field->offset + offset - field->offset;
+      column.stride = field->size;
+      *len = field->offset + field->size - offset;
+      return column;
+    }
+  }
+
+  column.offset += offset;
+  *len = SIZE_MAX;
+  return column;
+}
+
+// The entity ids are packed after the blocks
+static struct column_layout
+layout_entities(const struct storage_layout *layout) {
+  return (struct column_layout){.offset = layout->entities_offset,
+                                .stride = sizeof(CigEntity),
+                                .block_width = 1,
+                                .block_size = sizeof(CigEntity)};
+}
+
+static size_t column_at(const struct column_layout *column, size_t index) {
+  return column->offset + column->block_size * (index / column->block_width) +
+         column->stride * (index % column->block_width);
+}
+
+// Copies `count` components of `size` bytes, as a single run when both sides
+// are packed
+static void copy_strided(void *dest, size_t dest_stride, const void *src,
+                         size_t src_stride, size_t size, size_t count) {
+  if (dest_stride == size && src_stride == size) {
+    memcpy(dest, src, size * count);
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    memcpy(dest + dest_stride * i, src + src_stride * i, size);
+}
+
+// How many of the `count` values from `index` are `stride` bytes apart, a
+// packed column is a single run
+static size_t column_run(const struct column_layout *column, size_t index,
+                         size_t count, size_t *stride) {
+  if (column->block_width == 1) {
+    *stride = column->block_size;
+    return count;
+  }
+
+  *stride = column->stride;
+  const size_t left = column->block_width - index % column->block_width;
+  return left < count ? left : count;
+}
+
+// Copies `count` values of `size` bytes from the families of `src` starting at
+// `src_index` into the families of `dest` starting at `dest_index`
+static void copy_column(void *dest, const struct column_layout *dest_column,
+                        size_t dest_index, const void *src,
+                        const struct column_layout *src_column,
+                        size_t src_index, size_t size, size_t count) {
+  while (count > 0) {
+    size_t dest_stride, src_stride;
+    size_t n = column_run(dest_column, dest_index, count, &dest_stride);
+    n = column_run(src_column, src_index, n, &src_stride);
+
+    copy_strided(dest + column_at(dest_column, dest_index), dest_stride,
+                 src + column_at(src_column, src_index), src_stride, size, n);
+    dest_index += n;
+    src_index += n;
+    count -= n;
+  }
+}
+
+static uint32_t system_hash(const void *system_ptr) {
+  const struct system *system = *(struct system **)system_ptr;
+  return fnv1a_32_hash((const uint8_t *)system->identifier,
+                       strlen(system->identifier) + 1);
+}
+
+static int system_eql(const void *a_ptr, const void *b_ptr) {
+  const struct system *a = *(const struct system **)a_ptr;
+  const struct system *b = *(const struct system **)b_ptr;
+  return strcmp(a->identifier, b->identifier) == 0;
+}
+
+static int storage_init(CigWorld *w, struct storage *result, Bitset mask) {
+  *result = (struct storage){0};
+
+  result->regions = linked_list_init();
+
+  if (vector_init(&result->unassigned, sizeof(struct region)))
+    goto err;
+
+  if (hash_map_init(&result->systems, system_hash, system_eql,
+                    sizeof(struct system *), 0))
+    goto err;
+
+  if (calculate_layout(w, &result->layout, mask))
+    goto err;
+
+  result->mask = mask;
+  result->segment = w->shm;
+
+  return EXIT_SUCCESS;
+
+err:
   hash_map_deinit(&result->systems);
   vector_deinit(&result->unassigned);
   linked_list_deinit(&result->regions);
@@ -318,23 +1185,24 @@ static void storage_deinit(struct storage *storage) {
   if (storage == NULL)
     return;
 
-  if (storage->layout.family_size > 0) {
-    // For each region, deinitialize
-    LinkedListNode *node = storage->regions.first;
-    if (node) {
-      do {
-        region_deinit((struct region *)node->data);
-      } while ((node = node->next));
-    }
+  // For each region, deinitialize
+  LinkedListNode *node = storage->regions.first;
+  if (node) {
+    do {
+      region_deinit((struct region *)node->data);
+    } while ((node = node->next));
   }
 
   linked_list_deinit(&storage->regions);
 
+  for (size_t i = 0; i < vector_len(&storage->unassigned); i++)
+    region_deinit(vector_get(&storage->unassigned, i));
   vector_deinit(&storage->unassigned);
   hash_map_deinit(&storage->systems);
   bitset_deinit(&storage->mask);
+  free(storage->grouping);
 
-  free(storage->layout.types);
+  layout_deinit(&storage->layout);
 }
 
 static void system_deinit(struct system *system) {
@@ -343,7 +1211,15 @@ static void system_deinit(struct system *system) {
 
   hash_map_deinit(&system->storages);
 
+  free(system->accumulators);
+  free(system->reduction_result);
+  free(system->stats);
+  free(system->latency);
+  vector_deinit(&system->tasks);
+
+  free(system->strides);
   free(system->offsets);
+  free(system->fields);
   free(system->types);
 
   free(system->identifier);
@@ -355,215 +1231,301 @@ static int is_match(const Bitset mask, const Bitset must_have,
          bitset_is_subset(&must_have, &mask);
 }
 
-static int storage_find_matches(CigWorld *w, struct storage *storage) {
-  HashMapIterator it = hash_map_iter(&w->systems);
-  const HashMapKV *kv;
-  while ((kv = hash_map_next(&it))) {
-    struct system *system = kv->value;
-    if (!is_match(storage->mask, system->must_have, system->must_not_have))
-      continue;
-
-    if (hash_map_put(&storage->systems, &system, NULL) ||
-        hash_map_put(&system->storages, &storage, NULL))
-      goto err;
-
-#ifdef DEBUG
-    // TODO Also print out the IDs of types that are contained the storage
-    printf("%s(): Storage matched with system (%s).\n", __func__,
-           system->identifier);
-#endif
-  }
-  return EXIT_SUCCESS;
-
-err:
-  // Reset the iterator back to the first kv
-  it = hash_map_iter(it.map);
-  const HashMapKV *target = kv;
-  while ((kv = hash_map_next(&it))) {
-    struct system *system = kv->value;
-    hash_map_delete(&storage->systems, system);
-    hash_map_delete(&system->storages, storage);
-
-    if (kv == target)
-      break;
-  }
-
-  return EXIT_FAILURE;
-}
-
+// Takes ownership of `mask`
 static struct storage *get_storage(CigWorld *w, Bitset mask) {
   int has_existing;
   const HashMapKV *kv = hash_map_get_or_put(&w->storages, &mask, &has_existing);
 
   // NULL means that `hash_map_get_or_put()` operation failed
-  if (!kv)
+  if (!kv) {
+    bitset_deinit(&mask);
     return NULL;
+  }
 
-  if (has_existing)
+  // The existing storage already owns an equal mask
+  if (has_existing) {
+    bitset_deinit(&mask);
     return kv->value;
+  }
 
   struct storage storage;
-  if (storage_init(w, &storage, mask))
+  if (storage_init(w, &storage, mask)) {
+    hash_map_delete(&w->storages, &mask);
+    bitset_deinit(&mask);
     return NULL;
+  }
 
   hash_map_kv_assign(&w->storages, kv, &storage);
 
-  if (storage_find_matches(w, kv->value)) {
+  // Matched with the systems by the next step, most storages of a bulk load
+  // are only ever run once
+  struct storage *stored = kv->value;
+  if (vector_append(w->unmatched, &stored)) {
     hash_map_delete(&w->storages, &mask);
+    storage_deinit(&storage);
     return NULL;
   }
 
+  CIG_PROBE4(storage_create, kv->value, storage.layout.count,
+             storage.layout.family_size, storage.layout.capacity);
   return kv->value;
 }
 
+// The new storages and the systems to match them with. Each job only writes to
+// the matches of one system or one storage, so they can run in parallel.
+struct match_job {
+  struct system **systems;
+  size_t system_count;
+  struct storage **storages;
+  size_t storage_count;
+  atomic_int failed;
+};
+
+static void match_job_run(void *job_ptr, size_t index, size_t slot) {
+  struct match_job *job = job_ptr;
+
+  // The systems come first, then the storages
+  if (index < job->system_count) {
+    struct system *system = job->systems[index];
+    for (size_t i = 0; i < job->storage_count; i++) {
+      struct storage *storage = job->storages[i];
+      if (!is_match(storage->mask, system->must_have, system->must_not_have))
+        continue;
+
+      struct storage_access access = {0};
+      if (hash_map_put(&system->storages, &storage, &access)) {
+        atomic_store(&job->failed, 1);
+        return;
+      }
+    }
+    return;
+  }
+
+  struct storage *storage = job->storages[index - job->system_count];
+  for (size_t i = 0; i < job->system_count; i++) {
+    struct system *system = job->systems[i];
+    if (is_match(storage->mask, system->must_have, system->must_not_have) &&
+        hash_map_put(&storage->systems, &system, NULL)) {
+      atomic_store(&job->failed, 1);
+      return;
+    }
+  }
+}
+
+// Matches the storages created since the last call with the systems, in bulk
+// and on the workers when there are any
+static int world_match_storages(const CigWorld *w) {
+  const size_t storage_count = vector_len(w->unmatched);
+  if (storage_count == 0)
+    return EXIT_SUCCESS;
+
+  struct match_job job = {.systems = w->system_order.data,
+                          .system_count = vector_len(&w->system_order),
+                          .storages = w->unmatched->data,
+                          .storage_count = storage_count};
+  const size_t count = job.system_count + storage_count;
+  if (w->pool)
+    thread_pool_run(w->pool, match_job_run, &job, count);
+  else
+    for (size_t i = 0; i < count; i++)
+      match_job_run(&job, i, 0);
+
+  if (atomic_load(&job.failed)) {
+    // Left to be matched again, without the matches that were made
+    for (size_t i = 0; i < job.system_count; i++) {
+      for (size_t j = 0; j < storage_count; j++) {
+        hash_map_delete(&job.systems[i]->storages, &job.storages[j]);
+        hash_map_delete(&job.storages[j]->systems, &job.systems[i]);
+      }
+    }
+    return EXIT_FAILURE;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Matched (%zu) storages with (%zu) systems.\n", __func__,
+         storage_count, job.system_count);
+#endif
+
+  vector_resize(w->unmatched, 0);
+  return EXIT_SUCCESS;
+}
+
+// The block that holds the family at `index`
+static void *region_block(const struct storage *storage,
+                          const struct region *region, size_t index) {
+  const struct storage_layout *layout = &storage->layout;
+  return region->ptr + layout->block_size * (index / layout->block_width);
+}
+
+static CigEntity *region_entities(const struct storage *storage,
+                                  const struct region *region) {
+  return region->ptr + storage->layout.entities_offset;
+}
+
+// Zeroes every type of `count` families from `index`
+static void region_zero(const struct storage *storage,
+                        const struct region *region, size_t index,
+                        size_t count) {
+  const struct storage_layout *layout = &storage->layout;
+  if (layout->block_width == 1) {
+    memset(region_block(storage, region, index), 0,
+           layout->family_size * count);
+    return;
+  }
+
+  // A split type is zeroed a field at a time, within a block the stride of a
+  // type is its size without padding
+  for (size_t t = 0; t < layout->count; t++)
+    for (size_t offset = 0, len; offset < layout->types[t].stride;
+         offset += len) {
+      const struct column_layout column = layout_bytes(layout, t, offset, &len);
+      for (size_t i = index, n; i < index + count; i += n) {
+        size_t stride;
+        n = column_run(&column, i, index + count - i, &stride);
+        memset(region->ptr + column_at(&column, i), 0, stride * n);
+      }
+    }
+}
+
+// Whether the family at `index` in the region still belongs to its entity
+static int is_family_owned(const CigWorld *w, const struct storage *storage,
+                           const struct region *region, size_t index) {
+  const CigEntity id = region_entities(storage, region)[index];
+  const struct entity_internal *e = vector_get_const(&w->entities, id);
+  return e->region == region && e->index == index;
+}
+
+static int storage_is_paged_out(const struct storage *storage) {
+  for (LinkedListNode *node = storage->regions.first; node;
+       node = node->next)
+    if (!((struct region *)node->data)->ptr)
+      return 1;
+
+  return 0;
+}
+
+static void storage_unassign_region(struct storage *storage,
+                                    struct region *region) {
+  // A shared chunk still holds families of the other world, and if we fail to
+  // append, more than likely we are OOM so instead just free the region
+  if (!region->refs || atomic_load(region->refs) > 1 ||
+      vector_append(&storage->unassigned, region)) {
+    region_deinit(region);
+    return;
+  }
+
+  struct region *unassigned =
+      vector_get(&storage->unassigned, vector_len(&storage->unassigned) - 1);
+  unassigned->count = 0;
+}
+
 static int prepend_new_region(struct storage *storage) {
   struct region region;
-  if (region_init(&region, storage->layout.alignment))
+
+  // Prefer reusing an empty region over allocating a new one
+  const size_t unassigned_count = vector_len(&storage->unassigned);
+  if (unassigned_count > 0) {
+    region = *(struct region *)vector_get(&storage->unassigned,
+                                          unassigned_count - 1);
+    vector_resize(&storage->unassigned, unassigned_count - 1);
+    memset(region.ptr, 0, CHUNK_BYTE_SIZE);
+  } else if (region_init(&region, storage)) {
     return EXIT_FAILURE;
+  }
 
   if (linked_list_prepend(&storage->regions, &region, sizeof(struct region))) {
-    region_deinit(&region);
+    storage_unassign_region(storage, &region);
     return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
 }
 
+static void
+storage_regions_request_commit(struct storage_regions_request *request,
+                               int commit) {
+  if (commit) {
+#ifdef DEBUG
+    printf("%s(): Committed modification of the storage.\n", __func__);
+#endif
+  } else {
+    // Give back the families that were taken from each region
+    struct region_span *spans = request->spans.data;
+    for (size_t i = 0; i < vector_len(&request->spans); i++)
+      spans[i].region->count -= spans[i].count;
+
+    // The new regions were prepended, so they are at the front of the list
+    for (size_t i = 0; i < request->new_region_count; i++) {
+      LinkedListNode *node = linked_list_pop_first(&request->storage->regions);
+      storage_unassign_region(request->storage, node->data);
+      linked_list_node_deinit(node);
+    }
+  }
+
+  vector_deinit(&request->spans);
+}
+
+// When `zero` is not set the requested families are left uninitialized, the
+// caller must then write every type of each family
 static int storage_request_regions(struct storage *storage,
                                    struct storage_regions_request *result,
-                                   size_t count) {
+                                   size_t count, int zero) {
   *result = (struct storage_regions_request){0};
   result->storage = storage;
 
-  if (vector_init(&result->regions, sizeof(struct region)))
+  if (vector_init(&result->spans, sizeof(struct region_span)))
     return EXIT_FAILURE;
 
-  // Handle the zero sized family
-  if (storage->layout.family_size == 0) {
-    struct region region = {
-        .ptr = NULL,
-        .count = count,
-    };
-    if (linked_list_prepend(&storage->regions, &region,
-                            sizeof(struct region))) {
-      vector_deinit(&result->regions);
-      return EXIT_FAILURE;
-    }
-
-    if (vector_append(&result->regions, storage->regions.first)) {
-      linked_list_delete(&storage->regions, storage->regions.first);
-      vector_deinit(&result->regions);
-      return EXIT_FAILURE;
-    }
-
-    return EXIT_SUCCESS;
-  }
+  const size_t capacity = storage->layout.capacity;
 
   size_t i = 0;
-  const size_t unassigned_count = vector_len(&storage->unassigned);
-
-  // Keep track of the resulting capacity after we have taken from `unassigned`
-  result->new_unassigned_count = unassigned_count;
-  while (result->new_unassigned_count > 0) {
-    struct region *region =
-        vector_get(&storage->unassigned, result->new_unassigned_count - 1);
-    if (!vector_append(&result->regions, region)) {
-      vector_deinit(&result->regions);
-      return EXIT_FAILURE;
-    }
-
-    i++;
-    result->new_unassigned_count--;
-  }
-
   while (i < count) {
     LinkedListNode *node = storage->regions.first;
-    const size_t families_per_region =
-        (CHUNK_BYTE_SIZE / storage->layout.family_size);
 
-    // Create a new region if the first node in the list is NULL or if the
-    // region is full
-    if (!node ||
-        (families_per_region - ((struct region *)node->data)->count) == 0) {
+    // Create a new region if the first node in the list is NULL, if the
+    // region is full or if it is paged out, new regions are already zeroed
+    int fresh = 0;
+    if (!node || ((struct region *)node->data)->count == capacity ||
+        !((struct region *)node->data)->ptr) {
       if (prepend_new_region(storage))
         goto err;
 
+      result->new_region_count++;
       node = storage->regions.first;
+      fresh = 1;
     }
 
     struct region *region = node->data;
 
-    // Get the current offset for the region
-    size_t offset = region->count * storage->layout.family_size;
+    // The region may still be shared with a forked world
+    if (region_make_unique(region, storage))
+      goto err;
 
     // How many more families can fit into the region
-    size_t free_count = families_per_region - region->count;
+    size_t free_count = capacity - region->count;
 
     // And how many will we actually use
     size_t j = free_count < count - i ? free_count : count - i;
 
-    struct region to_append = {.ptr = region->ptr + offset, .count = j};
-    if (vector_append(&result->regions, &to_append))
+    struct region_span span = {
+        .region = region, .index = region->count, .count = j};
+    if (vector_append(&result->spans, &span))
       goto err;
 
+    if (zero && !fresh)
+      region_zero(storage, region, span.index, j);
+
     region->count += j;
     i += j;
   }
 
   return EXIT_SUCCESS;
 
-err:;
-  // TODO It's probably more sensible to send the newly initialized regions to
-  // the unassigned Vector
-
-  // Check if we allocated any new regions
-  size_t j = unassigned_count - result->new_unassigned_count;
-  if (vector_len(&result->regions) > j) {
-    // Go through the result and deinitialize regions
-    for (++j; j < i; j++) {
-      LinkedListNode *node = linked_list_pop_first(&storage->regions);
-      region_deinit(node->data);
-      linked_list_node_deinit(node);
-    }
-  }
-
-  vector_deinit(&result->regions);
+err:
+  storage_regions_request_commit(result, 0);
   return EXIT_FAILURE;
 }
 
-static void storage_unassign_regions(struct storage *storage,
-                                     struct region *regions, size_t count) {
-  // Loop through the regions and attempt to append them into the unassigned
-  // Vector, If we encounter an error, more than likely we are OOM so instead
-  // just free the region
-  size_t i = 0;
-  for (; i < count; i++)
-    if (vector_append(&storage->unassigned, &regions[i]))
-      break;
-
-  for (; i < count; i++)
-    free(regions[i].ptr);
-}
-
-static void
-storage_regions_request_commit(struct storage_regions_request *request,
-                               int commit) {
-  if (commit) {
-    if (request->new_unassigned_count <
-        vector_len(&request->storage->unassigned))
-      vector_resize(&request->storage->unassigned,
-                    request->new_unassigned_count);
-#ifdef DEBUG
-    printf("%s(): Committed modification of the storage.\n", __func__);
-#endif
-  } else {
-    storage_unassign_regions(request->storage, request->regions.data,
-                             vector_len(&request->regions));
-  }
-
-  vector_deinit(&request->regions);
-}
-
 // Count the instances of a character within the string
 static int count_char(const char *str, const char c) {
   size_t result;
@@ -639,7 +1601,7 @@ err:
   return NULL; // Return zero, indicating an empty result.
 }
 
-static int populate_mask(CigWorld *w, Bitset *mask,
+static int populate_mask(const CigWorld *w, Bitset *mask,
                          int (*func)(Bitset *, const char *, const char *,
                                      int32_t, void *),
                          const char *types_str, void *e) {
@@ -651,8 +1613,9 @@ static int populate_mask(CigWorld *w, Bitset *mask,
 
   int result = EXIT_SUCCESS;
 
-  // `size` cannot be more than the count of registered types
-  if (size > vector_len(&w->types)) {
+  // `size` cannot be more than the count of registered types, unless several
+  // fields of a type are requested
+  if (size > vector_len(&w->types) && !strchr(types_str, '.')) {
 
     result = EXIT_FAILURE;
     fprintf(stderr,
@@ -685,10 +1648,15 @@ static int populate_mask(CigWorld *w, Bitset *mask,
   return result;
 }
 
+struct mask_cursor {
+  const CigWorld *w;
+  int32_t *types, *fields;
+};
+
 static int generate_system_masks(Bitset *masks, const char *type,
                                  const char *token, int32_t id, void *e) {
-  // We passed a pointer to the system's `types` field
-  int32_t **types = e;
+  // We passed a cursor into the system's `types` and `fields`
+  struct mask_cursor *cursor = e;
 
   // `masks`[0] is must_have
   // `masks`[1] is must_not_have
@@ -705,57 +1673,52 @@ static int generate_system_masks(Bitset *masks, const char *type,
     }
     break;
 
-  default:
-    if (strcmp(token, type) == 0) {
-      bitset_incl(&masks[0], id);
-      *(*types)++ = id;
+  default: {
+    const size_t len = strlen(type);
+    if (strncmp(token, type, len) != 0 || (token[len] && token[len] != '.'))
+      break;
 
-      return EXIT_SUCCESS;
-    }
-    break;
+    // A field is requested as "type.field"
+    const int32_t field =
+        token[len] ? type_find_field(get_type(cursor->w, id), &token[len + 1])
+                   : -1;
+    if (token[len] && field < 0)
+      break;
+
+    bitset_incl(&masks[0], id);
+    *cursor->types++ = id;
+    *cursor->fields++ = field;
+
+    return EXIT_SUCCESS;
+  }
   }
 
   return EXIT_FAILURE;
 }
 
-static uint32_t storage_hash(const void *storage_ptr) {
-  const struct storage *storage = *(const struct storage **)storage_ptr;
-  return bitset_hash(&storage->mask);
-}
-
-static int storage_eql(const void *a_ptr, const void *b_ptr) {
-  const struct storage *a = *(const struct storage **)a_ptr;
-  const struct storage *b = *(const struct storage **)b_ptr;
-  return bitset_eql(&a->mask, &b->mask);
+static void query_deinit(struct query *query) {
+  bitset_deinit(&query->must_not_have);
+  bitset_deinit(&query->must_have);
+  free(query->fields);
+  free(query->types);
 }
 
-static int system_init(CigWorld *w, struct system *result,
-                       CigSystemDesc *desc) {
-  *result = (struct system){0};
-
-  result->identifier = strdup(desc->identifier);
-  if (!result->identifier)
-    return EXIT_FAILURE;
-
-  if (hash_map_has(&w->systems, &result->identifier)) {
-    fprintf(stderr, "%s(): System with identifier already registered(%s).\n",
-            __func__, desc->identifier);
-    free(result->identifier);
-    return EXIT_FAILURE;
-  }
+// Parses a comma-seperated requirements string, types prefixed with an
+// exclamation mark must not be present
+static int query_init(const CigWorld *w, struct query *result,
+                      const char *requirements) {
+  *result = (struct query){0};
 
   {
     // Allocate memory for the `types` array.
-    size_t capacity = count_char(desc->requirements, ',') + 1;
+    size_t capacity = count_char(requirements, ',') + 1;
     // Remove types which are prefixed with an exclamation mark
-    capacity -= count_char(desc->requirements, '!');
+    capacity -= count_char(requirements, '!');
 
+    // A query may consist of only excluded types
     result->types = malloc(capacity * sizeof(int32_t));
-    if (!result->types)
-      goto err;
-
-    result->offsets = calloc(capacity, sizeof(size_t));
-    if (!result->offsets)
+    result->fields = malloc(capacity * sizeof(int32_t));
+    if ((!result->types || !result->fields) && capacity > 0)
       goto err;
 
     result->types_len = capacity;
@@ -769,34 +1732,235 @@ static int system_init(CigWorld *w, struct system *result,
       goto err;
   }
 
-  if (hash_map_init(&result->storages, storage_hash, storage_eql,
-                    sizeof(struct storage *), 0))
-    goto err;
-
   {
     // Create an array with both masks to pass into `populate_mask()`
     Bitset masks[2] = {result->must_have, result->must_not_have};
-    // and a copy of the pointer for the types array.
-    int32_t *types = result->types;
+    // and a cursor into the types and fields arrays.
+    struct mask_cursor cursor = {w, result->types, result->fields};
 
-    if (populate_mask(w, masks, generate_system_masks, desc->requirements,
-                      &types))
+    if (populate_mask(w, masks, generate_system_masks, requirements, &cursor))
       goto err;
   }
 
-  result->func = desc->func;
-  result->user_data = desc->user_data;
-
   return EXIT_SUCCESS;
 
 err:
-  system_deinit(result);
+  query_deinit(result);
 
   return EXIT_FAILURE;
 }
 
-// TODO Should this go into mylib hash module?
-static uint32_t str_hash(const void *str_ptr) {
+static uint32_t storage_hash(const void *storage_ptr) {
+  const struct storage *storage = *(const struct storage **)storage_ptr;
+  return bitset_hash(&storage->mask);
+}
+
+static int storage_eql(const void *a_ptr, const void *b_ptr) {
+  const struct storage *a = *(const struct storage **)a_ptr;
+  const struct storage *b = *(const struct storage **)b_ptr;
+  return bitset_eql(&a->mask, &b->mask);
+}
+
+// Orders the `HashMapKV *` of storages by the IDs of their types, the first
+// ID that differs decides
+static int storage_kv_cmp(const void *a_ptr, const void *b_ptr) {
+  const HashMapKV *a_kv = *(const HashMapKV **)a_ptr;
+  const HashMapKV *b_kv = *(const HashMapKV **)b_ptr;
+  const struct storage *a = *(const struct storage **)a_kv->key;
+  const struct storage *b = *(const struct storage **)b_kv->key;
+
+  size_t i = 0, j = 0;
+  while (1) {
+    const int has_a = bitset_next(&a->mask, &i);
+    const int has_b = bitset_next(&b->mask, &j);
+    if (!has_a || !has_b)
+      return has_a - has_b;
+    if (i != j)
+      return i < j ? -1 : 1;
+    i++;
+    j++;
+  }
+}
+
+// Lists the `HashMapKV *` of the storages matched with the system. In
+// deterministic mode they are ordered by their types instead of by where they
+// ended up in the hash map.
+static int system_storages(const CigWorld *w, const struct system *system,
+                           Vector *result) {
+  if (vector_init(result, sizeof(const HashMapKV *)))
+    return EXIT_FAILURE;
+
+  HashMapIterator it = hash_map_iter(&system->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    if (vector_append(result, &kv)) {
+      vector_deinit(result);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (w->deterministic)
+    qsort(result->data, vector_len(result), sizeof(const HashMapKV *),
+          storage_kv_cmp);
+  return EXIT_SUCCESS;
+}
+
+// Allocates `slots` accumulators for the system, each one is padded out to a
+// whole number of cache lines
+static int system_reduction_init(struct system *system,
+                                 const CigReductionDesc *desc, size_t slots) {
+  const size_t alignment =
+      desc->alignment > CACHE_LINE_SIZE ? desc->alignment : CACHE_LINE_SIZE;
+  const size_t stride = round_up(desc->size, alignment);
+
+  void *accumulators = aligned_alloc(alignment, stride * slots);
+  if (!accumulators)
+    return EXIT_FAILURE;
+
+  if (!system->reduction_result) {
+    system->reduction_result = aligned_alloc(alignment, stride);
+    if (!system->reduction_result) {
+      free(accumulators);
+      return EXIT_FAILURE;
+    }
+    desc->init(system->reduction_result);
+  }
+
+  free(system->accumulators);
+  system->reduction = *desc;
+  system->accumulators = accumulators;
+  system->accumulator_stride = stride;
+  system->accumulator_count = slots;
+
+  return EXIT_SUCCESS;
+}
+
+// The number of accumulators each system needs to run on `pool`
+static size_t world_slots(const CigWorld *w, const struct thread_pool *pool) {
+  const size_t slots = pool ? thread_pool_slots(pool) : 1;
+  if (w->deterministic && slots < DETERMINISTIC_PARTS)
+    return DETERMINISTIC_PARTS;
+  return slots;
+}
+
+static void *system_get_accumulator(const struct system *system, size_t slot) {
+  if (!system->accumulators)
+    return NULL;
+  return system->accumulators + system->accumulator_stride * slot;
+}
+
+static void system_reduction_begin(const struct system *system) {
+  for (size_t i = 0; i < system->accumulator_count; i++)
+    system->reduction.init(system_get_accumulator(system, i));
+}
+
+// Combine the accumulators in slot order, so the result does not depend on
+// which slot finished first
+static void system_reduction_end(const struct system *system) {
+  if (!system->accumulators)
+    return;
+
+  system->reduction.init(system->reduction_result);
+  for (size_t i = 0; i < system->accumulator_count; i++)
+    system->reduction.combine(system->reduction_result,
+                              system_get_accumulator(system, i));
+}
+
+static struct task *find_task(const CigWorld *w, const char *identifier) {
+  if (!w->tasks)
+    return NULL;
+
+  struct task **tasks = w->tasks->tasks.data;
+  for (size_t i = 0; i < vector_len(&w->tasks->tasks); i++)
+    if (!strcmp(tasks[i]->identifier, identifier))
+      return tasks[i];
+  return NULL;
+}
+
+static void task_deinit(struct task *task) {
+  if (task == NULL)
+    return;
+
+  vector_deinit(&task->dependents);
+  free(task->identifier);
+  free(task->after);
+  free(task);
+}
+
+static void task_graph_deinit(struct task_graph *graph) {
+  if (graph == NULL)
+    return;
+
+  struct task **tasks = graph->tasks.data;
+  for (size_t i = 0; i < vector_len(&graph->tasks); i++)
+    task_deinit(tasks[i]);
+  vector_deinit(&graph->tasks);
+  free(graph);
+}
+
+static int system_init(CigWorld *w, struct system *result,
+                       CigSystemDesc *desc) {
+  *result = (struct system){0};
+
+  result->identifier = strdup(desc->identifier);
+  if (!result->identifier)
+    return EXIT_FAILURE;
+
+  if (hash_map_has(&w->systems, &result->identifier) ||
+      find_task(w, desc->identifier)) {
+    fprintf(stderr, "%s(): System with identifier already registered(%s).\n",
+            __func__, desc->identifier);
+    free(result->identifier);
+    return EXIT_FAILURE;
+  }
+
+  {
+    struct query query;
+    if (query_init(w, &query, desc->requirements))
+      goto err;
+
+    // The system takes ownership of the query's types and masks
+    result->types = query.types;
+    result->fields = query.fields;
+    result->types_len = query.types_len;
+    result->must_have = query.must_have;
+    result->must_not_have = query.must_not_have;
+  }
+
+  result->offsets = calloc(result->types_len, sizeof(size_t));
+  result->strides = calloc(result->types_len, sizeof(size_t));
+  result->stats = calloc(1, sizeof(CigSystemStats));
+  result->latency = calloc(1, sizeof(struct histogram));
+  if (!result->offsets || !result->strides || !result->stats ||
+      !result->latency)
+    goto err;
+
+  if (hash_map_init(&result->storages, storage_hash, storage_eql,
+                    sizeof(struct storage *), sizeof(struct storage_access)) ||
+      vector_init(&result->tasks, sizeof(struct task *)))
+    goto err;
+
+  result->func = desc->func;
+  result->user_data = desc->user_data;
+  // Extraction systems only ever read, the chunks may be frozen
+  result->read_only = desc->read_only || desc->extract;
+  result->extract = desc->extract;
+  result->group_filter = desc->group_filter;
+
+  const size_t slots = world_slots(w, w->pool);
+  if (desc->reduction && system_reduction_init(result, desc->reduction, slots))
+    goto err;
+
+  return EXIT_SUCCESS;
+
+err:
+  system_deinit(result);
+
+  return EXIT_FAILURE;
+}
+
+// TODO Should this go into mylib hash module?
+static uint32_t str_hash(const void *str_ptr) {
   return fnv1a_32_hash(*(const uint8_t **)str_ptr,
                        strlen(*(const char **)str_ptr) + 1);
 }
@@ -805,6 +1969,210 @@ static int str_eql(const void *a, const void *b) {
   return strcmp(*(const char **)a, *(const char **)b) == 0;
 }
 
+// Releases the chunks that are in flight
+static void zone_release_pages(struct zone *zone) {
+  struct zone_page *pages = zone->pages.data;
+  for (size_t i = 0; i < vector_len(&zone->pages); i++) {
+    struct region chunk = {.ptr = pages[i].ptr, .refs = pages[i].refs};
+    region_deinit(&chunk);
+    pages[i].ptr = NULL;
+    pages[i].refs = NULL;
+  }
+}
+
+static void zone_deinit(struct zone *zone) {
+  if (zone->has_thread)
+    pthread_join(zone->thread, NULL);
+
+  zone_release_pages(zone);
+  vector_deinit(&zone->pages);
+  free(zone->path);
+  free(zone);
+}
+
+// Journal records start with a `uint8_t` kind and a `uint64_t` payload size
+enum journal_record {
+  // uint64_t count, uint32_t type count, the uint32_t type ids
+  JOURNAL_SPAWN = 1,
+  // uint64_t first, uint64_t count, uint32_t column count, for each column:
+  //   uint32_t type id, the packed components
+  JOURNAL_COLUMNS,
+  // uint64_t entity, uint32_t type id, the component
+  JOURNAL_SET,
+  // uint64_t count, the uint64_t ids, the requirements
+  JOURNAL_DESPAWN,
+};
+
+static int byte_buffer_reserve(struct byte_buffer *buffer, size_t size) {
+  if (buffer->len + size <= buffer->capacity)
+    return EXIT_SUCCESS;
+
+  size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+  while (capacity < buffer->len + size)
+    capacity *= 2;
+
+  uint8_t *data = realloc(buffer->data, capacity);
+  if (!data)
+    return EXIT_FAILURE;
+
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return EXIT_SUCCESS;
+}
+
+// Returns `size` bytes at the end of the active buffer to write a record into.
+// Nothing is added once the journal has failed, a replay would otherwise run
+// into the gap.
+static void *journal_reserve(struct journal *journal, size_t size) {
+  struct byte_buffer *buffer = &journal->active;
+  if (journal->failed)
+    return NULL;
+
+  if (byte_buffer_reserve(buffer, size)) {
+    journal->failed = 1;
+    return NULL;
+  }
+
+  void *result = buffer->data + buffer->len;
+  buffer->len += size;
+  return result;
+}
+
+static void journal_append(struct journal *journal, const void *data,
+                           size_t size) {
+  void *dest = journal_reserve(journal, size);
+  if (dest)
+    memcpy(dest, data, size);
+}
+
+// Room for the whole record is made up front, so the header is never buffered
+// without its payload
+static void journal_begin(struct journal *journal, uint8_t kind,
+                          uint64_t size) {
+  if (!journal->failed &&
+      byte_buffer_reserve(&journal->active,
+                          sizeof(kind) + sizeof(size) + size))
+    journal->failed = 1;
+
+  journal_append(journal, &kind, sizeof(kind));
+  journal_append(journal, &size, sizeof(size));
+}
+
+static int write_all(int fd, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return EXIT_FAILURE;
+
+    data += n;
+    size -= n;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Writes whatever has been committed, every commit that piled up while the
+// last write was in flight is synced at once
+static void *journal_thread(void *journal_ptr) {
+  struct journal *journal = journal_ptr;
+
+  pthread_mutex_lock(&journal->mutex);
+  while (1) {
+    while (!journal->stop && journal->committed.len == 0)
+      pthread_cond_wait(&journal->cond, &journal->mutex);
+    if (journal->committed.len == 0)
+      break;
+
+    struct byte_buffer buffer = journal->committed;
+    journal->committed = journal->writing;
+    journal->writing = buffer;
+    const uint64_t commits = journal->commits;
+    pthread_mutex_unlock(&journal->mutex);
+
+    // After a failure the records that follow would be replayed past a gap
+    if (!journal->failed &&
+        (write_all(journal->fd, buffer.data, buffer.len) ||
+         fsync(journal->fd)))
+      journal->failed = 1;
+    journal->writing.len = 0;
+
+    pthread_mutex_lock(&journal->mutex);
+    journal->durable = commits;
+    pthread_cond_broadcast(&journal->cond);
+  }
+  pthread_mutex_unlock(&journal->mutex);
+
+  return NULL;
+}
+
+// Hands the active records to the writer thread, returns the number of the
+// commit
+static uint64_t journal_commit(struct journal *journal) {
+  pthread_mutex_lock(&journal->mutex);
+  if (journal->failed)
+    journal->active.len = 0;
+
+  if (journal->active.len > 0) {
+    if (journal->committed.len == 0) {
+      struct byte_buffer buffer = journal->committed;
+      journal->committed = journal->active;
+      journal->active = buffer;
+    } else {
+      // The writer is behind, the records join the pending commit
+      struct byte_buffer *committed = &journal->committed;
+      if (byte_buffer_reserve(committed, journal->active.len))
+        journal->failed = 1;
+      else {
+        memcpy(committed->data + committed->len, journal->active.data,
+               journal->active.len);
+        committed->len += journal->active.len;
+      }
+      journal->active.len = 0;
+    }
+
+    journal->commits++;
+    pthread_cond_signal(&journal->cond);
+  }
+
+  const uint64_t result = journal->commits;
+  pthread_mutex_unlock(&journal->mutex);
+  return result;
+}
+
+static int journal_sync(struct journal *journal) {
+  const uint64_t commit = journal_commit(journal);
+
+  pthread_mutex_lock(&journal->mutex);
+  while (journal->durable < commit)
+    pthread_cond_wait(&journal->cond, &journal->mutex);
+  pthread_mutex_unlock(&journal->mutex);
+
+  return journal->failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int journal_close(struct journal *journal) {
+  int result = journal_sync(journal);
+
+  pthread_mutex_lock(&journal->mutex);
+  journal->stop = 1;
+  pthread_cond_signal(&journal->cond);
+  pthread_mutex_unlock(&journal->mutex);
+  pthread_join(journal->thread, NULL);
+
+  pthread_cond_destroy(&journal->cond);
+  pthread_mutex_destroy(&journal->mutex);
+  if (close(journal->fd))
+    result = EXIT_FAILURE;
+
+  free(journal->active.data);
+  free(journal->committed.data);
+  free(journal->writing.data);
+  free(journal);
+  return result;
+}
+
 CigWorld *cig_world_init() {
   CigWorld *result = calloc(1, sizeof(CigWorld));
   if (!result)
@@ -818,15 +2186,32 @@ CigWorld *cig_world_init() {
     goto err;
 
   if (hash_map_init(&result->systems, str_hash, str_eql, sizeof(char *),
-                    sizeof(struct system)))
+                    sizeof(struct system)) ||
+      vector_init(&result->system_order, sizeof(struct system *)))
     goto err;
 
+  result->unmatched = malloc(sizeof(Vector));
+  if (!result->unmatched ||
+      vector_init(result->unmatched, sizeof(struct storage *))) {
+    free(result->unmatched);
+    result->unmatched = NULL;
+    goto err;
+  }
+
   if (vector_init(&result->entities, sizeof(struct entity_internal)))
     goto err;
 
   if (vector_init(&result->unassigned, sizeof(CigEntity)))
     goto err;
 
+  if (vector_init(&result->zones, sizeof(struct zone *)) ||
+      vector_init(&result->indexes, sizeof(struct field_index *)))
+    goto err;
+
+  result->step_latency = calloc(1, sizeof(struct histogram));
+  if (!result->step_latency)
+    goto err;
+
   return result;
 
 err:
@@ -834,13 +2219,121 @@ err:
   return NULL;
 }
 
+static struct shm_segment *shm_segment_init(const char *name, size_t size) {
+  struct shm_segment *result = calloc(1, sizeof(struct shm_segment));
+  if (!result)
+    return NULL;
+
+  // The directory has room for two words per chunk, and more for the types
+  // and storages
+  const size_t directory_offset = round_up(sizeof(struct shm_header), 8);
+  const size_t directory_capacity =
+      (size / CHUNK_BYTE_SIZE) * 2 * sizeof(uint64_t) + 64 * 1024;
+  result->first_chunk =
+      round_up(directory_offset + directory_capacity, CHUNK_BYTE_SIZE);
+  result->size = round_up(size, CHUNK_BYTE_SIZE);
+  if (result->size <= result->first_chunk) {
+    fprintf(stderr, "%s(): A segment of (%zu) bytes is too small.\n",
+            __func__, size);
+    free(result);
+    return NULL;
+  }
+  result->chunk_count = (result->size - result->first_chunk) / CHUNK_BYTE_SIZE;
+
+  result->name = strdup(name);
+  if (!result->name || vector_init(&result->free_chunks, sizeof(void *))) {
+    free(result->name);
+    free(result);
+    return NULL;
+  }
+  pthread_mutex_init(&result->mutex, NULL);
+  atomic_init(&result->refs, 1);
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, name);
+    result->ptr = MAP_FAILED;
+  } else {
+    result->ptr = ftruncate(fd, result->size)
+                      ? MAP_FAILED
+                      : mmap(NULL, result->size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+    close(fd);
+  }
+
+  if (result->ptr == MAP_FAILED) {
+    if (fd >= 0)
+      shm_unlink(name);
+    vector_deinit(&result->free_chunks);
+    pthread_mutex_destroy(&result->mutex);
+    free(result->name);
+    free(result);
+    return NULL;
+  }
+
+  result->header = result->ptr;
+  memcpy(result->header->magic, "CIGM", 4);
+  result->header->version = 2;
+  result->header->size = result->size;
+  atomic_init(&result->header->sequence, 0);
+  result->header->directory_offset = directory_offset;
+  result->header->directory_capacity = directory_capacity;
+  result->header->directory_size = 0;
+
+  return result;
+}
+
+CigWorld *cig_world_init_shared(const char *name, size_t size) {
+  assert(name != NULL);
+
+  CigWorld *result = cig_world_init();
+  if (!result)
+    return NULL;
+
+  result->shm = shm_segment_init(name, size);
+  if (!result->shm) {
+    cig_world_deinit(result);
+    return NULL;
+  }
+
+  return result;
+}
+
+static void field_index_deinit(struct field_index *index) {
+  vector_deinit(&index->records);
+  vector_deinit(&index->recent);
+  vector_deinit(&index->entries);
+  free(index->field);
+  free(index->identifier);
+  free(index);
+}
+
 void cig_world_deinit(CigWorld *w) {
   if (w == NULL)
     return;
 
+  if (w->journal)
+    journal_close(w->journal);
+
+  cig_world_set_pipelined(w, 0);
+  thread_pool_deinit(w->pool);
+  task_graph_deinit(w->tasks);
+  cig_world_enable_counters(w, 0);
+
+  // Wait for any I/O before the regions are freed
+  struct zone **zones = w->zones.data;
+  for (size_t i = 0; i < vector_len(&w->zones); i++)
+    zone_deinit(zones[i]);
+  vector_deinit(&w->zones);
+
+  struct field_index **indexes = w->indexes.data;
+  for (size_t i = 0; i < vector_len(&w->indexes); i++)
+    field_index_deinit(indexes[i]);
+  vector_deinit(&w->indexes);
+
   CigTypeDesc *types = w->types.data;
   for (size_t i = 0; i < vector_len(&w->types); i++)
-    free(types[i].identifier);
+    type_deinit(&types[i]);
   vector_deinit(&w->types);
 
   HashMapIterator it = hash_map_iter(&w->storages);
@@ -854,66 +2347,379 @@ void cig_world_deinit(CigWorld *w) {
     system_deinit((struct system *)next->value);
 
   hash_map_deinit(&w->systems);
+  vector_deinit(&w->system_order);
+  if (w->unmatched)
+    vector_deinit(w->unmatched);
+  free(w->unmatched);
 
   vector_deinit(&w->entities);
   vector_deinit(&w->unassigned);
   free(w->last_spawned);
+  free(w->step_latency);
+
+  // Readers keep their mappings, the name is gone along with the world
+  if (w->shm) {
+    shm_unlink(w->shm->name);
+    shm_segment_release(w->shm);
+  }
 
   free(w);
 }
 
-static size_t find_type(const Vector *types, const char *identifier) {
-  CigTypeDesc *arr = types->data;
-  size_t len = vector_len(types);
-  for (size_t i = 0; i < len; i++)
-    if (strcmp(arr[i].identifier, identifier) == 0)
-      return i;
+static int system_clone(const struct system *system, struct system *result) {
+  *result = (struct system){0};
 
-  return len;
-}
+  result->identifier = strdup(system->identifier);
+  if (!result->identifier)
+    return EXIT_FAILURE;
 
-int cig_world_register_type(CigWorld *w, CigTypeDesc *desc) {
-  assert(w != NULL);
-  assert(desc != NULL);
+  result->types = malloc(system->types_len * sizeof(int32_t));
+  result->fields = malloc(system->types_len * sizeof(int32_t));
+  result->offsets = calloc(system->types_len, sizeof(size_t));
+  result->strides = calloc(system->types_len, sizeof(size_t));
+  if ((!result->types || !result->fields || !result->offsets ||
+       !result->strides) &&
+      system->types_len > 0)
+    goto err;
 
-  if (find_type(&w->types, desc->identifier) < vector_len(&w->types)) {
-    fprintf(stderr, "%s(): Type with identifier already registered (%s).\n",
-            __func__, desc->identifier);
-    return EXIT_FAILURE;
-  }
+  result->stats = calloc(1, sizeof(CigSystemStats));
+  result->latency = calloc(1, sizeof(struct histogram));
+  if (!result->stats || !result->latency)
+    goto err;
 
-  if (vector_append(&w->types, desc))
-    return EXIT_FAILURE;
+  memcpy(result->types, system->types, system->types_len * sizeof(int32_t));
+  memcpy(result->fields, system->fields, system->types_len * sizeof(int32_t));
+  result->types_len = system->types_len;
 
-  char *identifier = strdup(desc->identifier);
-  if (!identifier) {
-    vector_delete(&w->types, vector_len(&w->types) - 1);
-    return EXIT_FAILURE;
-  }
-  ((CigTypeDesc *)vector_get(&w->types, vector_len(&w->types) - 1))
-      ->identifier = identifier;
+  if (bitset_clone(&system->must_have, &result->must_have) ||
+      bitset_clone(&system->must_not_have, &result->must_not_have))
+    goto err;
 
-#ifdef DEBUG
-  printf("%s(): Type registered (%s).\n", __func__, desc->identifier);
-#endif
+  // Tasks are registered again by the fork and add themselves
+  if (hash_map_init(&result->storages, storage_hash, storage_eql,
+                    sizeof(struct storage *), sizeof(struct storage_access)) ||
+      vector_init(&result->tasks, sizeof(struct task *)))
+    goto err;
 
-  return EXIT_SUCCESS;
-}
+  result->read_only = system->read_only;
+  result->extract = system->extract;
+  result->group_filter = system->group_filter;
+  result->func = system->func;
+  result->user_data = system->user_data;
+  result->fused = system->fused;
 
-static int system_find_matches(CigWorld *w, struct system *system) {
-  HashMapIterator it = hash_map_iter(&w->storages);
-  const HashMapKV *kv;
-  while ((kv = hash_map_next(&it))) {
-    struct storage *storage = kv->value;
-    if (!is_match(storage->mask, system->must_have, system->must_not_have))
-      continue;
+  if (system->accumulators &&
+      system_reduction_init(result, &system->reduction,
+                            system->accumulator_count))
+    goto err;
 
-    if (hash_map_put(&system->storages, &storage, NULL) ||
-        hash_map_put(&storage->systems, &system, NULL))
-      goto err;
+  return EXIT_SUCCESS;
 
-#ifdef DEBUG
-    printf("%s(): System (%s) matched with storage.\n", __func__,
+err:
+  system_deinit(result);
+
+  return EXIT_FAILURE;
+}
+
+// Clones the storage into the world `w`, the regions share their chunks with
+// the regions of `storage`
+static int storage_clone(CigWorld *w, const struct storage *storage,
+                         struct storage *result) {
+  Bitset mask;
+  if (bitset_clone(&storage->mask, &mask))
+    return EXIT_FAILURE;
+
+  if (storage_init(w, result, mask)) {
+    bitset_deinit(&mask);
+    return EXIT_FAILURE;
+  }
+
+  // The chunks are shared, so they have to be read the same way
+  struct storage_layout layout;
+  if (layout_clone(&storage->layout, &layout))
+    goto err;
+  layout_deinit(&result->layout);
+  result->layout = layout;
+
+  size_t len = 0;
+  for (LinkedListNode *node = storage->regions.first; node; node = node->next)
+    len++;
+
+  const struct region **regions = malloc(len * sizeof(struct region *));
+  if (!regions && len > 0)
+    goto err;
+
+  len = 0;
+  for (LinkedListNode *node = storage->regions.first; node; node = node->next)
+    regions[len++] = node->data;
+
+  // Prepend in reverse so the regions keep their order
+  while (len-- > 0) {
+    struct region region = *regions[len];
+    if (region.refs)
+      atomic_fetch_add(region.refs, 1);
+
+    if (linked_list_prepend(&result->regions, &region,
+                            sizeof(struct region))) {
+      region_deinit(&region);
+      free(regions);
+      goto err;
+    }
+  }
+
+  free(regions);
+
+  if (storage->grouping) {
+    result->grouping = malloc(sizeof(struct grouping));
+    if (!result->grouping)
+      goto err;
+    *result->grouping = *storage->grouping;
+  }
+
+  result->count = storage->count;
+
+  return EXIT_SUCCESS;
+
+err:
+  storage_deinit(result);
+
+  return EXIT_FAILURE;
+}
+
+CigWorld *cig_world_fork(const CigWorld *w) {
+  assert(w != NULL);
+
+  // The ids of paged out families can't be read to assign them in the fork
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it)))
+    if (storage_is_paged_out(kv->value)) {
+      fprintf(stderr, "%s(): A storage has paged out regions.\n", __func__);
+      return NULL;
+    }
+
+  CigWorld *result = cig_world_init();
+  if (!result)
+    return NULL;
+
+  const CigTypeDesc *types = w->types.data;
+  for (size_t i = 0; i < vector_len(&w->types); i++)
+    if (cig_world_register_type(result, (CigTypeDesc *)&types[i]))
+      goto err;
+
+  // Cloned in the order they were registered so they run in the same order
+  struct system **systems = w->system_order.data;
+  for (size_t i = 0; i < vector_len(&w->system_order); i++) {
+    struct system system;
+    if (system_clone(systems[i], &system))
+      goto err;
+
+    if (hash_map_put(&result->systems, &system.identifier, &system)) {
+      system_deinit(&system);
+      goto err;
+    }
+
+    struct system *stored =
+        hash_map_get_value(&result->systems, &system.identifier);
+    if (vector_append(&result->system_order, &stored))
+      goto err;
+  }
+
+  // Rebuild the fused chains out of the cloned systems
+  for (size_t i = 0; i < vector_len(&w->system_order); i++) {
+    const struct system *system = systems[i];
+    if (!system->fused_next)
+      continue;
+
+    struct system *clone =
+        hash_map_get_value(&result->systems, &system->identifier);
+    clone->fused_next =
+        hash_map_get_value(&result->systems, &system->fused_next->identifier);
+  }
+
+  // Registered in the same order, their dependencies are always there first
+  struct task **tasks = w->tasks ? w->tasks->tasks.data : NULL;
+  for (size_t i = 0; w->tasks && i < vector_len(&w->tasks->tasks); i++) {
+    CigTaskDesc desc = {tasks[i]->identifier, tasks[i]->func,
+                        tasks[i]->user_data, tasks[i]->after};
+    if (cig_world_register_task(result, &desc))
+      goto err;
+  }
+
+  // Every entity is initially without storage, the entities that have storage
+  // are pointed at the cloned regions below
+  if (vector_resize(&result->entities, vector_len(&w->entities)))
+    goto err;
+
+  struct entity_internal e = {0};
+  for (size_t i = 0; i < vector_len(&w->entities); i++)
+    if (vector_append(&result->entities, &e))
+      goto err;
+
+  it = hash_map_iter(&w->storages);
+  while ((kv = hash_map_next(&it))) {
+    const struct storage *storage = kv->value;
+
+    struct storage clone;
+    if (storage_clone(result, storage, &clone))
+      goto err;
+
+    if (hash_map_put(&result->storages, &clone.mask, &clone)) {
+      storage_deinit(&clone);
+      goto err;
+    }
+
+    struct storage *stored = hash_map_get_value(&result->storages, &clone.mask);
+    if (vector_append(result->unmatched, &stored))
+      goto err;
+
+    // Both region lists are in the same order, only the families that are
+    // still owned by their entity are assigned
+    const LinkedListNode *node = storage->regions.first;
+    LinkedListNode *clone_node = stored->regions.first;
+    for (; node; node = node->next, clone_node = clone_node->next) {
+      const struct region *region = node->data;
+      const CigEntity *ids = region_entities(storage, region);
+
+      for (size_t i = 0; i < region->count; i++) {
+        const struct entity_internal *parent =
+            vector_get_const(&w->entities, ids[i]);
+        if (parent->region != region || parent->index != i)
+          continue;
+
+        *(struct entity_internal *)vector_get(&result->entities, ids[i]) =
+            (struct entity_internal){
+                .storage = stored, .region = clone_node->data, .index = i};
+      }
+    }
+  }
+
+  const CigEntity *unassigned = w->unassigned.data;
+  for (size_t i = 0; i < vector_len(&w->unassigned); i++)
+    if (vector_append(&result->unassigned, &unassigned[i]))
+      goto err;
+
+  result->next_entity = w->next_entity;
+
+  // Built from the cloned families, so only once they are all assigned
+  struct field_index **indexes = w->indexes.data;
+  for (size_t i = 0; i < vector_len(&w->indexes); i++) {
+    CigIndexDesc desc = {indexes[i]->identifier, indexes[i]->field,
+                         indexes[i]->kind};
+    if (cig_world_register_index(result, &desc))
+      goto err;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Forked world with (%zu) entities.\n", __func__,
+         vector_len(&w->entities));
+#endif
+
+  return result;
+
+err:
+  cig_world_deinit(result);
+  return NULL;
+}
+
+static size_t find_type(const Vector *types, const char *identifier) {
+  CigTypeDesc *arr = types->data;
+  size_t len = vector_len(types);
+  for (size_t i = 0; i < len; i++)
+    if (strcmp(arr[i].identifier, identifier) == 0)
+      return i;
+
+  return len;
+}
+
+int cig_world_register_type(CigWorld *w, CigTypeDesc *desc) {
+  assert(w != NULL);
+  assert(desc != NULL);
+
+  if (find_type(&w->types, desc->identifier) < vector_len(&w->types)) {
+    fprintf(stderr, "%s(): Type with identifier already registered (%s).\n",
+            __func__, desc->identifier);
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < desc->field_count; i++) {
+    const CigFieldDesc *field = &desc->fields[i];
+    if (field->size == 0 || field->offset + field->size > desc->size ||
+        strpbrk(field->identifier, " ,.!") ||
+        type_find_field(desc, field->identifier) != (int32_t)i) {
+      fprintf(stderr, "%s(): Field (%s) of (%s) is invalid.\n", __func__,
+              field->identifier, desc->identifier);
+      return EXIT_FAILURE;
+    }
+  }
+
+  CigTypeDesc type = *desc;
+  type.identifier = strdup(desc->identifier);
+  type.fields = calloc(desc->field_count, sizeof(CigFieldDesc));
+  if (!type.identifier || (!type.fields && desc->field_count > 0)) {
+    type_deinit(&type);
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < desc->field_count; i++) {
+    type.fields[i] = desc->fields[i];
+    type.fields[i].identifier = strdup(desc->fields[i].identifier);
+    if (!type.fields[i].identifier) {
+      type_deinit(&type);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (vector_append(&w->types, &type)) {
+    type_deinit(&type);
+    return EXIT_FAILURE;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Type registered (%s).\n", __func__, desc->identifier);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+// Set when the system asks for the whole of a type the layout splits, it can
+// only be given its fields
+static int needs_split_type(const struct system *system,
+                            const struct storage_layout *layout) {
+  for (size_t i = 0; i < system->types_len; i++) {
+    if (system->fields[i] >= 0)
+      continue;
+
+    for (size_t j = 0; j < layout->count; j++)
+      if (layout->types[j].id == system->types[i] &&
+          layout->types[j].field_count > 0)
+        return 1;
+  }
+
+  return 0;
+}
+
+static int system_find_matches(CigWorld *w, struct system *system) {
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    struct storage *storage = kv->value;
+    if (!is_match(storage->mask, system->must_have, system->must_not_have))
+      continue;
+
+    if (needs_split_type(system, &storage->layout)) {
+      fprintf(stderr, "%s(): System (%s) needs a type that is split.\n",
+              __func__, system->identifier);
+      goto err;
+    }
+
+    struct storage_access access = {0};
+    if (hash_map_put(&system->storages, &storage, &access) ||
+        hash_map_put(&storage->systems, &system, NULL))
+      goto err;
+
+#ifdef DEBUG
+    printf("%s(): System (%s) matched with storage.\n", __func__,
            system->identifier);
 #endif
   }
@@ -925,8 +2731,8 @@ err:
   const HashMapKV *target = kv;
   while ((kv = hash_map_next(&it))) {
     struct storage *storage = kv->value;
-    hash_map_delete(&system->storages, storage);
-    hash_map_delete(&storage->systems, system);
+    hash_map_delete(&system->storages, &storage);
+    hash_map_delete(&storage->systems, &system);
 
     if (kv == target)
       break;
@@ -935,305 +2741,4903 @@ err:
   return EXIT_FAILURE;
 }
 
-static int system_run(const struct system *system, double delta_time) {
-  CigSystemCtx ctx = (CigSystemCtx){.offsets = system->offsets,
-                                    .user_data = system->user_data};
-  // Loop through the storages that have been matched with the system
-  HashMapIterator it = hash_map_iter(&system->storages);
-  const HashMapKV *kv;
-  while ((kv = hash_map_next(&it))) {
-    struct storage *storage = *(struct storage **)kv->key;
+// The index of the type in the storage's layout, or the count of its types
+static size_t get_type_index(const struct storage *storage, int32_t id) {
+  // Iterate the storage's layout to find the id
+  for (int32_t i = 0; i < storage->layout.count; i++)
+    if (id == storage->layout.types[i].id)
+      return i;
 
-    for (size_t i = 0; i < system->types_len; i++) {
-      int32_t id = system->types[i];
-      system->offsets[i] = storage->layout.types[id].offset;
+#ifdef DEBUG
+  fprintf(stderr, "%s(): Storage does not contain a type with the ID (%i).\n",
+          __func__, id);
+#endif
+  return storage->layout.count;
+}
+
+// Copies `count` values of `size` bytes between types of two layouts, a field
+// at a time when either of them is split
+static void copy_type(void *dest, const struct storage_layout *dest_layout,
+                      size_t dest_type, size_t dest_index, const void *src,
+                      const struct storage_layout *src_layout, size_t src_type,
+                      size_t src_index, size_t size, size_t count) {
+  for (size_t offset = 0, n; offset < size; offset += n) {
+    size_t dest_len, src_len;
+    const struct column_layout dest_column =
+        layout_bytes(dest_layout, dest_type, offset, &dest_len);
+    const struct column_layout src_column =
+        layout_bytes(src_layout, src_type, offset, &src_len);
+
+    n = size - offset;
+    if (dest_len < n)
+      n = dest_len;
+    if (src_len < n)
+      n = src_len;
+
+    copy_column(dest, &dest_column, dest_index, src, &src_column, src_index, n,
+                count);
+  }
+}
+
+// Systems can only be fused if they match exactly the same storages
+static int is_fusible(const struct system *a, const struct system *b) {
+  return bitset_eql(&a->must_have, &b->must_have) &&
+         bitset_eql(&a->must_not_have, &b->must_not_have) &&
+         a->group_filter == b->group_filter;
+}
+
+// Whether the system runs on the region, a system can skip the regions of
+// groups it has no use for
+static int system_wants_region(const struct system *system,
+                               const struct storage *storage,
+                               const struct region *region) {
+  return !storage->grouping || !system->group_filter ||
+         system->group_filter(region->group, system->user_data);
+}
+
+// Sets where the system finds each of its types or fields in the storage
+static void set_offsets(const CigWorld *w, const struct system *system,
+                        const struct storage *storage, size_t *offsets,
+                        size_t *strides) {
+  for (size_t i = 0; i < system->types_len; i++) {
+    const int32_t id = system->types[i], field = system->fields[i];
+    const size_t offset =
+        field < 0 ? 0 : get_type(w, id)->fields[field].offset;
+
+    size_t len;
+    const struct column_layout column = layout_bytes(
+        &storage->layout, get_type_index(storage, id), offset, &len);
+    offsets[i] = column.offset;
+    strides[i] = column.stride;
+  }
+}
+
+static void system_set_offsets(const CigWorld *w, const struct system *system,
+                               struct storage *storage) {
+  set_offsets(w, system, storage, system->offsets, system->strides);
+}
+
+// Runs the system on every family of the region, a block at a time
+static void system_run_families(const struct system *system, CigSystemCtx *ctx,
+                                const struct storage *storage,
+                                const struct region *region,
+                                double delta_time) {
+  const size_t width = storage->layout.block_width;
+  void *block = region->ptr;
+  for (size_t i = 0; i < region->count; i += width) {
+    const size_t lanes = region->count - i < width ? region->count - i : width;
+    ctx->ptr = block;
+    for (ctx->lane = 0; ctx->lane < lanes; ctx->lane++)
+      system->func(ctx, delta_time);
+    block += storage->layout.block_size;
+  }
+}
+
+static void system_run_region(const struct system *system,
+                              const struct storage *storage,
+                              const struct region *region, size_t slot,
+                              int tuning, double delta_time) {
+  struct storage_access *access =
+      tuning ? hash_map_get_value(&system->storages, &storage) : NULL;
+  CigSystemCtx ctx =
+      (CigSystemCtx){.offsets = system->offsets,
+                     .strides = system->strides,
+                     .user_data = system->user_data,
+                     .accumulator = system_get_accumulator(system, slot),
+                     .touched = access ? &access->touched : NULL,
+                     .group = region->group};
+  system_run_families(system, &ctx, storage, region, delta_time);
+}
+
+// Runs the system, and when `fused` is set the rest of its chain, on a region
+static int system_run_chain(const struct system *system, int fused,
+                            const struct storage *storage,
+                            struct region *region, size_t slot, int tuning,
+                            double delta_time) {
+  for (const struct system *s = system; s; s = fused ? s->fused_next : NULL) {
+    // Writing systems need the region's own copy of a shared chunk
+    if (!s->read_only && region_make_unique(region, storage))
+      return EXIT_FAILURE;
+
+    system_run_region(s, storage, region, slot, tuning, delta_time);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// The regions of one storage, handed out to the workers one at a time. In
+// deterministic mode they are handed out in `parts` fixed runs of regions
+// instead, each run with the accumulator of its part.
+struct system_job {
+  const struct system *system;
+  int fused;
+  const struct storage *storage;
+  struct region **regions;
+  size_t count, parts;
+  int tuning;
+  double delta_time;
+  atomic_int failed;
+};
+
+static void system_job_run(void *job_ptr, size_t index, size_t slot) {
+  struct system_job *job = job_ptr;
+
+  size_t first = index, last = index + 1;
+  if (job->parts) {
+    first = index * job->count / job->parts;
+    last = (index + 1) * job->count / job->parts;
+    slot = index;
+  }
+
+  for (size_t i = first; i < last; i++) {
+    if (system_run_chain(job->system, job->fused, job->storage,
+                         job->regions[i], slot, job->tuning,
+                         job->delta_time)) {
+      atomic_store(&job->failed, 1);
+      return;
     }
+  }
+}
+
+// Runs the system over all of its matched storages. When `fused` is set, the
+// systems fused after it are run on each region straight after it, while the
+// region is still in cache.
+static int system_run(const CigWorld *w, const struct system *system,
+                      int fused, double delta_time) {
+  CIG_PROBE2(system_begin, system->identifier, fused);
+  const uint64_t start = now_ns();
+  size_t families = 0;
+
+  uint64_t before[PERF_COUNTER_COUNT];
+  const int counted = w->counters && !perf_counters_read(w->counters, before);
+
+  for (const struct system *s = system; s; s = fused ? s->fused_next : NULL)
+    if (s->accumulators)
+      system_reduction_begin(s);
+
+  // The regions are gathered first when they are run in parallel, or split
+  // into the same parts whatever the number of threads
+  const int gather = w->pool || w->deterministic;
+
+  // Contains `struct region *`, the regions of a storage to run in parallel
+  Vector regions;
+  if (gather && vector_init(&regions, sizeof(struct region *)))
+    return EXIT_FAILURE;
+
+  // Contains `const HashMapKV *`, the storages matched with the system
+  Vector storages;
+  if (system_storages(w, system, &storages)) {
+    if (gather)
+      vector_deinit(&regions);
+    return EXIT_FAILURE;
+  }
+
+  // Loop through the storages that have been matched with the system
+  const HashMapKV **kvs = storages.data;
+  for (size_t i = 0; i < vector_len(&storages); i++) {
+    struct storage *storage = *(struct storage **)kvs[i]->key;
+
+    for (const struct system *s = system; s; s = fused ? s->fused_next : NULL)
+      system_set_offsets(w, s, storage);
+
+    const uint64_t storage_start = w->tuning ? now_ns() : 0;
+    const size_t storage_families = families;
+
+    if (gather)
+      vector_resize(&regions, 0);
 
     LinkedListNode *next = storage->regions.first;
     if (next) {
       do {
         struct region *region = next->data;
-        for (size_t i = 0; i < region->count; i++) {
-          const size_t offset = storage->layout.family_size * i;
-          ctx.ptr = region->ptr + offset;
-          system->func(&ctx, delta_time);
+        if (!region->ptr || !system_wants_region(system, storage, region))
+          continue;
+
+        families += region->count;
+        if (!gather) {
+          if (system_run_chain(system, fused, storage, region, 0, w->tuning,
+                               delta_time))
+            goto err;
+        } else if (vector_append(&regions, &region)) {
+          goto err;
         }
       } while ((next = next->next));
     }
+
+    const size_t count = gather ? vector_len(&regions) : 0;
+    if (count > 0) {
+      // The parts only depend on the number of regions
+      size_t parts = 0;
+      if (w->deterministic)
+        parts = count < DETERMINISTIC_PARTS ? count : DETERMINISTIC_PARTS;
+
+      struct system_job job = {.system = system,
+                               .fused = fused,
+                               .storage = storage,
+                               .regions = regions.data,
+                               .count = count,
+                               .parts = parts,
+                               .tuning = w->tuning,
+                               .delta_time = delta_time};
+      const size_t jobs = parts ? parts : count;
+
+      // A lone region isn't worth waking the workers for
+      if (!w->pool || jobs == 1) {
+        for (size_t j = 0; j < jobs; j++)
+          system_job_run(&job, j, 0);
+      } else {
+        thread_pool_run(w->pool, system_job_run, &job, jobs);
+      }
+
+      if (atomic_load(&job.failed))
+        goto err;
+    }
+
+    if (!w->tuning)
+      continue;
+
+    struct storage_access *access = kvs[i]->value;
+    access->ns += now_ns() - storage_start;
+    for (const struct system *s = system; s; s = fused ? s->fused_next : NULL)
+      ((struct storage_access *)hash_map_get_value(&s->storages, &storage))
+          ->families += families - storage_families;
+  }
+
+  vector_deinit(&storages);
+  if (gather)
+    vector_deinit(&regions);
+
+  for (const struct system *s = system; s; s = fused ? s->fused_next : NULL)
+    system_reduction_end(s);
+
+  // A fused chain is counted as a whole by its head
+  histogram_record(system->latency, now_ns() - start);
+
+  CigSystemStats *stats = system->stats;
+  stats->runs++;
+  stats->families += families;
+
+  uint64_t after[PERF_COUNTER_COUNT];
+  if (counted && !perf_counters_read(w->counters, after)) {
+    stats->cycles += after[PERF_CYCLES] - before[PERF_CYCLES];
+    stats->instructions += after[PERF_INSTRUCTIONS] - before[PERF_INSTRUCTIONS];
+    stats->cache_misses += after[PERF_CACHE_MISSES] - before[PERF_CACHE_MISSES];
+    stats->branch_misses +=
+        after[PERF_BRANCH_MISSES] - before[PERF_BRANCH_MISSES];
   }
 
-  return EXIT_SUCCESS;
-}
+  CIG_PROBE2(system_end, system->identifier, families);
+  return EXIT_SUCCESS;
+
+err:
+  vector_deinit(&storages);
+  if (gather)
+    vector_deinit(&regions);
+
+  return EXIT_FAILURE;
+}
+
+int cig_world_register_system(CigWorld *w, CigSystemDesc *desc) {
+  struct system system;
+  if (system_init(w, &system, desc))
+    return EXIT_FAILURE;
+
+  if (desc->fuse_after) {
+    const struct system *target =
+        hash_map_get_value(&w->systems, &desc->fuse_after);
+    if (!target) {
+      fprintf(stderr,
+              "%s(): There is no system registered with the identifier (%s) "
+              "to fuse after.\n",
+              __func__, desc->fuse_after);
+      system_deinit(&system);
+      return EXIT_FAILURE;
+    }
+
+    if (!is_fusible(target, &system)) {
+      fprintf(stderr,
+              "%s(): System (%s) does not have the same requirements as the "
+              "system (%s) it is fused after.\n",
+              __func__, desc->identifier, desc->fuse_after);
+      system_deinit(&system);
+      return EXIT_FAILURE;
+    }
+
+    if (target->extract || system.extract) {
+      fprintf(stderr, "%s(): Extraction systems can't be fused (%s).\n",
+              __func__, desc->identifier);
+      system_deinit(&system);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The extraction in flight holds on to the systems
+  cig_world_wait_extraction(w);
+
+  // The system is matched with every storage below, the new storages are
+  // matched with the others first
+  if (world_match_storages(w)) {
+    system_deinit(&system);
+    return EXIT_FAILURE;
+  }
+
+  if (hash_map_put(&w->systems, &system.identifier, &system)) {
+    system_deinit(&system);
+    return EXIT_FAILURE;
+  }
+
+  // Match against the copy owned by the map so that storages point at it
+  struct system *stored = hash_map_get_value(&w->systems, &system.identifier);
+  if (vector_append(&w->system_order, &stored)) {
+    hash_map_delete(&w->systems, &system.identifier);
+    system_deinit(&system);
+    return EXIT_FAILURE;
+  }
+
+  if (system_find_matches(w, stored)) {
+    vector_resize(&w->system_order, vector_len(&w->system_order) - 1);
+    hash_map_delete(&w->systems, &system.identifier);
+    system_deinit(&system);
+    return EXIT_FAILURE;
+  }
+
+  if (desc->fuse_after) {
+    // Append to the end of the chain that the target belongs to
+    struct system *tail = hash_map_get_value(&w->systems, &desc->fuse_after);
+    while (tail->fused_next)
+      tail = tail->fused_next;
+
+    tail->fused_next = stored;
+    stored->fused = 1;
+  }
+
+#ifdef DEBUG
+  printf("%s(): System registered (%s).\n", __func__, desc->identifier);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+static int generate_entity_mask(Bitset *mask, const char *type,
+                                const char *token, int32_t id, void *e) {
+  if (strcmp(token, type) == 0) {
+    bitset_incl(mask, id);
+    return EXIT_SUCCESS;
+  }
+
+  return EXIT_FAILURE;
+}
+
+static int assign_regions(CigWorld *w, struct storage *storage, size_t count,
+                          int zero) {
+  struct storage_regions_request request;
+  if (storage_request_regions(storage, &request, count, zero))
+    return EXIT_FAILURE;
+
+  size_t i = 0;
+  for (size_t k = 0; k < vector_len(&request.spans); k++) {
+    const struct region_span *span = vector_get(&request.spans, k);
+    CigEntity *ids = region_entities(storage, span->region);
+
+    for (size_t j = span->index; j < span->index + span->count; j++) {
+      const CigEntity id = w->last_spawned[i];
+      struct entity_internal *e = vector_get(&w->entities, id);
+
+      // Check if the entity has existing storage, this means that there may be
+      // types that need to be moved into the new storage
+      if (e->storage) {
+        struct storage *old_storage = e->storage;
+        old_storage->count--;
+
+        // Get the intersection between the old and new storage masks
+        Bitset intersection;
+        if (bitset_intersect(&old_storage->mask, &storage->mask, &intersection))
+          goto err;
+
+        // For each of the intersecting types, copy the type from the old
+        // storage to the new storage
+        for (size_t id = 0; bitset_next(&intersection, &id); id++)
+          copy_type(span->region->ptr, &storage->layout,
+                    get_type_index(storage, id), j, e->region->ptr,
+                    &old_storage->layout, get_type_index(old_storage, id),
+                    e->index, get_size(w, id), 1);
+
+        bitset_deinit(&intersection);
+      }
+
+      // Assign the entities new storage and family
+      e->storage = storage;
+      e->region = span->region;
+      e->index = j;
+      ids[j] = id;
+
+      i++;
+    }
+  }
+
+  storage_regions_request_commit(&request, 1);
+  storage->count += count;
+  return EXIT_SUCCESS;
+
+err:
+  storage_regions_request_commit(&request, 0);
+  return EXIT_FAILURE;
+}
+
+static void journal_record_spawn(CigWorld *w, const struct storage *storage,
+                                 size_t count) {
+  const uint64_t count64 = count;
+  const uint32_t type_count = storage->layout.count;
+  journal_begin(w->journal, JOURNAL_SPAWN,
+                sizeof(count64) + sizeof(type_count) +
+                    sizeof(uint32_t) * type_count);
+  journal_append(w->journal, &count64, sizeof(count64));
+  journal_append(w->journal, &type_count, sizeof(type_count));
+  for (size_t i = 0; i < type_count; i++)
+    journal_append(w->journal, &storage->layout.types[i].id, sizeof(uint32_t));
+}
+
+// Spawns `count` entities into the storage for `mask`, which it takes ownership
+// of. See `storage_request_regions()` for `zero`.
+static const CigEntity *spawn_mask(CigWorld *w, size_t count, Bitset mask,
+                                   int zero) {
+  CigEntity *result = realloc(w->last_spawned, sizeof(CigEntity) * count);
+  if (!result) {
+    bitset_deinit(&mask);
+    return NULL;
+  }
+  w->last_spawned = result;
+
+  // The storage takes ownership of the mask
+  struct storage *storage = get_storage(w, mask);
+  if (!storage)
+    return NULL;
+
+  const size_t unassigned_count = vector_len(&w->unassigned);
+  size_t new_unassigned_count = unassigned_count;
+
+  // `i` is used to keep track of how many entities we have sorted out
+  size_t i = 0;
+  // Take as many entities as possible from world->recycled first
+  while (new_unassigned_count > 0 && i < count)
+    result[i++] =
+        *((CigEntity *)vector_get(&w->unassigned, --new_unassigned_count));
+
+  // Make space for the new entities
+  if (vector_resize(&w->entities, vector_len(&w->entities) + (count - i)))
+    return NULL;
+
+  struct entity_internal e = {0};
+  while (i < count) {
+    vector_append(&w->entities, &e);
+    // Make sure `next_entity` is iterated
+    result[i++] = w->next_entity++;
+  }
+
+  // How many did we take from recycled
+  size_t recycled_count = unassigned_count - new_unassigned_count;
+  size_t new_count = count - recycled_count;
+  if (assign_regions(w, storage, count, zero)) {
+    // Reset everything back to what it was before.
+    vector_resize(&w->entities, vector_len(&w->entities) - new_count);
+    w->next_entity -= new_count;
+    return NULL;
+  }
+
+  // If we took anything from recycled then be sure to shrink it down to it's
+  // new capacity
+  if (recycled_count > 0)
+    vector_resize(&w->unassigned, new_unassigned_count);
+
+  if (w->journal)
+    journal_record_spawn(w, storage, count);
+
+  CIG_PROBE4(spawn, w, count, storage->layout.count, recycled_count);
+
+#ifdef DEBUG
+  printf("%s(): Spawned (%zu) entities.\nRecycled: %zu\nNew: %zu\n", __func__,
+         count, recycled_count, new_count);
+#endif
+  return w->last_spawned;
+}
+
+const CigEntity *cig_world_spawn(CigWorld *w, size_t count,
+                                 const char *types_str) {
+  assert(w != NULL);
+  assert(types_str != NULL);
+
+  size_t types_count = count_char(types_str, ',') + 1;
+
+  Bitset mask;
+  if (bitset_init(&mask, types_count))
+    return NULL;
+
+  if (populate_mask(w, &mask, generate_entity_mask, types_str, NULL)) {
+    bitset_deinit(&mask);
+    return NULL;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Spawning (%zu) entities with types [%s].\n", __func__, count,
+         types_str);
+#endif
+
+  return spawn_mask(w, count, mask, 1);
+}
+
+// Moves the families of the storage into new chunks laid out as `layout`. The
+// types of both layouts must be in the same order.
+static int storage_relayout(CigWorld *w, struct storage *storage,
+                            const struct storage_layout *layout) {
+  const size_t type_count = layout->count;
+  size_t len = 0;
+  for (LinkedListNode *node = storage->regions.first; node; node = node->next)
+    len++;
+
+  // Contains `struct region`, in the order they are filled
+  Vector regions;
+  const struct region **old = malloc(len * sizeof(struct region *));
+  if ((!old && len > 0) || vector_init(&regions, sizeof(struct region))) {
+    free(old);
+    return EXIT_FAILURE;
+  }
+
+  len = 0;
+  for (LinkedListNode *node = storage->regions.first; node; node = node->next)
+    old[len++] = node->data;
+
+  // The oldest regions are at the back, they are copied first so that the
+  // last region to be filled ends up in front
+  struct region *dest = NULL;
+  for (size_t i = len; i-- > 0;) {
+    const struct region *src = old[i];
+    const CigEntity *ids = region_entities(storage, src);
+
+    size_t j = 0;
+    while (j < src->count) {
+      // Families left behind by entities that moved are dropped
+      if (!is_family_owned(w, storage, src, j)) {
+        j++;
+        continue;
+      }
+
+      if (!dest || dest->count == layout->capacity) {
+        struct region region;
+        if (region_init(&region, storage))
+          goto err;
+        if (vector_append(&regions, &region)) {
+          region_deinit(&region);
+          goto err;
+        }
+        dest = vector_get(&regions, vector_len(&regions) - 1);
+      }
+
+      // Copy the run of owned families that fits into the region
+      size_t n = 1;
+      while (j + n < src->count && dest->count + n < layout->capacity &&
+             is_family_owned(w, storage, src, j + n))
+        n++;
+
+      // The types may be in another order in the new layout
+      for (size_t t = 0; t < type_count; t++) {
+        const size_t src_type = get_type_index(storage, layout->types[t].id);
+        copy_type(dest->ptr, layout, t, dest->count, src->ptr,
+                  &storage->layout, src_type, j,
+                  get_size(w, layout->types[t].id), n);
+      }
+
+      CigEntity *dest_ids = dest->ptr + layout->entities_offset;
+      memcpy(dest_ids + dest->count, ids + j, n * sizeof(CigEntity));
+      dest->count += n;
+      j += n;
+    }
+  }
+
+  LinkedList list = linked_list_init();
+  for (size_t i = 0; i < vector_len(&regions); i++)
+    if (linked_list_prepend(&list, vector_get(&regions, i),
+                            sizeof(struct region))) {
+      // The regions are still owned by the vector
+      LinkedListNode *node;
+      while ((node = linked_list_pop_first(&list)))
+        linked_list_node_deinit(node);
+      goto err;
+    }
+
+  LinkedListNode *node;
+  while ((node = linked_list_pop_first(&storage->regions))) {
+    region_deinit(node->data);
+    linked_list_node_deinit(node);
+  }
+  storage->regions = list;
+
+  // Point the entities at their new families
+  for (node = storage->regions.first; node; node = node->next) {
+    struct region *region = node->data;
+    const CigEntity *ids = region->ptr + layout->entities_offset;
+    for (size_t i = 0; i < region->count; i++) {
+      struct entity_internal *e = vector_get(&w->entities, ids[i]);
+      e->region = region;
+      e->index = i;
+    }
+  }
+
+  layout_deinit(&storage->layout);
+  storage->layout = *layout;
+
+  // The families were packed in order, their groups are sorted out again by
+  // the next pass
+  if (storage->grouping)
+    storage->grouping->seen = 0;
+
+  vector_deinit(&regions);
+  free(old);
+  return EXIT_SUCCESS;
+
+err:
+  for (size_t i = 0; i < vector_len(&regions); i++)
+    region_deinit(vector_get(&regions, i));
+  vector_deinit(&regions);
+  free(old);
+  return EXIT_FAILURE;
+}
+
+// The first system of the storage that needs a type the layout splits
+static const struct system *
+storage_needs_split(const struct storage *storage,
+                    const struct storage_layout *layout) {
+  HashMapIterator it = hash_map_iter(&storage->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct system *system = *(struct system **)kv->key;
+    if (needs_split_type(system, layout))
+      return system;
+  }
+
+  return NULL;
+}
+
+int cig_world_set_layout(CigWorld *w, const char *types_str,
+                         size_t block_width, int split_fields) {
+  assert(w != NULL);
+  assert(types_str != NULL);
+
+  if (block_width == 0 || (block_width & (block_width - 1))) {
+    fprintf(stderr, "%s(): The block width (%zu) is not a power of two.\n",
+            __func__, block_width);
+    return EXIT_FAILURE;
+  }
+
+  size_t types_count = count_char(types_str, ',') + 1;
+
+  Bitset mask;
+  if (bitset_init(&mask, types_count))
+    return EXIT_FAILURE;
+
+  if (populate_mask(w, &mask, generate_entity_mask, types_str, NULL)) {
+    bitset_deinit(&mask);
+    return EXIT_FAILURE;
+  }
+
+  // Frozen chunks are read with the layout of their storage
+  cig_world_wait_extraction(w);
+
+  // The storage takes ownership of the mask, its systems are needed to check
+  // the layout against
+  struct storage *storage = get_storage(w, mask);
+  if (!storage || world_match_storages(w))
+    return EXIT_FAILURE;
+
+  // Fields are only split into their own columns within blocks
+  split_fields = split_fields && block_width > 1;
+  if (storage->layout.block_width == block_width &&
+      storage->layout.split_fields == split_fields)
+    return EXIT_SUCCESS;
+
+  if (storage_is_paged_out(storage)) {
+    fprintf(stderr, "%s(): Storage of [%s] has paged out regions.\n",
+            __func__, types_str);
+    return EXIT_FAILURE;
+  }
+
+  struct storage_layout layout;
+  if (calculate_layout(w, &layout, storage->mask))
+    return EXIT_FAILURE;
+
+  if (block_width > 1 &&
+      layout_tile(w, &layout, block_width, split_fields)) {
+    layout_deinit(&layout);
+    return EXIT_FAILURE;
+  }
+
+  // The systems that use a whole type can't be given a split one
+  const struct system *system = storage_needs_split(storage, &layout);
+  if (system) {
+    fprintf(stderr, "%s(): System (%s) needs a type of [%s] whole.\n",
+            __func__, system->identifier, types_str);
+    layout_deinit(&layout);
+    return EXIT_FAILURE;
+  }
+
+  if (storage_relayout(w, storage, &layout)) {
+    layout_deinit(&layout);
+    return EXIT_FAILURE;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Laid out [%s] in blocks of (%zu).\n", __func__, types_str,
+         block_width);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+static uint32_t group_hash(const void *group) {
+  return fnv1a_32_hash(group, sizeof(uint64_t));
+}
+
+static int group_eql(const void *a, const void *b) {
+  return *(const uint64_t *)a == *(const uint64_t *)b;
+}
+
+// Copies the family at `src_index` of `src` over the one at `index` of `dest`,
+// the entity is pointed at the copy if it owned the family
+static void storage_move_family(CigWorld *w, struct storage *storage,
+                                struct region *dest, size_t index,
+                                const struct region *src, size_t src_index) {
+  const struct storage_layout *layout = &storage->layout;
+  const int owned = is_family_owned(w, storage, src, src_index);
+  for (size_t t = 0; t < layout->count; t++)
+    copy_type(dest->ptr, layout, t, index, src->ptr, layout, t, src_index,
+              get_size(w, layout->types[t].id), 1);
+
+  const CigEntity id = region_entities(storage, src)[src_index];
+  region_entities(storage, dest)[index] = id;
+  if (owned)
+    *(struct entity_internal *)vector_get(&w->entities, id) =
+        (struct entity_internal){
+            .storage = storage, .region = dest, .index = index};
+}
+
+// A region of the group with room for another family. `open` holds the region
+// being filled for each group and `empty` the regions without families.
+static struct region *storage_group_region(struct storage *storage,
+                                           HashMap *open, Vector *empty,
+                                           uint64_t group) {
+  struct region **found = hash_map_get_value(open, &group);
+  if (found && (*found)->group == group &&
+      (*found)->count < storage->layout.capacity)
+    return *found;
+
+  // Empty regions are given to the group before new ones, unless they were
+  // filled again in the meantime
+  struct region *region = NULL;
+  size_t empty_count;
+  while (!region && (empty_count = vector_len(empty)) > 0) {
+    struct region *next = *(struct region **)vector_get(empty, empty_count - 1);
+    vector_resize(empty, empty_count - 1);
+    if (next->count == 0)
+      region = next;
+  }
+
+  if (!region) {
+    if (prepend_new_region(storage))
+      return NULL;
+    region = storage->regions.first->data;
+  }
+
+  if (region_make_unique(region, storage) ||
+      hash_map_put(open, &group, &region))
+    return NULL;
+
+  region->group = group;
+  return region;
+}
+
+// Moves the families of the regions written to since the last pass into
+// regions of their group, the holes they leave are filled from the back
+static int storage_regroup(CigWorld *w, struct storage *storage) {
+  struct grouping *grouping = storage->grouping;
+  const uint64_t now = atomic_fetch_add(&change_clock, 1);
+  const size_t capacity = storage->layout.capacity;
+
+  size_t len;
+  const struct column_layout column =
+      layout_bytes(&storage->layout, get_type_index(storage, grouping->id),
+                   grouping->offset, &len);
+
+  // The `struct region *` being filled for each group, and the
+  // `struct region *` without families
+  HashMap open;
+  Vector empty;
+  if (hash_map_init(&open, group_hash, group_eql, sizeof(uint64_t),
+                    sizeof(struct region *)))
+    return EXIT_FAILURE;
+  if (vector_init(&empty, sizeof(struct region *))) {
+    hash_map_deinit(&open);
+    return EXIT_FAILURE;
+  }
+
+  int result = EXIT_SUCCESS;
+  for (LinkedListNode *node = storage->regions.first; node;
+       node = node->next) {
+    struct region *region = node->data;
+    if (!region->ptr)
+      continue;
+
+    if (region->count == 0)
+      result = vector_append(&empty, &region);
+    else if (region->count < capacity)
+      result = hash_map_put(&open, &region->group, &region);
+    if (result)
+      goto out;
+  }
+
+  // Regions prepended for new groups are in front, they are not visited
+  for (LinkedListNode *node = storage->regions.first; node;
+       node = node->next) {
+    struct region *region = node->data;
+    if (!region->ptr || region->count == 0 || region->changed < grouping->seen)
+      continue;
+
+    if (region_make_unique(region, storage)) {
+      result = EXIT_FAILURE;
+      goto out;
+    }
+
+    size_t i = 0;
+    while (i < region->count) {
+      if (is_family_owned(w, storage, region, i)) {
+        const uint64_t group = grouping->func(
+            region->ptr + column_at(&column, i), grouping->user_data);
+        if (group == region->group) {
+          i++;
+          continue;
+        }
+
+        struct region *dest =
+            storage_group_region(storage, &open, &empty, group);
+        if (!dest) {
+          result = EXIT_FAILURE;
+          goto out;
+        }
+        storage_move_family(w, storage, dest, dest->count++, region, i);
+      }
+
+      // Families left behind by entities that moved are dropped as well
+      region->count--;
+      if (i < region->count)
+        storage_move_family(w, storage, region, i, region, region->count);
+    }
+
+    // Not being able to reuse it only costs another region later on
+    if (region->count == 0)
+      vector_append(&empty, &region);
+  }
+
+  grouping->seen = now + 1;
+
+out:
+  vector_deinit(&empty);
+  hash_map_deinit(&open);
+  return result;
+}
+
+// Where the field named `name` is within its type, `field` is -1 for the whole
+// type. A type that can be split is only ever whole in some of its storages,
+// so only its fields can be read in place.
+static int field_offset(const CigWorld *w, int32_t id, int32_t field,
+                        const char *name, size_t *offset) {
+  const CigTypeDesc *type = get_type(w, id);
+  if (field < 0 && type->field_count > 0) {
+    fprintf(stderr, "%s(): Type (%s) has fields, only they can be used.\n",
+            __func__, name);
+    return EXIT_FAILURE;
+  }
+
+  *offset = field < 0 ? 0 : type->fields[field].offset;
+  return EXIT_SUCCESS;
+}
+
+int cig_world_set_grouping(CigWorld *w, const char *types_str,
+                           CigGroupDesc *desc) {
+  assert(w != NULL);
+  assert(types_str != NULL);
+
+  size_t types_count = count_char(types_str, ',') + 1;
+
+  Bitset mask;
+  if (bitset_init(&mask, types_count))
+    return EXIT_FAILURE;
+
+  if (populate_mask(w, &mask, generate_entity_mask, types_str, NULL)) {
+    bitset_deinit(&mask);
+    return EXIT_FAILURE;
+  }
+
+  // Frozen chunks hold on to the families where they are
+  cig_world_wait_extraction(w);
+
+  // The storage takes ownership of the mask
+  struct storage *storage = get_storage(w, mask);
+  if (!storage)
+    return EXIT_FAILURE;
+
+  if (!desc) {
+    free(storage->grouping);
+    storage->grouping = NULL;
+    for (LinkedListNode *node = storage->regions.first; node;
+         node = node->next)
+      ((struct region *)node->data)->group = 0;
+    return EXIT_SUCCESS;
+  }
+
+  int32_t field;
+  const int32_t id = get_field_id(w, desc->field, &field);
+  if (id < 0 || !bitset_has(&storage->mask, id)) {
+    fprintf(stderr, "%s(): Storage of [%s] has no (%s).\n", __func__,
+            types_str, desc->field);
+    return EXIT_FAILURE;
+  }
+
+  size_t offset;
+  if (field_offset(w, id, field, desc->field, &offset))
+    return EXIT_FAILURE;
+
+  if (!storage->grouping &&
+      !(storage->grouping = malloc(sizeof(struct grouping))))
+    return EXIT_FAILURE;
+
+  // Every region is grouped by the first pass
+  *storage->grouping = (struct grouping){
+      .func = desc->func,
+      .user_data = desc->user_data,
+      .id = id,
+      .offset = offset};
+
+  if (storage_regroup(w, storage))
+    return EXIT_FAILURE;
+
+#ifdef DEBUG
+  printf("%s(): Grouped [%s] by (%s).\n", __func__, types_str, desc->field);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_regroup(CigWorld *w) {
+  assert(w != NULL);
+
+  cig_world_wait_extraction(w);
+
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    struct storage *storage = kv->value;
+    if (storage->grouping && storage_regroup(w, storage))
+      return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Despawns every entity in the storages that match the query, their ids are
+// appended to the unassigned ones in the order their families are found
+static int despawn_query(CigWorld *w, const struct query *query) {
+  // The ids of paged out families can't be read, so nothing is despawned if
+  // any of the storages has them
+  size_t total = 0;
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct storage *storage = kv->value;
+    if (!is_match(storage->mask, query->must_have, query->must_not_have))
+      continue;
+
+    if (storage_is_paged_out(storage)) {
+      fprintf(stderr, "%s(): A matching storage has paged out regions.\n",
+              __func__);
+      return EXIT_FAILURE;
+    }
+    total += storage->count;
+  }
+
+  // Reserved up front so that appending the ids can't fail halfway
+  if (vector_resize(&w->unassigned, vector_len(&w->unassigned) + total))
+    return EXIT_FAILURE;
+
+  it = hash_map_iter(&w->storages);
+  while ((kv = hash_map_next(&it))) {
+    struct storage *storage = kv->value;
+    if (!is_match(storage->mask, query->must_have, query->must_not_have))
+      continue;
+
+    // Only the ids are read, the chunks go back whole. Families that were
+    // moved out already belong to an entity elsewhere.
+    LinkedListNode *node;
+    while ((node = linked_list_pop_first(&storage->regions))) {
+      struct region *region = node->data;
+      const CigEntity *ids = region_entities(storage, region);
+      for (size_t i = 0; i < region->count; i++) {
+        if (!is_family_owned(w, storage, region, i))
+          continue;
+
+        *(struct entity_internal *)vector_get(&w->entities, ids[i]) =
+            (struct entity_internal){0};
+        vector_append(&w->unassigned, &ids[i]);
+      }
+
+      region_deinit(region);
+      linked_list_node_deinit(node);
+    }
+
+    for (size_t i = 0; i < vector_len(&storage->unassigned); i++)
+      region_deinit(vector_get(&storage->unassigned, i));
+    vector_resize(&storage->unassigned, 0);
+    storage->count = 0;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void journal_record_despawn(CigWorld *w, const char *requirements,
+                                   size_t first) {
+  const uint64_t count = vector_len(&w->unassigned) - first;
+  const size_t len = strlen(requirements);
+  journal_begin(w->journal, JOURNAL_DESPAWN,
+                sizeof(count) + sizeof(CigEntity) * count + len);
+  journal_append(w->journal, &count, sizeof(count));
+  journal_append(w->journal, vector_get(&w->unassigned, first),
+                 sizeof(CigEntity) * count);
+  journal_append(w->journal, requirements, len);
+}
+
+int cig_world_despawn_query(CigWorld *w, const char *requirements) {
+  assert(w != NULL);
+  assert(requirements != NULL);
+
+  struct query query;
+  if (query_init(w, &query, requirements))
+    return EXIT_FAILURE;
+
+  // Frozen chunks are still read by the extraction
+  cig_world_wait_extraction(w);
+
+  const size_t first = vector_len(&w->unassigned);
+  const int result = despawn_query(w, &query);
+  query_deinit(&query);
+  if (result)
+    return EXIT_FAILURE;
+
+  if (w->journal)
+    journal_record_despawn(w, requirements, first);
+
+#ifdef DEBUG
+  printf("%s(): Despawned (%zu) entities matching [%s].\n", __func__,
+         vector_len(&w->unassigned) - first, requirements);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+// The widest blocks tuning lays a storage out in
+#define TUNE_BLOCK_WIDTH 32
+
+static int access_has(const struct storage_access *access, size_t idx) {
+  return atomic_load(&access->touched) >> (idx < 63 ? idx : 63) & 1;
+}
+
+static int layout_has_split(const struct storage_layout *layout) {
+  for (size_t i = 0; i < layout->count; i++)
+    if (layout->types[i].field_count > 0)
+      return 1;
+
+  return 0;
+}
+
+static int layout_is_split(const struct storage_layout *layout, int32_t id) {
+  for (size_t i = 0; i < layout->count; i++)
+    if (layout->types[i].id == id)
+      return layout->types[i].field_count > 0;
+
+  return 0;
+}
+
+// The bytes the systems brought into cache over the last window if the
+// families had been laid out as `layout`. A packed family is read whole, up to
+// a cache line for each touched component, blocks only read the columns that
+// are touched.
+static uint64_t layout_cost(const CigWorld *w, const struct storage *storage,
+                            const struct storage_layout *layout) {
+  uint64_t result = 0;
+  HashMapIterator it = hash_map_iter(&storage->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct system *system = *(struct system **)kv->key;
+    const struct storage_access *access =
+        hash_map_get_value(&system->storages, &storage);
+    if (!access || access->families == 0)
+      continue;
+
+    size_t bytes = 0, touched = 0;
+    for (size_t i = 0; i < system->types_len; i++) {
+      if (!access_has(access, i))
+        continue;
+      touched++;
+
+      // The fields of a whole type are in the same column
+      const int32_t id = system->types[i];
+      const int32_t field =
+          layout_is_split(layout, id) ? system->fields[i] : -1;
+      size_t j = 0;
+      while (j < i && !(access_has(access, j) && system->types[j] == id &&
+                        (field < 0 || system->fields[j] == field)))
+        j++;
+      if (j < i)
+        continue;
+
+      bytes +=
+          field < 0 ? get_size(w, id) : get_type(w, id)->fields[field].size;
+    }
+
+    if (layout->block_width == 1) {
+      bytes = touched * CACHE_LINE_SIZE;
+      if (bytes > layout->family_size)
+        bytes = layout->family_size;
+    }
+
+    result += access->families * bytes;
+  }
+
+  return result;
+}
+
+// How many families the systems ran on touching the type
+static uint64_t type_heat(const struct storage *storage, int32_t id) {
+  uint64_t result = 0;
+  HashMapIterator it = hash_map_iter(&storage->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct system *system = *(struct system **)kv->key;
+    const struct storage_access *access =
+        hash_map_get_value(&system->storages, &storage);
+    for (size_t i = 0; access && i < system->types_len; i++)
+      if (system->types[i] == id && access_has(access, i)) {
+        result += access->families;
+        break;
+      }
+  }
+
+  return result;
+}
+
+// Lays the storage out in blocks of `width` with the most touched types at the
+// start of each block, or packed when `width` is 1
+static int tune_layout(CigWorld *w, const struct storage *storage,
+                       size_t width, int split, struct storage_layout *result) {
+  if (calculate_layout(w, result, storage->mask))
+    return EXIT_FAILURE;
+
+  if (width == 1)
+    return EXIT_SUCCESS;
+
+  for (size_t i = 1; i < result->count; i++) {
+    const struct storage_layout_type_desc type = result->types[i];
+    const uint64_t heat = type_heat(storage, type.id);
+    size_t j = i;
+    for (; j > 0 && type_heat(storage, result->types[j - 1].id) < heat; j--)
+      result->types[j] = result->types[j - 1];
+    result->types[j] = type;
+  }
+
+  if (layout_tile(w, result, width, split)) {
+    layout_deinit(result);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void storage_access_reset(struct storage_access *access) {
+  atomic_store(&access->touched, 0);
+  access->families = 0;
+  access->ns = 0;
+}
+
+struct tune_target {
+  struct storage *storage;
+  uint64_t ns;
+};
+
+// The storages the systems spent the most time on come first
+static int tune_target_cmp(const void *a_ptr, const void *b_ptr) {
+  const struct tune_target *a = a_ptr, *b = b_ptr;
+  return (a->ns < b->ns) - (a->ns > b->ns);
+}
+
+// Picks the layout of the storage that is predicted to touch the fewest bytes,
+// a new layout has to save an eighth of the bytes so the storage doesn't flip
+// between two that are about the same
+static int storage_tune(CigWorld *w, struct storage *storage) {
+  const uint64_t current = layout_cost(w, storage, &storage->layout);
+  uint64_t best_cost = current;
+  struct storage_layout best = {0};
+
+  // Keep a few blocks in every chunk
+  const size_t family_size = storage->layout.family_size + sizeof(CigEntity);
+  size_t width = TUNE_BLOCK_WIDTH;
+  while (width > 1 && family_size * width * 4 > CHUNK_BYTE_SIZE)
+    width /= 2;
+
+  for (int i = 0; i < 3; i++) {
+    const size_t block_width = i == 0 ? 1 : width;
+    const int split = i == 2;
+    if (i > 0 && block_width == 1)
+      break;
+
+    struct storage_layout layout;
+    if (tune_layout(w, storage, block_width, split, &layout)) {
+      layout_deinit(&best);
+      return EXIT_FAILURE;
+    }
+
+    // Splitting needs a type to split that no system needs whole
+    const int usable = !split || (layout_has_split(&layout) &&
+                                  !storage_needs_split(storage, &layout));
+
+    const uint64_t cost = layout_cost(w, storage, &layout);
+    if (!usable || cost >= best_cost) {
+      layout_deinit(&layout);
+      continue;
+    }
+
+    layout_deinit(&best);
+    best = layout;
+    best_cost = cost;
+  }
+
+  if (!best.types || best_cost * 8 >= current * 7) {
+    layout_deinit(&best);
+    return EXIT_SUCCESS;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Blocks of (%zu) touch (%llu) bytes instead of (%llu).\n",
+         __func__, best.block_width, (unsigned long long)best_cost,
+         (unsigned long long)current);
+#endif
+
+  if (storage_relayout(w, storage, &best)) {
+    layout_deinit(&best);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_enable_layout_tuning(CigWorld *w, int enable) {
+  assert(w != NULL);
+  w->tuning = enable;
+  return EXIT_SUCCESS;
+}
+
+int cig_world_tune_layouts(CigWorld *w, size_t max_storages) {
+  assert(w != NULL);
+
+  // Frozen chunks are read with the layout of their storage
+  cig_world_wait_extraction(w);
+
+  if (world_match_storages(w))
+    return EXIT_FAILURE;
+
+  // Contains `struct tune_target`
+  Vector targets;
+  if (vector_init(&targets, sizeof(struct tune_target)))
+    return EXIT_FAILURE;
+
+  int result = EXIT_SUCCESS;
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    struct tune_target target = {.storage = kv->value};
+    if (target.storage->count == 0 || storage_is_paged_out(target.storage))
+      continue;
+
+    HashMapIterator systems = hash_map_iter(&target.storage->systems);
+    const HashMapKV *system_kv;
+    while ((system_kv = hash_map_next(&systems))) {
+      const struct system *system = *(struct system **)system_kv->key;
+      const struct storage_access *access =
+          hash_map_get_value(&system->storages, &target.storage);
+      target.ns += access ? access->ns : 0;
+    }
+
+    if (target.ns > 0 && vector_append(&targets, &target)) {
+      result = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  if (vector_len(&targets) > 0)
+    qsort(targets.data, vector_len(&targets), sizeof(struct tune_target),
+          tune_target_cmp);
+
+  const struct tune_target *data = targets.data;
+  for (size_t i = 0; !result && i < vector_len(&targets) && i < max_storages;
+       i++)
+    result = storage_tune(w, data[i].storage);
+
+  vector_deinit(&targets);
+
+  // The next window starts from nothing
+  it = hash_map_iter(&w->systems);
+  while ((kv = hash_map_next(&it))) {
+    struct system *system = kv->value;
+    HashMapIterator storages = hash_map_iter(&system->storages);
+    const HashMapKV *storage_kv;
+    while ((storage_kv = hash_map_next(&storages)))
+      storage_access_reset(storage_kv->value);
+  }
+
+  return result;
+}
+
+struct import_column {
+  int32_t id;
+  const void *data;
+  size_t stride;
+  // The bytes of each value in the column, a field of the type or all of it
+  size_t offset, size;
+};
+
+// Builds the mask for the columns, every type of the storage is then written by
+// the import so the families don't need zeroing
+static int import_mask(const CigWorld *w, const struct import_column *columns,
+                       size_t column_count, Bitset *result) {
+  if (bitset_init(result, vector_len(&w->types)))
+    return EXIT_FAILURE;
+
+  for (size_t i = 0; i < column_count; i++) {
+    // The fields of a type are imported as a column each
+    const int whole = columns[i].size == get_size(w, columns[i].id);
+    if (whole && bitset_has(result, columns[i].id)) {
+      fprintf(stderr, "%s(): Type (%s) is imported more than once.\n",
+              __func__, get_type(w, columns[i].id)->identifier);
+      bitset_deinit(result);
+      return EXIT_FAILURE;
+    }
+    bitset_incl(result, columns[i].id);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void journal_record_columns(CigWorld *w,
+                                   const struct import_column *columns,
+                                   size_t column_count, size_t first,
+                                   size_t count) {
+  uint64_t size = sizeof(uint64_t) * 2 + sizeof(uint32_t);
+  for (size_t i = 0; i < column_count; i++)
+    size += sizeof(uint32_t) + get_size(w, columns[i].id) * count;
+  journal_begin(w->journal, JOURNAL_COLUMNS, size);
+
+  const uint64_t header[2] = {first, count};
+  const uint32_t column_count32 = column_count;
+  journal_append(w->journal, header, sizeof(header));
+  journal_append(w->journal, &column_count32, sizeof(column_count32));
+  for (size_t i = 0; i < column_count; i++) {
+    const uint32_t id = columns[i].id;
+    const size_t type_size = get_size(w, id);
+    journal_append(w->journal, &id, sizeof(id));
+
+    void *dest = journal_reserve(w->journal, type_size * count);
+    if (dest)
+      copy_strided(dest, type_size, columns[i].data, columns[i].stride,
+                   type_size, count);
+  }
+}
+
+// Copies the next `count` components of each column into the families of the
+// last spawned entities, starting at `first`. The spawned families are
+// contiguous within each region, so the columns are copied a region at a time.
+static void import_columns(CigWorld *w, struct import_column *columns,
+                           size_t column_count, size_t first, size_t count) {
+  if (w->journal)
+    journal_record_columns(w, columns, column_count, first, count);
+
+  size_t i = first;
+  while (i < first + count) {
+    const struct entity_internal *e =
+        vector_get_const(&w->entities, w->last_spawned[i]);
+    const struct storage *storage = e->storage;
+
+    size_t n = e->region->count - e->index;
+    if (n > first + count - i)
+      n = first + count - i;
+
+    for (size_t j = 0; j < column_count; j++) {
+      const size_t t = get_type_index(storage, columns[j].id);
+      for (size_t offset = 0, m; offset < columns[j].size; offset += m) {
+        size_t len;
+        const struct column_layout dest = layout_bytes(
+            &storage->layout, t, columns[j].offset + offset, &len);
+        const struct column_layout src = {.offset = offset,
+                                          .stride = columns[j].stride,
+                                          .block_width = 1,
+                                          .block_size = columns[j].stride};
+
+        m = columns[j].size - offset;
+        if (len < m)
+          m = len;
+        copy_column(e->region->ptr, &dest, e->index, columns[j].data, &src, 0,
+                    m, n);
+      }
+      columns[j].data += columns[j].stride * n;
+    }
+
+    i += n;
+  }
+}
+
+const CigEntity *cig_world_spawn_columns(CigWorld *w, size_t count,
+                                         const CigColumnDesc *columns,
+                                         size_t column_count) {
+  assert(w != NULL);
+  assert(columns != NULL || column_count == 0);
+
+  struct import_column *import =
+      malloc(column_count * sizeof(struct import_column));
+  if (!import && column_count > 0)
+    return NULL;
+
+  for (size_t i = 0; i < column_count; i++) {
+    const int32_t id = get_id(w, columns[i].identifier);
+    if (id < 0) {
+      fprintf(stderr, "%s(): Type (%s) does not exist in the world.\n",
+              __func__, columns[i].identifier);
+      free(import);
+      return NULL;
+    }
+
+    import[i] = (struct import_column){
+        .id = id,
+        .data = columns[i].data,
+        .stride = columns[i].stride ? columns[i].stride : get_size(w, id),
+        .size = get_size(w, id)};
+  }
+
+  Bitset mask;
+  if (import_mask(w, import, column_count, &mask)) {
+    free(import);
+    return NULL;
+  }
+
+  const CigEntity *result = spawn_mask(w, count, mask, 0);
+  if (result)
+    import_columns(w, import, column_count, 0, count);
+
+  free(import);
+  return result;
+}
+
+struct import_reader {
+  const uint8_t *ptr, *end;
+};
+
+static const void *import_read(struct import_reader *reader, size_t size) {
+  if ((size_t)(reader->end - reader->ptr) < size)
+    return NULL;
+
+  const void *result = reader->ptr;
+  reader->ptr += size;
+  return result;
+}
+
+// Reads `size` bytes into `dest`, neither exports nor journal records are
+// aligned within their files
+static int journal_read(struct import_reader *reader, void *dest,
+                        size_t size) {
+  const void *src = import_read(reader, size);
+  if (!src)
+    return EXIT_FAILURE;
+
+  memcpy(dest, src, size);
+  return EXIT_SUCCESS;
+}
+
+// Whether the value of `size` bytes of family `index` ends within the chunk,
+// the column itself is known to start within it
+static int column_fits(const struct column_layout *column, size_t index,
+                       size_t size, size_t chunk_size) {
+  size_t room = chunk_size - column->offset - size;
+
+  // Divides instead of multiplying, the layout comes from the file
+  const size_t block = index / column->block_width;
+  if (block > 0) {
+    if (column->block_size > 0 && block > room / column->block_size)
+      return 0;
+    room -= column->block_size * block;
+  }
+
+  const size_t i = index % column->block_width;
+  return i == 0 || column->stride == 0 || i <= room / column->stride;
+}
+
+// Spawns the families of a section written by `cig_world_export()`, the
+// regions are copied column by column straight out of the mapped file
+static int import_section(CigWorld *w, struct import_reader *reader,
+                          uint32_t version) {
+  uint32_t header[2];
+  uint64_t region_count;
+  if (journal_read(reader, header, sizeof(header)) ||
+      journal_read(reader, &region_count, sizeof(region_count)))
+    return EXIT_FAILURE;
+
+  const uint32_t column_count = header[0];
+  const size_t chunk_size = header[1];
+  // The first version only had packed families
+  const size_t desc_len = version == 1 ? 3 : 5;
+
+  struct import_column *columns =
+      malloc(column_count * sizeof(struct import_column));
+  struct column_layout *layouts =
+      malloc(column_count * sizeof(struct column_layout));
+  if ((!columns || !layouts) && column_count > 0)
+    goto err;
+
+  size_t n = 0;
+  int fields = 0;
+  size_t capacity = 0;
+  for (uint32_t i = 0; i < column_count; i++) {
+    uint32_t len;
+    uint64_t desc[5];
+    const char *identifier =
+        journal_read(reader, &len, sizeof(len)) ? NULL
+                                                : import_read(reader, len);
+    if (!identifier ||
+        journal_read(reader, desc, sizeof(uint64_t) * desc_len) ||
+        desc[1] > chunk_size || desc[0] > chunk_size - desc[1])
+      goto err;
+
+    const struct column_layout layout = {
+        .offset = desc[1],
+        .stride = desc[2],
+        .block_width = version == 1 ? 1 : desc[3],
+        .block_size = version == 1 ? desc[2] : desc[4]};
+    if (layout.block_width == 0)
+      goto err;
+
+    char *name = strndup(identifier, len);
+    if (!name)
+      goto err;
+
+    // New ids are given to the entities, their packed column only bounds the
+    // families of each region
+    if (strcmp(name, "entity") == 0) {
+      free(name);
+      if (capacity > 0 || desc[0] != sizeof(CigEntity) ||
+          layout.block_width != 1 || layout.block_size < sizeof(CigEntity))
+        goto err;
+
+      capacity = (chunk_size - layout.offset) / layout.block_size;
+      continue;
+    }
+
+    // The fields of a split type are exported as a column each
+    int32_t field;
+    const int32_t id = get_field_id(w, name, &field);
+    const CigTypeDesc *type = id < 0 ? NULL : get_type(w, id);
+    const size_t size = !type         ? 0
+                        : field < 0 ? type->size
+                                    : type->fields[field].size;
+    if (!type || size != desc[0]) {
+      fprintf(stderr, "%s(): Type (%s) is not registered in the world.\n",
+              __func__, name);
+      free(name);
+      goto err;
+    }
+    free(name);
+
+    // The columns are copied a block at a time
+    if (n > 0 && layout.block_width != layouts[0].block_width)
+      goto err;
+
+    // Fields can't be described by the journal records
+    if (field >= 0 && w->journal) {
+      fprintf(stderr, "%s(): Can't import fields into a world with a "
+                      "journal.\n",
+              __func__);
+      goto err;
+    }
+    fields |= field >= 0;
+
+    columns[n] = (struct import_column){
+        .id = id,
+        .stride = layout.block_width == 1 ? layout.block_size : layout.stride,
+        .offset = field < 0 ? 0 : type->fields[field].offset,
+        .size = size};
+    layouts[n++] = layout;
+  }
+
+  // Entities without components are never exported
+  if (n == 0 || capacity == 0)
+    goto err;
+
+  // Count the families up front so they are spawned at once
+  const uint8_t *regions = reader->ptr;
+  size_t count = 0;
+  for (uint64_t i = 0; i < region_count; i++) {
+    uint64_t families;
+    if (journal_read(reader, &families, sizeof(families)) ||
+        !import_read(reader, chunk_size) || families > capacity)
+      goto err;
+
+    // The last family of every column, and the last one of the block before
+    // it, must be inside the chunk
+    for (size_t j = 0; j < n && families > 0; j++) {
+      const size_t last = families - 1;
+      const size_t width = layouts[j].block_width;
+      const size_t size = columns[j].size;
+      if (!column_fits(&layouts[j], last, size, chunk_size) ||
+          (last >= width && !column_fits(&layouts[j], last / width * width - 1,
+                                         size, chunk_size)))
+        goto err;
+    }
+
+    count += families;
+  }
+
+  Bitset mask;
+  if (import_mask(w, columns, n, &mask))
+    goto err;
+
+  // Types are only written whole unless they come as fields
+  if (!spawn_mask(w, count, mask, fields))
+    goto err;
+
+  const size_t width = layouts[0].block_width;
+  size_t first = 0;
+  for (uint64_t i = 0; i < region_count; i++) {
+    uint64_t families;
+    memcpy(&families, regions, sizeof(families));
+    const uint8_t *chunk = regions + sizeof(uint64_t);
+    regions = chunk + chunk_size;
+
+    // Packed families are a single run
+    const size_t run = width == 1 ? families : width;
+    for (size_t k = 0; k < families; k += run) {
+      for (size_t j = 0; j < n; j++)
+        columns[j].data = chunk + column_at(&layouts[j], k);
+
+      const size_t m = families - k < run ? families - k : run;
+      import_columns(w, columns, n, first, m);
+      first += m;
+    }
+  }
+
+  free(layouts);
+  free(columns);
+  return EXIT_SUCCESS;
+
+err:
+  fprintf(stderr, "%s(): Malformed section.\n", __func__);
+  free(layouts);
+  free(columns);
+  return EXIT_FAILURE;
+}
+
+int cig_world_import(CigWorld *w, const char *path) {
+  assert(w != NULL);
+  assert(path != NULL);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, path);
+    return EXIT_FAILURE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return EXIT_FAILURE;
+
+  struct import_reader reader = {.ptr = map, .end = map + st.st_size};
+
+  int result = EXIT_FAILURE;
+  const char *magic = import_read(&reader, 4);
+  uint32_t header[2];
+  if (magic && !journal_read(&reader, header, sizeof(header)) &&
+      memcmp(magic, "CIGC", 4) == 0 && (header[0] == 1 || header[0] == 2)) {
+    result = EXIT_SUCCESS;
+    for (uint32_t i = 0; result == EXIT_SUCCESS && i < header[1]; i++)
+      result = import_section(w, &reader, header[0]);
+  } else {
+    fprintf(stderr, "%s(): (%s) is not an exported world.\n", __func__, path);
+  }
+
+  munmap(map, st.st_size);
+  return result;
+}
+
+int cig_world_journal_open(CigWorld *w, const char *path) {
+  assert(w != NULL);
+  assert(path != NULL);
+
+  if (w->journal) {
+    fprintf(stderr, "%s(): The world already has a journal.\n", __func__);
+    return EXIT_FAILURE;
+  }
+
+  struct journal *journal = calloc(1, sizeof(struct journal));
+  if (!journal)
+    return EXIT_FAILURE;
+
+  journal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (journal->fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, path);
+    free(journal);
+    return EXIT_FAILURE;
+  }
+
+  pthread_mutex_init(&journal->mutex, NULL);
+  pthread_cond_init(&journal->cond, NULL);
+  if (pthread_create(&journal->thread, NULL, journal_thread, journal)) {
+    pthread_cond_destroy(&journal->cond);
+    pthread_mutex_destroy(&journal->mutex);
+    close(journal->fd);
+    free(journal);
+    return EXIT_FAILURE;
+  }
+
+  // The file starts with the magic "CIGJ" and a `uint32_t` version
+  const uint32_t version = 1;
+  journal_append(journal, "CIGJ", 4);
+  journal_append(journal, &version, sizeof(version));
+
+  w->journal = journal;
+  return EXIT_SUCCESS;
+}
+
+int cig_world_journal_sync(CigWorld *w) {
+  assert(w != NULL);
+  return w->journal ? journal_sync(w->journal) : EXIT_SUCCESS;
+}
+
+int cig_world_journal_close(CigWorld *w) {
+  assert(w != NULL);
+  if (!w->journal)
+    return EXIT_SUCCESS;
+
+  const int result = journal_close(w->journal);
+  w->journal = NULL;
+  return result;
+}
+
+static int replay_spawn(CigWorld *w, struct import_reader *reader,
+                        size_t *spawned) {
+  uint64_t count;
+  uint32_t type_count;
+  if (journal_read(reader, &count, sizeof(count)) ||
+      journal_read(reader, &type_count, sizeof(type_count)))
+    return EXIT_FAILURE;
+
+  Bitset mask;
+  if (bitset_init(&mask, vector_len(&w->types)))
+    return EXIT_FAILURE;
+
+  for (uint32_t i = 0; i < type_count; i++) {
+    uint32_t id;
+    if (journal_read(reader, &id, sizeof(id)) || id >= vector_len(&w->types)) {
+      bitset_deinit(&mask);
+      return EXIT_FAILURE;
+    }
+    bitset_incl(&mask, id);
+  }
+
+  if (!spawn_mask(w, count, mask, 1))
+    return EXIT_FAILURE;
+
+  *spawned = count;
+  return EXIT_SUCCESS;
+}
+
+static int replay_columns(CigWorld *w, struct import_reader *reader,
+                          size_t spawned) {
+  uint64_t header[2];
+  uint32_t column_count;
+  if (journal_read(reader, header, sizeof(header)) ||
+      journal_read(reader, &column_count, sizeof(column_count)) ||
+      header[0] > spawned || header[1] > spawned - header[0])
+    return EXIT_FAILURE;
+
+  struct import_column *columns =
+      malloc(column_count * sizeof(struct import_column));
+  if (!columns && column_count > 0)
+    return EXIT_FAILURE;
+
+  for (uint32_t i = 0; i < column_count; i++) {
+    uint32_t id;
+    if (journal_read(reader, &id, sizeof(id)) ||
+        id >= vector_len(&w->types)) {
+      free(columns);
+      return EXIT_FAILURE;
+    }
+
+    const size_t size = get_size(w, id);
+    columns[i] = (struct import_column){
+        .id = id,
+        .data = import_read(reader, size * header[1]),
+        .stride = size,
+        .size = size};
+    if (!columns[i].data) {
+      free(columns);
+      return EXIT_FAILURE;
+    }
+  }
+
+  import_columns(w, columns, column_count, header[0], header[1]);
+  free(columns);
+  return EXIT_SUCCESS;
+}
+
+static int replay_set(CigWorld *w, struct import_reader *reader) {
+  uint64_t e;
+  uint32_t id;
+  if (journal_read(reader, &e, sizeof(e)) ||
+      journal_read(reader, &id, sizeof(id)) || e >= vector_len(&w->entities) ||
+      id >= vector_len(&w->types))
+    return EXIT_FAILURE;
+
+  const CigTypeDesc *type = get_type(w, id);
+  const void *data = import_read(reader, type->size);
+  if (!data)
+    return EXIT_FAILURE;
+
+  return cig_world_set_component(w, e, type->identifier, data);
+}
+
+static int replay_despawn(CigWorld *w, struct import_reader *reader) {
+  uint64_t count;
+  if (journal_read(reader, &count, sizeof(count)) ||
+      count > (size_t)(reader->end - reader->ptr) / sizeof(CigEntity))
+    return EXIT_FAILURE;
+
+  const void *ids = import_read(reader, sizeof(CigEntity) * count);
+  const size_t len = reader->end - reader->ptr;
+  char *requirements = malloc(len + 1);
+  if (!requirements)
+    return EXIT_FAILURE;
+  memcpy(requirements, reader->ptr, len);
+  requirements[len] = '\0';
+
+  struct query query;
+  if (query_init(w, &query, requirements)) {
+    free(requirements);
+    return EXIT_FAILURE;
+  }
+
+  cig_world_wait_extraction(w);
+
+  // The storages and their regions may be in another order than when the
+  // record was made, the ids are unassigned in the recorded order so that
+  // later spawns get the same ones
+  const size_t first = vector_len(&w->unassigned);
+  int result = despawn_query(w, &query);
+  query_deinit(&query);
+  if (!result && vector_len(&w->unassigned) - first != count)
+    result = EXIT_FAILURE;
+
+  if (!result) {
+    memcpy(vector_get(&w->unassigned, first), ids, sizeof(CigEntity) * count);
+    if (w->journal)
+      journal_record_despawn(w, requirements, first);
+  }
+
+  free(requirements);
+  return result;
+}
+
+int cig_world_replay(CigWorld *w, const char *path) {
+  assert(w != NULL);
+  assert(path != NULL);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, path);
+    return EXIT_FAILURE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return EXIT_FAILURE;
+
+  struct import_reader reader = {.ptr = map, .end = map + st.st_size};
+
+  const char *magic = import_read(&reader, 4);
+  uint32_t version;
+  if (!magic || memcmp(magic, "CIGJ", 4) != 0 ||
+      journal_read(&reader, &version, sizeof(version)) || version != 1) {
+    fprintf(stderr, "%s(): (%s) is not a journal.\n", __func__, path);
+    munmap(map, st.st_size);
+    return EXIT_FAILURE;
+  }
+
+  int result = EXIT_SUCCESS;
+  size_t spawned = 0, records = 0;
+  while (result == EXIT_SUCCESS) {
+    uint8_t kind;
+    uint64_t size;
+    if (journal_read(&reader, &kind, sizeof(kind)) ||
+        journal_read(&reader, &size, sizeof(size)))
+      break;
+
+    // A record cut short by a crash ends the journal
+    const uint8_t *payload = import_read(&reader, size);
+    if (!payload)
+      break;
+
+    struct import_reader record = {.ptr = payload, .end = payload + size};
+
+    switch (kind) {
+    case JOURNAL_SPAWN:
+      result = replay_spawn(w, &record, &spawned);
+      break;
+    case JOURNAL_COLUMNS:
+      result = replay_columns(w, &record, spawned);
+      break;
+    case JOURNAL_SET:
+      result = replay_set(w, &record);
+      break;
+    case JOURNAL_DESPAWN:
+      result = replay_despawn(w, &record);
+      break;
+    default:
+      result = EXIT_FAILURE;
+    }
+
+    if (result)
+      fprintf(stderr, "%s(): Malformed record (%zu).\n", __func__, records);
+    records++;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Replayed (%zu) records.\n", __func__, records);
+#endif
+
+  munmap(map, st.st_size);
+  return result;
+}
+
+struct snapshot_column {
+  size_t size;
+  // The index of the type in the layout, the entity ids come after the types
+  const struct storage_layout *layout;
+  size_t index;
+};
+
+// The column of the byte at `offset` in the values, see `layout_bytes()`
+static struct column_layout
+snapshot_bytes(const struct snapshot_column *column, size_t offset,
+               size_t *len) {
+  if (column->index < column->layout->count)
+    return layout_bytes(column->layout, column->index, offset, len);
+
+  struct column_layout result = layout_entities(column->layout);
+  result.offset += offset;
+  *len = SIZE_MAX;
+  return result;
+}
+
+// Columns are encoded as lanes of 32-bit words, or of bytes when the size isn't
+// a multiple of a word. Each lane of a `vec2` is then one of its floats.
+static size_t snapshot_lane_width(const struct snapshot_column *column) {
+  if (column->size % sizeof(uint32_t))
+    return 1;
+
+  // A word can't span two fields of a split type
+  for (size_t offset = 0; offset < column->size; offset += sizeof(uint32_t)) {
+    size_t len;
+    snapshot_bytes(column, offset, &len);
+    if (len < sizeof(uint32_t))
+      return 1;
+  }
+
+  return sizeof(uint32_t);
+}
+
+// Copies a lane of the column between the families of `spans` and `values`,
+// out of the families when `gather` is set
+static void snapshot_lane(const Vector *spans,
+                          const struct snapshot_column *column, size_t lane,
+                          uint32_t *values, int gather) {
+  const size_t width = snapshot_lane_width(column);
+  size_t len;
+  const struct column_layout layout =
+      snapshot_bytes(column, width * lane, &len);
+
+  for (size_t k = 0; k < vector_len(spans); k++) {
+    const struct region_span *span = vector_get_const(spans, k);
+
+    for (size_t i = span->index, n; i < span->index + span->count; i += n) {
+      size_t stride;
+      n = column_run(&layout, i, span->index + span->count - i, &stride);
+      uint8_t *ptr = span->region->ptr + column_at(&layout, i);
+
+      // The direction and width are decided once per run to keep the loops
+      // tight
+      if (gather && width == 1)
+        for (size_t j = 0; j < n; j++)
+          values[j] = ptr[stride * j];
+      else if (gather)
+        for (size_t j = 0; j < n; j++)
+          memcpy(&values[j], ptr + stride * j, sizeof(uint32_t));
+      else if (width == 1)
+        for (size_t j = 0; j < n; j++)
+          ptr[stride * j] = values[j];
+      else
+        for (size_t j = 0; j < n; j++)
+          memcpy(ptr + stride * j, &values[j], sizeof(uint32_t));
+
+      values += n;
+    }
+  }
+}
+
+static void snapshot_columns(const CigWorld *w, const struct storage *storage,
+                             struct snapshot_column *result) {
+  const struct storage_layout *layout = &storage->layout;
+  result[0] = (struct snapshot_column){
+      .size = sizeof(CigEntity), .layout = layout, .index = layout->count};
+
+  for (size_t i = 0; i < layout->count; i++)
+    result[i + 1] =
+        (struct snapshot_column){.size = get_size(w, layout->types[i].id),
+                                 .layout = layout,
+                                 .index = i};
+}
+
+static uint8_t *snapshot_put(uint8_t *dest, const void *src, size_t size) {
+  memcpy(dest, src, size);
+  return dest + size;
+}
+
+static int snapshot_write_storage(int fd, const CigWorld *w,
+                                  const struct storage *storage,
+                                  struct byte_buffer *buffer) {
+  const struct storage_layout *layout = &storage->layout;
+  const uint64_t count = storage->count;
+
+  Vector spans;
+  struct snapshot_column *columns =
+      malloc((layout->count + 1) * sizeof(struct snapshot_column));
+  uint32_t *values = malloc(count * sizeof(uint32_t));
+  if (vector_init(&spans, sizeof(struct region_span))) {
+    free(values);
+    free(columns);
+    return EXIT_FAILURE;
+  }
+
+  int result = EXIT_FAILURE;
+  if (!columns || !values)
+    goto out;
+
+  for (LinkedListNode *node = storage->regions.first; node;
+       node = node->next) {
+    struct region *region = node->data;
+    if (region->count == 0)
+      continue;
+
+    if (!region->ptr) {
+      fprintf(stderr, "%s(): Can't snapshot a paged out zone.\n", __func__);
+      goto out;
+    }
+
+    struct region_span span = {.region = region, .count = region->count};
+    if (vector_append(&spans, &span))
+      goto out;
+  }
+
+  snapshot_columns(w, storage, columns);
+
+  // Reserve enough for the worst case so the section is written unchecked
+  size_t bound = sizeof(uint32_t) * (1 + 2 * layout->count) + sizeof(count);
+  for (size_t i = 0; i <= layout->count; i++)
+    bound += (sizeof(uint64_t) + column_encode_bound(count)) *
+             (columns[i].size / snapshot_lane_width(&columns[i]));
+
+  buffer->len = 0;
+  if (byte_buffer_reserve(buffer, bound))
+    goto out;
+
+  uint8_t *out = buffer->data;
+  const uint32_t type_count = layout->count;
+  out = snapshot_put(out, &type_count, sizeof(type_count));
+  for (size_t i = 0; i < layout->count; i++) {
+    const uint32_t type[2] = {layout->types[i].id, columns[i + 1].size};
+    out = snapshot_put(out, type, sizeof(type));
+  }
+  out = snapshot_put(out, &count, sizeof(count));
+
+  for (size_t i = 0; i <= layout->count; i++) {
+    const size_t lanes = columns[i].size / snapshot_lane_width(&columns[i]);
+    for (size_t lane = 0; lane < lanes; lane++) {
+      snapshot_lane(&spans, &columns[i], lane, values, 1);
+
+      const uint64_t size =
+          column_encode(values, count, out + sizeof(uint64_t));
+      out = snapshot_put(out, &size, sizeof(size)) + size;
+    }
+  }
+
+  result = write_all(fd, buffer->data, out - buffer->data);
+
+out:
+  vector_deinit(&spans);
+  free(values);
+  free(columns);
+  return result;
+}
+
+// The file starts with the magic "CIGS", a `uint32_t` version, a `uint32_t`
+// count of sections, the `uint64_t` next entity and a `uint64_t` count of
+// unassigned entities followed by them. A section is made of:
+//   uint32_t type count, for each type: uint32_t id and size
+//   uint64_t family count
+//   for the entity ids and then each type, for each lane:
+//     uint64_t size, followed by the encoded lane
+// All values are in native byte order.
+int cig_world_snapshot(const CigWorld *w, const char *path) {
+  assert(w != NULL);
+  assert(path != NULL);
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, path);
+    return EXIT_FAILURE;
+  }
+
+  uint32_t section_count = 0;
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it)))
+    if (((const struct storage *)kv->value)->count > 0)
+      section_count++;
+
+  const uint32_t version = 1;
+  const uint64_t header[2] = {w->next_entity, vector_len(&w->unassigned)};
+  int result = write_all(fd, (const uint8_t *)"CIGS", 4) ||
+               write_all(fd, (const uint8_t *)&version, sizeof(version)) ||
+               write_all(fd, (const uint8_t *)&section_count,
+                         sizeof(section_count)) ||
+               write_all(fd, (const uint8_t *)header, sizeof(header)) ||
+               write_all(fd, w->unassigned.data,
+                         sizeof(CigEntity) * header[1]);
+
+  struct byte_buffer buffer = {0};
+  it = hash_map_iter(&w->storages);
+  while (!result && (kv = hash_map_next(&it)))
+    if (((const struct storage *)kv->value)->count > 0)
+      result = snapshot_write_storage(fd, w, kv->value, &buffer);
+  free(buffer.data);
+
+  if (close(fd))
+    result = EXIT_FAILURE;
+
+  return result ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Points the entities whose ids were decoded into the families of `request` at
+// them, `restored` is set to how many were before any failure
+static int restore_entities(CigWorld *w, struct storage *storage,
+                            const struct storage_regions_request *request,
+                            size_t *restored) {
+  *restored = 0;
+  for (size_t k = 0; k < vector_len(&request->spans); k++) {
+    const struct region_span *span = vector_get_const(&request->spans, k);
+    const CigEntity *ids = region_entities(storage, span->region);
+
+    for (size_t j = span->index; j < span->index + span->count; j++) {
+      if (ids[j] >= vector_len(&w->entities))
+        return EXIT_FAILURE;
+
+      struct entity_internal *e = vector_get(&w->entities, ids[j]);
+      if (e->storage)
+        return EXIT_FAILURE;
+
+      *e = (struct entity_internal){
+          .storage = storage, .region = span->region, .index = j};
+      (*restored)++;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void restore_entities_undo(CigWorld *w, struct storage *storage,
+                                  const struct storage_regions_request *request,
+                                  size_t restored) {
+  for (size_t k = 0; k < vector_len(&request->spans) && restored > 0; k++) {
+    const struct region_span *span = vector_get_const(&request->spans, k);
+    const CigEntity *ids = region_entities(storage, span->region);
+
+    for (size_t j = span->index;
+         j < span->index + span->count && restored > 0; j++, restored--)
+      *(struct entity_internal *)vector_get(&w->entities, ids[j]) =
+          (struct entity_internal){0};
+  }
+}
+
+// `remaining` is how many entities are yet to be given a family, a section
+// can't hold more families than that
+static int restore_storage(CigWorld *w, struct import_reader *reader,
+                           size_t *remaining) {
+  uint32_t type_count;
+  if (journal_read(reader, &type_count, sizeof(type_count)) ||
+      type_count > vector_len(&w->types))
+    return EXIT_FAILURE;
+
+  uint32_t *ids = malloc(type_count * sizeof(uint32_t));
+  struct snapshot_column *columns =
+      malloc((type_count + 1) * sizeof(struct snapshot_column));
+  uint32_t *values = NULL;
+  if (!ids || !columns) {
+    free(columns);
+    free(ids);
+    return EXIT_FAILURE;
+  }
+
+  Bitset mask;
+  if (bitset_init(&mask, vector_len(&w->types))) {
+    free(columns);
+    free(ids);
+    return EXIT_FAILURE;
+  }
+
+  int mask_owned = 1;
+  int result = EXIT_FAILURE;
+  for (uint32_t i = 0; i < type_count; i++) {
+    uint32_t type[2];
+    if (journal_read(reader, type, sizeof(type)) ||
+        type[0] >= vector_len(&w->types) || bitset_has(&mask, type[0]) ||
+        type[1] != get_size(w, type[0]))
+      goto out;
+
+    bitset_incl(&mask, type[0]);
+    ids[i] = type[0];
+  }
+
+  uint64_t count;
+  if (journal_read(reader, &count, sizeof(count)) ||
+      count > SIZE_MAX / sizeof(uint32_t) || count > *remaining)
+    goto out;
+
+  // The storage takes ownership of the mask
+  mask_owned = 0;
+  struct storage *storage = get_storage(w, mask);
+  if (!storage)
+    goto out;
+
+  columns[0] = (struct snapshot_column){.size = sizeof(CigEntity),
+                                        .layout = &storage->layout,
+                                        .index = storage->layout.count};
+  for (uint32_t i = 0; i < type_count; i++)
+    columns[i + 1] =
+        (struct snapshot_column){.size = get_size(w, ids[i]),
+                                 .layout = &storage->layout,
+                                 .index = get_type_index(storage, ids[i])};
+
+  values = malloc(count * sizeof(uint32_t));
+  if (!values && count > 0)
+    goto out;
+
+  struct storage_regions_request request;
+  if (storage_request_regions(storage, &request, count, 0))
+    goto out;
+
+  for (uint32_t i = 0; i <= type_count; i++) {
+    const size_t lanes = columns[i].size / snapshot_lane_width(&columns[i]);
+    for (size_t lane = 0; lane < lanes; lane++) {
+      uint64_t size;
+      const uint8_t *data = NULL;
+      if (!journal_read(reader, &size, sizeof(size)))
+        data = import_read(reader, size);
+
+      if (!data || column_decode(data, size, values, count)) {
+        storage_regions_request_commit(&request, 0);
+        goto out;
+      }
+      snapshot_lane(&request.spans, &columns[i], lane, values, 0);
+    }
+  }
+
+  size_t restored;
+  if (restore_entities(w, storage, &request, &restored)) {
+    restore_entities_undo(w, storage, &request, restored);
+    storage_regions_request_commit(&request, 0);
+    goto out;
+  }
+
+  storage_regions_request_commit(&request, 1);
+  storage->count += count;
+  *remaining -= count;
+  result = EXIT_SUCCESS;
+
+out:
+  if (mask_owned)
+    bitset_deinit(&mask);
+  free(values);
+  free(columns);
+  free(ids);
+  return result;
+}
+
+// Restores a snapshot into a world without entities, that has the same types
+// registered. A failed restore keeps the sections restored before it.
+int cig_world_restore(CigWorld *w, const char *path) {
+  assert(w != NULL);
+  assert(path != NULL);
+
+  if (vector_len(&w->entities) > 0 || w->journal) {
+    fprintf(stderr, "%s(): Can only restore into an empty world.\n",
+            __func__);
+    return EXIT_FAILURE;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, path);
+    return EXIT_FAILURE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return EXIT_FAILURE;
+
+  struct import_reader reader = {.ptr = map, .end = map + st.st_size};
+
+  const char *magic = import_read(&reader, 4);
+  uint32_t header[2];
+  uint64_t entities[2];
+  if (!magic || memcmp(magic, "CIGS", 4) != 0 ||
+      journal_read(&reader, header, sizeof(header)) || header[0] != 1 ||
+      journal_read(&reader, entities, sizeof(entities))) {
+    fprintf(stderr, "%s(): (%s) is not a snapshot.\n", __func__, path);
+    munmap(map, st.st_size);
+    return EXIT_FAILURE;
+  }
+
+  // An id is either unassigned or belongs to a family, and as no two families
+  // share an id, each of them takes at least a bit of the file
+  const size_t bytes = reader.end - reader.ptr;
+  int result = EXIT_FAILURE;
+  if (entities[0] > SIZE_MAX / sizeof(struct entity_internal) ||
+      entities[1] > entities[0] || entities[1] > bytes / sizeof(CigEntity) ||
+      (entities[0] - entities[1]) / 8 >
+          bytes - entities[1] * sizeof(CigEntity)) {
+    fprintf(stderr, "%s(): (%s) has more entities than it can hold.\n",
+            __func__, path);
+    goto out;
+  }
+
+  if (vector_resize(&w->entities, entities[0]))
+    goto out;
+
+  struct entity_internal e = {0};
+  for (uint64_t i = 0; i < entities[0]; i++)
+    if (vector_append(&w->entities, &e))
+      goto out;
+  w->next_entity = entities[0];
+
+  for (uint64_t i = 0; i < entities[1]; i++) {
+    CigEntity id;
+    if (journal_read(&reader, &id, sizeof(id)) || id >= entities[0] ||
+        vector_append(&w->unassigned, &id))
+      goto out;
+  }
+
+  size_t remaining = entities[0] - entities[1];
+  result = EXIT_SUCCESS;
+  for (uint32_t i = 0; result == EXIT_SUCCESS && i < header[1]; i++)
+    if ((result = restore_storage(w, &reader, &remaining)))
+      fprintf(stderr, "%s(): Malformed section (%u).\n", __func__, i);
+
+out:
+  munmap(map, st.st_size);
+  return result;
+}
+
+// Registries are compatible when every type of `src` has the same id, size,
+// alignment and fields in `dst`, the storages of both then have identical
+// layouts
+static int is_same_registry(const CigWorld *dst, const CigWorld *src) {
+  if (vector_len(&src->types) > vector_len(&dst->types))
+    return 0;
+
+  const CigTypeDesc *a = dst->types.data;
+  const CigTypeDesc *b = src->types.data;
+  for (size_t i = 0; i < vector_len(&src->types); i++) {
+    if (strcmp(a[i].identifier, b[i].identifier) != 0 ||
+        a[i].size != b[i].size || a[i].alignment != b[i].alignment ||
+        a[i].field_count != b[i].field_count)
+      return 0;
+
+    // Fields decide how split types are laid out
+    for (size_t j = 0; j < a[i].field_count; j++)
+      if (a[i].fields[j].offset != b[i].fields[j].offset ||
+          a[i].fields[j].size != b[i].fields[j].size)
+        return 0;
+  }
+
+  return 1;
+}
+
+struct type_copy {
+  // The indices of the type in the source and destination layouts
+  size_t src, dest;
+  size_t size;
+};
+
+// A storage of the source world along with what was set aside in `dst` for it.
+// Everything that can fail is done while the steps are prepared, so that a
+// merge either moves every storage or leaves both worlds as they were.
+struct merge_step {
+  struct storage *src_storage, *storage;
+
+  // Spliced storages get a region prepended per region of the source, sharing
+  // its chunk, `regions[i]` takes over the `i`th region of the source
+  int spliced;
+  struct region **regions;
+  size_t region_count;
+
+  // Otherwise the families are copied into requested families
+  struct type_copy *copies;
+  struct storage_regions_request request;
+};
+
+// Prepends a region sharing the chunk of each region of `src_storage`. A chunk
+// that would still be shared once the source lets go of it, or that isn't from
+// the allocator of `storage`, is copied now so that the splice can't fail.
+static int storage_splice_prepare(struct merge_step *step) {
+  struct storage *storage = step->storage;
+
+  size_t count = 0;
+  for (LinkedListNode *node = step->src_storage->regions.first; node;
+       node = node->next)
+    count++;
+
+  step->regions = malloc(count * sizeof(struct region *));
+  if (!step->regions && count > 0)
+    return EXIT_FAILURE;
+
+  for (LinkedListNode *node = step->src_storage->regions.first; node;
+       node = node->next) {
+    struct region region = *(struct region *)node->data;
+    atomic_fetch_add(region.refs, 1);
+    if (linked_list_prepend(&storage->regions, &region,
+                            sizeof(struct region))) {
+      region_deinit(&region);
+      return EXIT_FAILURE;
+    }
+
+    struct region *prepended = storage->regions.first->data;
+    step->regions[step->region_count++] = prepended;
+
+    if ((atomic_load(region.refs) > 2 ||
+         chunk_segment(region.refs) != storage->segment) &&
+        region_make_unique(prepended, storage))
+      return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Moves the regions of `src_storage` into `storage` without copying any
+// families, only the entity ids stored in the regions are rewritten
+static void storage_splice(CigWorld *dst, const CigWorld *src,
+                           struct merge_step *step, CigEntity first) {
+  struct storage *storage = step->storage;
+
+  size_t k = 0;
+  LinkedListNode *node;
+  while ((node = linked_list_pop_first(&step->src_storage->regions))) {
+    const struct region *src_region = node->data;
+    struct region *region = step->regions[k++];
+
+    // The chunk is left to `storage` alone, which can't fail as
+    // `storage_splice_prepare()` copied the ones that would stay shared
+    region_deinit(node->data);
+    region_make_unique(region, storage);
+
+    CigEntity *ids = region_entities(storage, region);
+    for (size_t i = 0; i < region->count; i++) {
+      const struct entity_internal *e =
+          vector_get_const(&src->entities, ids[i]);
+      const int owned = e->region == src_region && e->index == i;
+
+      ids[i] += first;
+      if (owned)
+        *(struct entity_internal *)vector_get(&dst->entities, ids[i]) =
+            (struct entity_internal){
+                .storage = storage, .region = region, .index = i};
+    }
+
+    linked_list_node_deinit(node);
+  }
+
+  storage->count += step->src_storage->count;
+  step->src_storage->count = 0;
+}
+
+// Finds the storage of `dst` for the families of `src_storage`, types are
+// matched by their identifier, and requests room for them
+static int storage_merge_copy_prepare(CigWorld *dst, const CigWorld *src,
+                                      struct merge_step *step) {
+  const struct storage *src_storage = step->src_storage;
+  const size_t type_count = src_storage->layout.count;
+  step->copies = malloc(type_count * sizeof(struct type_copy));
+  if (!step->copies && type_count > 0)
+    return EXIT_FAILURE;
+
+  Bitset mask;
+  if (bitset_init(&mask, vector_len(&dst->types)))
+    return EXIT_FAILURE;
+
+  size_t n = 0;
+  for (size_t id = 0; bitset_next(&src_storage->mask, &id); id++) {
+    const CigTypeDesc *type = get_type(src, id);
+    const size_t dst_id = find_type(&dst->types, type->identifier);
+    if (dst_id == vector_len(&dst->types) ||
+        get_size(dst, dst_id) != type->size) {
+      fprintf(stderr,
+              "%s(): Type (%s) is not registered in the destination world.\n",
+              __func__, type->identifier);
+      bitset_deinit(&mask);
+      return EXIT_FAILURE;
+    }
+
+    bitset_incl(&mask, dst_id);
+    step->copies[n++] = (struct type_copy){
+        .src = get_type_index(src_storage, id), .size = type->size};
+  }
+
+  // The storage takes ownership of the mask
+  struct storage *storage = get_storage(dst, mask);
+  if (!storage)
+    return EXIT_FAILURE;
+
+  n = 0;
+  for (size_t id = 0; bitset_next(&src_storage->mask, &id); id++)
+    step->copies[n++].dest = get_type_index(
+        storage, find_type(&dst->types, get_type(src, id)->identifier));
+
+  // Every type of the families is copied, so they don't need zeroing
+  if (storage_request_regions(storage, &step->request, src_storage->count, 0))
+    return EXIT_FAILURE;
+
+  step->storage = storage;
+  return EXIT_SUCCESS;
+}
+
+// Copies the families of `src_storage` into the families requested for them
+static void storage_merge_copy(CigWorld *dst, const CigWorld *src,
+                               struct merge_step *step, CigEntity first) {
+  struct storage *src_storage = step->src_storage;
+  struct storage *storage = step->storage;
+  const size_t type_count = src_storage->layout.count;
+
+  size_t k = 0, j = 0;
+  for (LinkedListNode *node = src_storage->regions.first; node;
+       node = node->next) {
+    const struct region *src_region = node->data;
+
+    for (size_t i = 0; i < src_region->count; i++) {
+      if (!is_family_owned(src, src_storage, src_region, i))
+        continue;
+
+      const struct region_span *span = vector_get(&step->request.spans, k);
+      for (size_t t = 0; t < type_count; t++)
+        copy_type(span->region->ptr, &storage->layout, step->copies[t].dest,
+                  span->index + j, src_region->ptr, &src_storage->layout,
+                  step->copies[t].src, i, step->copies[t].size, 1);
+
+      const CigEntity id = region_entities(src_storage, src_region)[i] + first;
+      region_entities(storage, span->region)[span->index + j] = id;
+      *(struct entity_internal *)vector_get(&dst->entities, id) =
+          (struct entity_internal){.storage = storage,
+                                   .region = span->region,
+                                   .index = span->index + j};
+
+      if (++j == span->count) {
+        j = 0;
+        k++;
+      }
+    }
+  }
+
+  storage_regions_request_commit(&step->request, 1);
+  storage->count += src_storage->count;
+
+  // Keep the emptied regions around for the next batch built in `src`
+  LinkedListNode *node;
+  while ((node = linked_list_pop_first(&src_storage->regions))) {
+    storage_unassign_region(src_storage, node->data);
+    linked_list_node_deinit(node);
+  }
+  src_storage->count = 0;
+}
+
+// Gives back what was set aside for the step, `storage` is only set for copies
+// once their families were requested
+static void merge_step_cancel(struct merge_step *step) {
+  for (size_t i = 0; i < step->region_count; i++) {
+    LinkedListNode *node = linked_list_pop_first(&step->storage->regions);
+    region_deinit(node->data);
+    linked_list_node_deinit(node);
+  }
+
+  if (!step->spliced && step->storage)
+    storage_regions_request_commit(&step->request, 0);
+}
+
+static int merge_step_prepare(CigWorld *dst, const CigWorld *src,
+                              int same_registry, struct merge_step *step) {
+  if (!same_registry)
+    return storage_merge_copy_prepare(dst, src, step);
+
+  Bitset mask;
+  if (bitset_clone(&step->src_storage->mask, &mask))
+    return EXIT_FAILURE;
+
+  // The storage takes ownership of the mask
+  struct storage *storage = get_storage(dst, mask);
+  if (!storage)
+    return EXIT_FAILURE;
+
+  // Chunks can only be spliced between storages with the same layout
+  if (!layout_eql(&storage->layout, &step->src_storage->layout))
+    return storage_merge_copy_prepare(dst, src, step);
+
+  step->storage = storage;
+  step->spliced = 1;
+  return storage_splice_prepare(step);
+}
+
+int cig_world_merge(CigWorld *dst, CigWorld *src, CigEntity *first) {
+  assert(dst != NULL);
+  assert(src != NULL);
+
+  // Spliced chunks can't be described by the journal records
+  if (dst->journal) {
+    fprintf(stderr, "%s(): Can't merge into a world with a journal.\n",
+            __func__);
+    return EXIT_FAILURE;
+  }
+
+  // The ids of paged out families can't be read to move them into `dst`
+  HashMapIterator it = hash_map_iter(&src->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it)))
+    if (storage_is_paged_out(kv->value)) {
+      fprintf(stderr, "%s(): A storage of the source has paged out regions.\n",
+              __func__);
+      return EXIT_FAILURE;
+    }
+
+  const int same_registry = is_same_registry(dst, src);
+
+  // Every entity of `src` is offset by the next id of `dst`
+  const CigEntity offset = dst->next_entity;
+  const size_t count = vector_len(&src->entities);
+
+  // The unassigned ids of `src` stay unassigned in `dst`, the room for them is
+  // made up front so that they can't be lost after the families are moved
+  const size_t unassigned_len = vector_len(&src->unassigned);
+  if (vector_resize(&dst->unassigned,
+                    vector_len(&dst->unassigned) + unassigned_len))
+    return EXIT_FAILURE;
+
+  Vector steps;
+  if (vector_init(&steps, sizeof(struct merge_step)))
+    return EXIT_FAILURE;
+
+  const size_t entities_len = vector_len(&dst->entities);
+  if (vector_resize(&dst->entities, entities_len + count))
+    goto err;
+
+  struct entity_internal e = {0};
+  for (size_t i = 0; i < count; i++)
+    if (vector_append(&dst->entities, &e))
+      goto err;
+
+  it = hash_map_iter(&src->storages);
+  while ((kv = hash_map_next(&it))) {
+    struct merge_step step = {.src_storage = kv->value};
+    if (step.src_storage->count == 0)
+      continue;
+
+    const int failed = merge_step_prepare(dst, src, same_registry, &step);
+    if (failed || vector_append(&steps, &step)) {
+      merge_step_cancel(&step);
+      free(step.regions);
+      free(step.copies);
+      goto err;
+    }
+  }
+
+  // Nothing can fail from here on
+  struct merge_step *prepared = steps.data;
+  for (size_t i = 0; i < vector_len(&steps); i++) {
+    if (prepared[i].spliced)
+      storage_splice(dst, src, &prepared[i], offset);
+    else
+      storage_merge_copy(dst, src, &prepared[i], offset);
+
+    free(prepared[i].regions);
+    free(prepared[i].copies);
+  }
+  vector_deinit(&steps);
+  dst->next_entity += count;
+
+  const CigEntity *unassigned = src->unassigned.data;
+  for (size_t i = 0; i < unassigned_len; i++) {
+    const CigEntity id = unassigned[i] + offset;
+    vector_append(&dst->unassigned, &id);
+  }
+
+  // Leave `src` empty so it can be used to build the next batch
+  vector_resize(&src->entities, 0);
+  vector_resize(&src->unassigned, 0);
+  src->next_entity = 0;
+
+  if (first)
+    *first = offset;
+
+#ifdef DEBUG
+  printf("%s(): Merged (%zu) entities starting at (%zu).\n", __func__, count,
+         offset);
+#endif
+
+  return EXIT_SUCCESS;
+
+err:
+  // The steps are given back in reverse, `src` is left untouched and `dst` only
+  // keeps the empty storages that were created for them
+  prepared = steps.data;
+  for (size_t i = vector_len(&steps); i-- > 0;) {
+    merge_step_cancel(&prepared[i]);
+    free(prepared[i].regions);
+    free(prepared[i].copies);
+  }
+  vector_deinit(&steps);
+  vector_resize(&dst->entities, entities_len);
+  return EXIT_FAILURE;
+}
+
+// Transfers every byte described by `iov`, retrying short transfers
+static int transfer_all(int fd, struct iovec *iov, int count,
+                        ssize_t (*func)(int, const struct iovec *, int)) {
+  while (count > 0) {
+    ssize_t n = func(fd, iov, count);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return EXIT_FAILURE;
+
+    // Skip past everything that was transferred
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Streams the chunks of every page to or from `fd` in large sequential
+// transfers
+static int zone_transfer_pages(struct zone *zone, int fd,
+                               ssize_t (*func)(int, const struct iovec *,
+                                               int)) {
+  struct zone_page *pages = zone->pages.data;
+  struct iovec iov[STREAM_IOV_COUNT];
+
+  size_t i = 0;
+  while (i < vector_len(&zone->pages)) {
+    int count = 0;
+    for (; count < STREAM_IOV_COUNT && i < vector_len(&zone->pages); i++)
+      iov[count++] =
+          (struct iovec){.iov_base = pages[i].ptr, .iov_len = CHUNK_BYTE_SIZE};
+
+    if (transfer_all(fd, iov, count, func))
+      return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void *zone_page_out_thread(void *zone_ptr) {
+  struct zone *zone = zone_ptr;
+
+  int fd = open(zone->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  zone->failed = fd < 0 || zone_transfer_pages(zone, fd, writev);
+  if (fd >= 0 && close(fd))
+    zone->failed = 1;
+
+  // The chunks are only dropped once they are safely in the file, otherwise
+  // they are handed back to the regions
+  if (!zone->failed)
+    zone_release_pages(zone);
+
+  atomic_store(&zone->done, 1);
+  return NULL;
+}
+
+static void *zone_page_in_thread(void *zone_ptr) {
+  struct zone *zone = zone_ptr;
+  struct zone_page *pages = zone->pages.data;
+
+  zone->failed = 0;
+  for (size_t i = 0; i < vector_len(&zone->pages); i++)
+    if (chunk_alloc(pages[i].segment, pages[i].alignment, &pages[i].ptr,
+                    &pages[i].refs)) {
+      zone->failed = 1;
+      break;
+    }
+
+  int fd = -1;
+  if (!zone->failed) {
+    fd = open(zone->path, O_RDONLY);
+    zone->failed = fd < 0 || zone_transfer_pages(zone, fd, readv);
+  }
+  if (fd >= 0)
+    close(fd);
+
+  if (zone->failed)
+    zone_release_pages(zone);
+
+  atomic_store(&zone->done, 1);
+  return NULL;
+}
+
+static int zone_start(struct zone *zone, void *(*func)(void *)) {
+  atomic_store(&zone->done, 0);
+  if (pthread_create(&zone->thread, NULL, func, zone))
+    return EXIT_FAILURE;
+
+  zone->has_thread = 1;
+  return EXIT_SUCCESS;
+}
+
+// Waits for the zone's I/O to finish and applies the result
+static int zone_finish(struct zone *zone) {
+  if (!zone->has_thread)
+    return EXIT_SUCCESS;
+
+  pthread_join(zone->thread, NULL);
+  zone->has_thread = 0;
+
+  struct zone_page *pages = zone->pages.data;
+  const int reinstall = zone->state == CIG_ZONE_PAGING_OUT
+                            ? zone->failed
+                            : !zone->failed;
+  if (reinstall) {
+    for (size_t i = 0; i < vector_len(&zone->pages); i++) {
+      if (pages[i].segment)
+        shm_begin_write(pages[i].segment);
+      pages[i].region->ptr = pages[i].ptr;
+      pages[i].region->refs = pages[i].refs;
+    }
+    vector_resize(&zone->pages, 0);
+  }
+
+  zone->state = reinstall ? CIG_ZONE_RESIDENT : CIG_ZONE_PAGED_OUT;
+
+  if (zone->failed) {
+    fprintf(stderr, "%s(): Failed to page the zone (%s).\n", __func__,
+            zone->path);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static struct zone *find_zone(const CigWorld *w, int32_t id) {
+  struct zone *const *zones = w->zones.data;
+  for (size_t i = 0; i < vector_len(&w->zones); i++)
+    if (zones[i]->id == id)
+      return zones[i];
+
+  return NULL;
+}
+
+int cig_world_page_out(CigWorld *w, const char *zone_str, const char *path) {
+  assert(w != NULL);
+  assert(zone_str != NULL);
+  assert(path != NULL);
+
+  const int32_t id = get_id(w, zone_str);
+  if (id < 0)
+    return EXIT_FAILURE;
+
+  struct zone *zone = find_zone(w, id);
+  if (!zone) {
+    zone = calloc(1, sizeof(struct zone));
+    if (!zone)
+      return EXIT_FAILURE;
+
+    zone->id = id;
+    zone->state = CIG_ZONE_RESIDENT;
+    if (vector_init(&zone->pages, sizeof(struct zone_page)) ||
+        vector_append(&w->zones, &zone)) {
+      vector_deinit(&zone->pages);
+      free(zone);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (zone->state != CIG_ZONE_RESIDENT) {
+    fprintf(stderr, "%s(): Zone (%s) is not resident.\n", __func__, zone_str);
+    return EXIT_FAILURE;
+  }
+
+  char *zone_path = strdup(path);
+  if (!zone_path)
+    return EXIT_FAILURE;
+  free(zone->path);
+  zone->path = zone_path;
+
+  // Detach the chunks of every storage that is tagged with the zone, the
+  // regions stay in place so that the entity ids remain valid
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct storage *storage = kv->value;
+    if (!bitset_has(&storage->mask, id))
+      continue;
+
+    for (LinkedListNode *node = storage->regions.first; node;
+         node = node->next) {
+      struct region *region = node->data;
+      if (!region->ptr)
+        continue;
+
+      struct zone_page page = {.region = region,
+                               .ptr = region->ptr,
+                               .refs = region->refs,
+                               .alignment = storage->layout.alignment,
+                               .segment = storage->segment};
+      if (vector_append(&zone->pages, &page))
+        goto err;
+
+      if (storage->segment)
+        shm_begin_write(storage->segment);
+      region->ptr = NULL;
+      region->refs = NULL;
+    }
+  }
+
+  zone->state = CIG_ZONE_PAGING_OUT;
+  if (zone_start(zone, zone_page_out_thread))
+    goto err;
+
+#ifdef DEBUG
+  printf("%s(): Paging out (%zu) regions of zone (%s).\n", __func__,
+         vector_len(&zone->pages), zone_str);
+#endif
+
+  return EXIT_SUCCESS;
+
+err:;
+  struct zone_page *pages = zone->pages.data;
+  for (size_t i = 0; i < vector_len(&zone->pages); i++) {
+    pages[i].region->ptr = pages[i].ptr;
+    pages[i].region->refs = pages[i].refs;
+  }
+  vector_resize(&zone->pages, 0);
+  zone->state = CIG_ZONE_RESIDENT;
+
+  return EXIT_FAILURE;
+}
+
+int cig_world_page_in(CigWorld *w, const char *zone_str) {
+  assert(w != NULL);
+  assert(zone_str != NULL);
+
+  const int32_t id = get_id(w, zone_str);
+  struct zone *zone = id < 0 ? NULL : find_zone(w, id);
+  if (!zone) {
+    fprintf(stderr, "%s(): Zone (%s) was never paged out.\n", __func__,
+            zone_str);
+    return EXIT_FAILURE;
+  }
+
+  // The chunks have to be in the file before they can be read back
+  if (zone->state == CIG_ZONE_PAGING_OUT && zone_finish(zone))
+    return EXIT_FAILURE;
+
+  if (zone->state != CIG_ZONE_PAGED_OUT) {
+    fprintf(stderr, "%s(): Zone (%s) is not paged out.\n", __func__, zone_str);
+    return EXIT_FAILURE;
+  }
+
+  zone->state = CIG_ZONE_PAGING_IN;
+  if (zone_start(zone, zone_page_in_thread)) {
+    zone->state = CIG_ZONE_PAGED_OUT;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_poll_zones(CigWorld *w) {
+  assert(w != NULL);
+
+  int result = EXIT_SUCCESS;
+
+  struct zone **zones = w->zones.data;
+  for (size_t i = 0; i < vector_len(&w->zones); i++)
+    if (zones[i]->has_thread && atomic_load(&zones[i]->done) &&
+        zone_finish(zones[i]))
+      result = EXIT_FAILURE;
+
+  return result;
+}
+
+CigZoneState cig_world_zone_state(const CigWorld *w, const char *zone_str) {
+  assert(w != NULL);
+  assert(zone_str != NULL);
+
+  const int32_t id = get_id(w, zone_str);
+  const struct zone *zone = id < 0 ? NULL : find_zone(w, id);
+  return zone ? zone->state : CIG_ZONE_RESIDENT;
+}
+
+static void export_deinit(CigExport *export) {
+  struct export_section *sections = export->sections.data;
+  for (size_t i = 0; i < vector_len(&export->sections); i++) {
+    struct export_column *columns = sections[i].columns.data;
+    for (size_t j = 0; j < vector_len(&sections[i].columns); j++)
+      free((char *)columns[j].identifier);
+    vector_deinit(&sections[i].columns);
+
+    for (size_t j = 0; j < vector_len(&sections[i].regions); j++)
+      region_deinit(vector_get(&sections[i].regions, j));
+    vector_deinit(&sections[i].regions);
+  }
+  vector_deinit(&export->sections);
+
+  free(export->path);
+  free(export);
+}
+
+static int export_write(int fd, const void *data, size_t size) {
+  struct iovec iov = {.iov_base = (void *)data, .iov_len = size};
+  return transfer_all(fd, &iov, 1, writev);
+}
+
+// The file starts with the magic "CIGC", a `uint32_t` version and a `uint32_t`
+// count of sections, one section per storage. A section is made of:
+//   uint32_t column count, uint32_t chunk size, uint64_t region count
+//   for each column:
+//     uint32_t identifier length, the identifier without a terminator,
+//     uint64_t size, offset, stride, block width and block size
+//   for each region:
+//     uint64_t family count, followed by the raw chunk
+// The value of family `i` of a column is at `offset + block size * (i / block
+// width) + stride * (i % block width)`. Version 1 had no block width and size,
+// its families were packed. The entity ids are described by a column named
+// "entity". All values are in native byte order.
+static int export_write_section(int fd, const struct export_section *section) {
+  const uint32_t header[2] = {vector_len(&section->columns), CHUNK_BYTE_SIZE};
+  const uint64_t region_count = vector_len(&section->regions);
+  if (export_write(fd, header, sizeof(header)) ||
+      export_write(fd, &region_count, sizeof(region_count)))
+    return EXIT_FAILURE;
+
+  const struct export_column *columns = section->columns.data;
+  for (size_t i = 0; i < vector_len(&section->columns); i++) {
+    const uint32_t len = strlen(columns[i].identifier);
+    const struct column_layout *layout = &columns[i].layout;
+    const uint64_t desc[5] = {columns[i].size, layout->offset, layout->stride,
+                              layout->block_width, layout->block_size};
+    if (export_write(fd, &len, sizeof(len)) ||
+        export_write(fd, columns[i].identifier, len) ||
+        export_write(fd, desc, sizeof(desc)))
+      return EXIT_FAILURE;
+  }
+
+  // The chunks are written straight out, along with their family counts
+  const struct region *regions = section->regions.data;
+  struct iovec iov[STREAM_IOV_COUNT * 2];
+  uint64_t counts[STREAM_IOV_COUNT];
+
+  size_t i = 0;
+  while (i < region_count) {
+    int count = 0;
+    for (; count < STREAM_IOV_COUNT * 2 && i < region_count; i++) {
+      uint64_t *family_count = &counts[count / 2];
+      *family_count = regions[i].count;
+
+      iov[count++] = (struct iovec){.iov_base = family_count,
+                                    .iov_len = sizeof(uint64_t)};
+      iov[count++] = (struct iovec){.iov_base = regions[i].ptr,
+                                    .iov_len = CHUNK_BYTE_SIZE};
+    }
+
+    if (transfer_all(fd, iov, count, writev))
+      return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void *export_thread(void *export_ptr) {
+  CigExport *export = export_ptr;
+
+  int fd = open(export->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    export->failed = 1;
+    return NULL;
+  }
+
+  const uint32_t header[2] = {2, vector_len(&export->sections)};
+  export->failed = export_write(fd, "CIGC", 4) ||
+                   export_write(fd, header, sizeof(header));
+
+  const struct export_section *sections = export->sections.data;
+  for (size_t i = 0; !export->failed && i < vector_len(&export->sections); i++)
+    export->failed = export_write_section(fd, &sections[i]);
+
+  if (close(fd))
+    export->failed = 1;
+
+  return NULL;
+}
+
+static int export_add_column(struct export_section *section,
+                             const char *identifier, uint64_t size,
+                             struct column_layout layout) {
+  struct export_column column = {
+      .identifier = strdup(identifier), .size = size, .layout = layout};
+  if (!column.identifier)
+    return EXIT_FAILURE;
+
+  if (vector_append(&section->columns, &column)) {
+    free((char *)column.identifier);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Takes a reference to every chunk of the storage, the simulation then copies
+// a chunk before it writes to it, leaving the export with a stable snapshot
+static int export_add_storage(CigExport *export, const CigWorld *w,
+                              const struct storage *storage) {
+  struct export_section section = {0};
+  if (vector_init(&section.columns, sizeof(struct export_column)) ||
+      vector_init(&section.regions, sizeof(struct region)) ||
+      vector_append(&export->sections, &section)) {
+    vector_deinit(&section.columns);
+    vector_deinit(&section.regions);
+    return EXIT_FAILURE;
+  }
+
+  struct export_section *stored =
+      vector_get(&export->sections, vector_len(&export->sections) - 1);
+
+  const struct storage_layout *layout = &storage->layout;
+  for (size_t i = 0; i < layout->count; i++) {
+    const CigTypeDesc *type = get_type(w, layout->types[i].id);
+    if (layout->types[i].field_count == 0) {
+      if (export_add_column(stored, type->identifier, type->size,
+                            layout_column(layout, i)))
+        return EXIT_FAILURE;
+      continue;
+    }
+
+    // A split type has a column per field, named "type.field"
+    for (size_t j = 0; j < type->field_count; j++) {
+      char *identifier = get_field_name(type, j);
+      if (!identifier)
+        return EXIT_FAILURE;
+
+      size_t len;
+      const int failed = export_add_column(
+          stored, identifier, type->fields[j].size,
+          layout_bytes(layout, i, type->fields[j].offset, &len));
+      free(identifier);
+      if (failed)
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (export_add_column(stored, "entity", sizeof(CigEntity),
+                        layout_entities(layout)))
+    return EXIT_FAILURE;
+
+  for (LinkedListNode *node = storage->regions.first; node;
+       node = node->next) {
+    const struct region *region = node->data;
+    if (!region->ptr || region->count == 0)
+      continue;
+
+    if (vector_append(&stored->regions, region))
+      return EXIT_FAILURE;
+    atomic_fetch_add(region->refs, 1);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+CigExport *cig_world_export(const CigWorld *w, const char *requirements,
+                            const char *path) {
+  assert(w != NULL);
+  assert(requirements != NULL);
+  assert(path != NULL);
+
+  CigExport *result = calloc(1, sizeof(CigExport));
+  if (!result)
+    return NULL;
+
+  if (vector_init(&result->sections, sizeof(struct export_section)))
+    goto err;
+
+  result->path = strdup(path);
+  if (!result->path)
+    goto err;
+
+  struct query query;
+  if (query_init(w, &query, requirements))
+    goto err;
+
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    // Entities without components have nothing to export
+    const struct storage *storage = kv->value;
+    if (storage->layout.count == 0 ||
+        !is_match(storage->mask, query.must_have, query.must_not_have))
+      continue;
+
+    if (export_add_storage(result, w, storage)) {
+      query_deinit(&query);
+      goto err;
+    }
+  }
+
+  query_deinit(&query);
+
+  if (pthread_create(&result->thread, NULL, export_thread, result))
+    goto err;
+
+#ifdef DEBUG
+  printf("%s(): Exporting (%zu) storages to (%s).\n", __func__,
+         vector_len(&result->sections), path);
+#endif
+
+  return result;
+
+err:
+  export_deinit(result);
+  return NULL;
+}
+
+int cig_export_wait(CigExport *export) {
+  assert(export != NULL);
+
+  pthread_join(export->thread, NULL);
+
+  const int failed = export->failed;
+  if (failed)
+    fprintf(stderr, "%s(): Failed to export to (%s).\n", __func__,
+            export->path);
+
+  export_deinit(export);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// The entity when it has the type in a region that can be written to
+static const struct entity_internal *
+get_writable_entity(const CigWorld *w, const CigEntity e, int32_t id,
+                    const char *type_str) {
+  const struct entity_internal *e_internal = vector_get_const(&w->entities, e);
+  if (!e_internal->storage) {
+#ifdef DEBUG
+    fprintf(stderr, "%s(): Entity (%zu) contains no components.\n", __func__,
+            e);
+#endif
+    return NULL;
+  }
+
+  if (id < 0) {
+#ifdef DEBUG
+    fprintf(stderr,
+            "%s(): Attempted to get component from entity (%zu), there is no "
+            "type with the identifier (%s).\n",
+            __func__, e, type_str);
+#endif
+    return NULL;
+  }
+
+  if (!bitset_has(&e_internal->storage->mask, id)) {
+#ifdef DEBUG
+    fprintf(stderr, "%s(): Entity (%zu) does not have the component type (%s)",
+            __func__, e, type_str);
+#endif
+    return NULL;
+  }
+
+  if (!e_internal->region->ptr) {
+#ifdef DEBUG
+    fprintf(stderr, "%s(): Entity (%zu) is paged out.\n", __func__, e);
+#endif
+    return NULL;
+  }
+
+  // The caller may write to the component, so the region can no longer be
+  // shared with a forked world
+  if (region_make_unique(e_internal->region, e_internal->storage))
+    return NULL;
+
+  return e_internal;
+}
+
+void *cig_world_get_component(const CigWorld *w, const CigEntity e,
+                              const char *type_str) {
+  assert(w != NULL);
+  assert(type_str != NULL);
+
+  int32_t field;
+  const int32_t id = get_field_id(w, type_str, &field);
+  const struct entity_internal *e_internal =
+      get_writable_entity(w, e, id, type_str);
+  if (!e_internal)
+    return NULL;
+
+  const struct storage_layout *layout = &e_internal->storage->layout;
+  const size_t index = get_type_index(e_internal->storage, id);
+  // The fields of a split type are apart, only they can be pointed to
+  if (field < 0 && layout->types[index].field_count > 0) {
+#ifdef DEBUG
+    fprintf(stderr, "%s(): The type (%s) is split into its fields.\n",
+            __func__, type_str);
+#endif
+    return NULL;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Returning pointer to component type (%s) belonging to entity "
+         "(%zu).\n",
+         __func__, type_str, e);
+#endif
+
+  size_t len;
+  const struct column_layout column = layout_bytes(
+      layout, index, field < 0 ? 0 : get_type(w, id)->fields[field].offset,
+      &len);
+  return e_internal->region->ptr + column_at(&column, e_internal->index);
+}
+
+int cig_world_set_component(CigWorld *w, const CigEntity e,
+                            const char *type_str, const void *data) {
+  assert(w != NULL);
+  assert(data != NULL);
+
+  const int32_t id = get_id(w, type_str);
+  const struct entity_internal *e_internal =
+      get_writable_entity(w, e, id, type_str);
+  if (!e_internal)
+    return EXIT_FAILURE;
+
+  const struct storage_layout *layout = &e_internal->storage->layout;
+  const size_t index = get_type_index(e_internal->storage, id);
+  const size_t size = get_size(w, id);
+
+  // A split type is written a field at a time
+  for (size_t offset = 0, len; offset < size; offset += len) {
+    const struct column_layout column =
+        layout_bytes(layout, index, offset, &len);
+    if (len > size - offset)
+      len = size - offset;
+    memcpy(e_internal->region->ptr + column_at(&column, e_internal->index),
+           (const uint8_t *)data + offset, len);
+  }
+
+  if (w->journal) {
+    const uint64_t e64 = e;
+    const uint32_t id32 = id;
+    journal_begin(w->journal, JOURNAL_SET, sizeof(e64) + sizeof(id32) + size);
+    journal_append(w->journal, &e64, sizeof(e64));
+    journal_append(w->journal, &id32, sizeof(id32));
+    journal_append(w->journal, data, size);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void task_run(struct task *task);
+
+static void task_start(struct task *task) {
+  if (task->graph->pool)
+    thread_pool_submit(task->graph->pool, &task->batch);
+  else
+    task_run(task);
+}
+
+// Starts the task once the last of its dependencies has finished
+static void task_release(struct task *task) {
+  if (atomic_fetch_sub(&task->pending, 1) == 1)
+    task_start(task);
+}
+
+static void tasks_release(const Vector *tasks) {
+  struct task *const *data = tasks->data;
+  for (size_t i = 0; i < vector_len(tasks); i++)
+    task_release(data[i]);
+}
+
+static void task_run(struct task *task) {
+  task->func(task->user_data);
+
+  tasks_release(&task->dependents);
+  atomic_fetch_sub(&task->graph->left, 1);
+}
+
+static void task_batch_run(void *task_ptr, size_t index, size_t slot) {
+  task_run(task_ptr);
+}
+
+// Starts the tasks that don't depend on anything
+static void tasks_begin(struct task_graph *graph, struct thread_pool *pool) {
+  struct task **tasks = graph->tasks.data;
+  const size_t count = vector_len(&graph->tasks);
+
+  graph->pool = pool;
+  atomic_store(&graph->left, count);
+  for (size_t i = 0; i < count; i++)
+    atomic_store(&tasks[i]->pending, tasks[i]->dependency_count);
+
+  for (size_t i = 0; i < count; i++)
+    if (tasks[i]->dependency_count == 0)
+      task_start(tasks[i]);
+}
+
+static void tasks_end(struct task_graph *graph) {
+  if (!graph->pool)
+    return;
+
+  thread_pool_wait(graph->pool, &graph->left);
+
+  // A worker can still be releasing the batch of a task that has finished
+  struct task **tasks = graph->tasks.data;
+  for (size_t i = 0; i < vector_len(&graph->tasks); i++)
+    thread_pool_batch_wait(&tasks[i]->batch);
+}
+
+// Adds the task as a dependent of each system and task in `after`
+static int task_add_dependencies(CigWorld *w, struct task *task,
+                                 const char *after) {
+  size_t count;
+  char **identifiers = tokenize(after, &count);
+  if (!identifiers && count > 0)
+    return EXIT_FAILURE;
+
+  int result = EXIT_SUCCESS;
+  for (size_t i = 0; i < count; i++) {
+    struct system *system = hash_map_get_value(&w->systems, &identifiers[i]);
+    struct task *before = find_task(w, identifiers[i]);
+    Vector *dependents = system ? &system->tasks
+                                : before ? &before->dependents : NULL;
+    if (!dependents) {
+      fprintf(stderr,
+              "%s(): There is no system or task registered with the "
+              "identifier (%s) to run after.\n",
+              __func__, identifiers[i]);
+      result = EXIT_FAILURE;
+      break;
+    }
+
+    if (system && system->extract) {
+      fprintf(stderr,
+              "%s(): Tasks can't run after the extraction system (%s).\n",
+              __func__, identifiers[i]);
+      result = EXIT_FAILURE;
+      break;
+    }
+
+    if (vector_append(dependents, &task)) {
+      result = EXIT_FAILURE;
+      break;
+    }
+    task->dependency_count++;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    free(identifiers[i]);
+  free(identifiers);
+
+  return result;
+}
+
+// A task that failed to register is at the end of the dependents it was added
+// to
+static void dependents_remove(Vector *dependents, const struct task *task) {
+  size_t len = vector_len(dependents);
+  while (len > 0 && *(struct task **)vector_get(dependents, len - 1) == task)
+    len--;
+  vector_resize(dependents, len);
+}
+
+static void task_remove_dependencies(CigWorld *w, const struct task *task) {
+  HashMapIterator it = hash_map_iter(&w->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it)))
+    dependents_remove(&((struct system *)kv->value)->tasks, task);
+
+  struct task **tasks = w->tasks->tasks.data;
+  for (size_t i = 0; i < vector_len(&w->tasks->tasks); i++)
+    dependents_remove(&tasks[i]->dependents, task);
+}
+
+int cig_world_register_task(CigWorld *w, CigTaskDesc *desc) {
+  assert(w != NULL);
+  assert(desc != NULL);
+  assert(desc->identifier != NULL);
+  assert(desc->func != NULL);
+
+  if (hash_map_has(&w->systems, &desc->identifier) ||
+      find_task(w, desc->identifier)) {
+    fprintf(stderr,
+            "%s(): A system or task with the identifier (%s) is already "
+            "registered.\n",
+            __func__, desc->identifier);
+    return EXIT_FAILURE;
+  }
+
+  if (!w->tasks) {
+    w->tasks = calloc(1, sizeof(struct task_graph));
+    if (!w->tasks || vector_init(&w->tasks->tasks, sizeof(struct task *))) {
+      free(w->tasks);
+      w->tasks = NULL;
+      return EXIT_FAILURE;
+    }
+  }
+
+  struct task *task = calloc(1, sizeof(struct task));
+  if (!task)
+    return EXIT_FAILURE;
+
+  task->identifier = strdup(desc->identifier);
+  task->after = desc->after ? strdup(desc->after) : NULL;
+  if (!task->identifier || (desc->after && !task->after) ||
+      vector_init(&task->dependents, sizeof(struct task *))) {
+    task_deinit(task);
+    return EXIT_FAILURE;
+  }
+
+  task->func = desc->func;
+  task->user_data = desc->user_data;
+  task->graph = w->tasks;
+  task->batch = (struct thread_pool_batch){
+      .func = task_batch_run, .arg = task, .count = 1};
+
+  // Dependencies have to be registered first, so there can't be a cycle
+  if (desc->after && task_add_dependencies(w, task, desc->after)) {
+    task_remove_dependencies(w, task);
+    task_deinit(task);
+    return EXIT_FAILURE;
+  }
+
+  if (vector_append(&w->tasks->tasks, &task)) {
+    task_remove_dependencies(w, task);
+    task_deinit(task);
+    return EXIT_FAILURE;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Task registered (%s).\n", __func__, desc->identifier);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_run(const CigWorld *w, const char *identifier,
+                  double delta_time) {
+  assert(w != NULL);
+  assert(identifier != NULL);
+
+  const struct system *system = hash_map_get_value(&w->systems, &identifier);
+  if (!system) {
+    fprintf(stderr,
+            "%s(): There is no system registered with the identifier (%s).\n",
+            __func__, identifier);
+    return EXIT_FAILURE;
+  }
+
+  if (world_match_storages(w))
+    return EXIT_FAILURE;
+
+#ifdef DEBUG
+  printf("%s(): Running system (%s).\n", __func__, identifier);
+#endif
+
+  return system_run(w, system, 0, delta_time);
+}
+
+int cig_world_set_threads(CigWorld *w, size_t count, const int *cpus) {
+  assert(w != NULL);
+
+  if (w->pipeline && count <= 1) {
+    fprintf(stderr, "%s(): A pipelined world needs workers.\n", __func__);
+    return EXIT_FAILURE;
+  }
+
+  // The counters only follow the calling thread
+  if (w->counters && count > 1) {
+    fprintf(stderr, "%s(): Workers can't be used while counters are enabled.\n",
+            __func__);
+    return EXIT_FAILURE;
+  }
+  cig_world_wait_extraction(w);
+
+  struct thread_pool *pool = NULL;
+  if (count > 1 && !(pool = thread_pool_init(count - 1, cpus)))
+    return EXIT_FAILURE;
+
+  // Every thread needs its own accumulator, they are only ever added so that
+  // a failure part way leaves enough for the old pool
+  const size_t slots = world_slots(w, pool);
+  HashMapIterator it = hash_map_iter(&w->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    struct system *system = kv->value;
+    if (system->accumulators && system->accumulator_count < slots &&
+        system_reduction_init(system, &system->reduction, slots)) {
+      thread_pool_deinit(pool);
+      return EXIT_FAILURE;
+    }
+  }
+
+  thread_pool_deinit(w->pool);
+  w->pool = pool;
+
+#ifdef DEBUG
+  printf("%s(): Running systems on (%zu) threads.\n", __func__, slots);
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_set_deterministic(CigWorld *w, int enable) {
+  assert(w != NULL);
+
+  cig_world_wait_extraction(w);
+
+  const int was_deterministic = w->deterministic;
+  w->deterministic = enable;
+
+  // Every part of a storage needs its own accumulator
+  const size_t slots = world_slots(w, w->pool);
+  HashMapIterator it = hash_map_iter(&w->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    struct system *system = kv->value;
+    if (system->accumulators && system->accumulator_count < slots &&
+        system_reduction_init(system, &system->reduction, slots)) {
+      w->deterministic = was_deterministic;
+      return EXIT_FAILURE;
+    }
+  }
+
+#ifdef DEBUG
+  printf("%s(): Deterministic steps %s.\n", __func__,
+         enable ? "enabled" : "disabled");
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_enable_counters(CigWorld *w, int enable) {
+  assert(w != NULL);
+
+  if (!enable && w->counters) {
+    perf_counters_close(w->counters);
+    free(w->counters);
+    w->counters = NULL;
+  }
+
+  if (!enable || w->counters)
+    return EXIT_SUCCESS;
+
+  // The counters follow the calling thread, the work done on the workers of
+  // `cig_world_set_threads()` would be missing from the stats
+  if (w->pool) {
+    fprintf(stderr, "%s(): Counters can't be enabled with workers.\n",
+            __func__);
+    return EXIT_FAILURE;
+  }
+
+  struct perf_counters *counters = malloc(sizeof(struct perf_counters));
+  if (!counters || perf_counters_open(counters)) {
+    free(counters);
+    return EXIT_FAILURE;
+  }
+
+  w->counters = counters;
+  return EXIT_SUCCESS;
+}
+
+static void pipeline_wait(const CigWorld *w, struct pipeline *pipeline);
+
+// The run of an extraction system may still be writing its stats, latency and
+// reduction on a worker
+static void system_wait_extraction(const CigWorld *w,
+                                   const struct system *system) {
+  if (system->extract && w->pipeline)
+    pipeline_wait(w, w->pipeline);
+}
+
+int cig_world_get_system_stats(const CigWorld *w, const char *identifier,
+                               CigSystemStats *result) {
+  assert(w != NULL);
+  assert(identifier != NULL);
+  assert(result != NULL);
+
+  const struct system *system = hash_map_get_value(&w->systems, &identifier);
+  if (!system) {
+    fprintf(stderr, "%s(): No system with the identifier (%s).\n", __func__,
+            identifier);
+    return EXIT_FAILURE;
+  }
+
+  system_wait_extraction(w, system);
+  *result = *system->stats;
+  return EXIT_SUCCESS;
+}
+
+static void get_latency(const struct histogram *histogram,
+                        CigLatency *result) {
+  *result = (CigLatency){
+      .count = histogram_count(histogram),
+      .p50 = histogram_percentile(histogram, 50.0),
+      .p99 = histogram_percentile(histogram, 99.0),
+      .p999 = histogram_percentile(histogram, 99.9),
+      .max = histogram_percentile(histogram, 100.0)};
+}
+
+void cig_world_get_step_latency(const CigWorld *w, CigLatency *result) {
+  assert(w != NULL);
+  assert(result != NULL);
+  get_latency(w->step_latency, result);
+}
+
+int cig_world_get_system_latency(const CigWorld *w, const char *identifier,
+                                 CigLatency *result) {
+  assert(w != NULL);
+  assert(identifier != NULL);
+  assert(result != NULL);
+
+  const struct system *system = hash_map_get_value(&w->systems, &identifier);
+  if (!system) {
+    fprintf(stderr, "%s(): No system with the identifier (%s).\n", __func__,
+            identifier);
+    return EXIT_FAILURE;
+  }
+
+  system_wait_extraction(w, system);
+  get_latency(system->latency, result);
+  return EXIT_SUCCESS;
+}
+
+void cig_world_reset_latency(CigWorld *w) {
+  assert(w != NULL);
+
+  cig_world_wait_extraction(w);
+
+  histogram_reset(w->step_latency);
+
+  HashMapIterator it = hash_map_iter(&w->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it)))
+    histogram_reset(((const struct system *)kv->value)->latency);
+}
+
+static double per(uint64_t value, uint64_t count) {
+  return count ? (double)value / count : 0.0;
+}
+
+void cig_world_print_system_stats(const CigWorld *w) {
+  assert(w != NULL);
+
+  if (w->pipeline)
+    pipeline_wait(w, w->pipeline);
+
+  printf("%-24s %10s %14s %10s %8s %14s %14s\n", "system", "runs",
+         "entities/run", "cycles/e", "ipc", "cache miss/e", "branch miss/e");
+
+  HashMapIterator it = hash_map_iter(&w->systems);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct system *system = kv->value;
+    const CigSystemStats *stats = system->stats;
+    if (system->fused)
+      continue;
+
+    printf("%-24s %10llu %14.1f %10.2f %8.2f %14.4f %14.4f\n",
+           system->identifier, (unsigned long long)stats->runs,
+           per(stats->families, stats->runs),
+           per(stats->cycles, stats->families),
+           per(stats->instructions, stats->cycles),
+           per(stats->cache_misses, stats->families),
+           per(stats->branch_misses, stats->families));
+  }
+}
+
+const void *cig_world_get_reduction(const CigWorld *w,
+                                    const char *identifier) {
+  assert(w != NULL);
+  assert(identifier != NULL);
+
+  const struct system *system = hash_map_get_value(&w->systems, &identifier);
+  if (!system) {
+    fprintf(stderr,
+            "%s(): There is no system registered with the identifier (%s).\n",
+            __func__, identifier);
+    return NULL;
+  }
+
+  system_wait_extraction(w, system);
+  return system->reduction_result;
+}
+
+size_t cig_query_count(const CigWorld *w, const char *requirements) {
+  assert(w != NULL);
+  assert(requirements != NULL);
+
+  struct query query;
+  if (query_init(w, &query, requirements))
+    return 0;
+
+  // Only the cached counts are read, none of the regions are touched
+  size_t result = 0;
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct storage *storage = kv->value;
+    if (is_match(storage->mask, query.must_have, query.must_not_have))
+      result += storage->count;
+  }
+
+  query_deinit(&query);
+
+  return result;
+}
+
+static struct field_index *find_index(const CigWorld *w,
+                                      const char *identifier) {
+  struct field_index **indexes = w->indexes.data;
+  for (size_t i = 0; i < vector_len(&w->indexes); i++)
+    if (!strcmp(indexes[i]->identifier, identifier))
+      return indexes[i];
+  return NULL;
+}
+
+static size_t key_size(CigKeyKind kind) {
+  switch (kind) {
+  case CIG_KEY_INT32:
+  case CIG_KEY_UINT32:
+  case CIG_KEY_FLOAT:
+    return sizeof(uint32_t);
+  case CIG_KEY_INT64:
+  case CIG_KEY_UINT64:
+  case CIG_KEY_DOUBLE:
+    return sizeof(uint64_t);
+  }
+  return 0;
+}
+
+// Maps the value to a key with the same order when compared as unsigned
+static uint64_t index_key(CigKeyKind kind, const void *value) {
+  switch (kind) {
+  case CIG_KEY_INT32: {
+    int32_t v;
+    memcpy(&v, value, sizeof(v));
+    return (uint64_t)(int64_t)v ^ (UINT64_C(1) << 63);
+  }
+  case CIG_KEY_INT64: {
+    int64_t v;
+    memcpy(&v, value, sizeof(v));
+    return (uint64_t)v ^ (UINT64_C(1) << 63);
+  }
+  case CIG_KEY_UINT32: {
+    uint32_t v;
+    memcpy(&v, value, sizeof(v));
+    return v;
+  }
+  case CIG_KEY_UINT64: {
+    uint64_t v;
+    memcpy(&v, value, sizeof(v));
+    return v;
+  }
+  case CIG_KEY_FLOAT:
+  case CIG_KEY_DOUBLE:
+    break;
+  }
+
+  double v;
+  if (kind == CIG_KEY_FLOAT) {
+    float f;
+    memcpy(&f, value, sizeof(f));
+    v = f;
+  } else {
+    memcpy(&v, value, sizeof(v));
+  }
+
+  // Negative zero is ordered as zero, negative values have every bit flipped
+  // so that larger magnitudes come first
+  if (v == 0.0)
+    v = 0.0;
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits >> 63 ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+static int index_entry_cmp(const void *a_ptr, const void *b_ptr) {
+  const struct index_entry *a = a_ptr;
+  const struct index_entry *b = b_ptr;
+  if (a->key != b->key)
+    return a->key < b->key ? -1 : 1;
+  return (a->entity > b->entity) - (a->entity < b->entity);
+}
+
+// The first entry of the run with a key of at least `key`
+static size_t index_lower_bound(const Vector *run, uint64_t key) {
+  const struct index_entry *entries = run->data;
+  size_t low = 0, high = vector_len(run);
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (entries[mid].key < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// Whether the entry is the entity's current one and the entity still has the
+// component
+static int index_entry_live(const CigWorld *w, const struct field_index *index,
+                            const struct index_entry *entry) {
+  const struct index_record *record =
+      vector_get_const(&index->records, entry->entity);
+  if (record->sequence != entry->sequence)
+    return 0;
+
+  const struct entity_internal *e =
+      vector_get_const(&w->entities, entry->entity);
+  return e->storage && bitset_has(&e->storage->mask, index->id);
+}
+
+// Merges the recent run into the entries, leaving out every entry that isn't
+// current anymore
+static int field_index_merge(const CigWorld *w, struct field_index *index) {
+  Vector merged;
+  if (vector_init(&merged, sizeof(struct index_entry)))
+    return EXIT_FAILURE;
+
+  const struct index_entry *a = index->entries.data;
+  const struct index_entry *b = index->recent.data;
+  size_t i = 0, j = 0;
+  const size_t a_len = vector_len(&index->entries);
+  const size_t b_len = vector_len(&index->recent);
+  while (i < a_len || j < b_len) {
+    const struct index_entry *entry =
+        j == b_len || (i < a_len && index_entry_cmp(&a[i], &b[j]) < 0)
+            ? &a[i++]
+            : &b[j++];
+
+    if (index_entry_live(w, index, entry)) {
+      if (vector_append(&merged, entry)) {
+        vector_deinit(&merged);
+        return EXIT_FAILURE;
+      }
+    } else if (((struct index_record *)vector_get(&index->records,
+                                                  entry->entity))
+                   ->sequence == entry->sequence) {
+      // The entity is added again once it has the component back
+      *(struct index_record *)vector_get(&index->records, entry->entity) =
+          (struct index_record){0};
+    }
+  }
+
+  vector_deinit(&index->entries);
+  index->entries = merged;
+  vector_resize(&index->recent, 0);
+  return EXIT_SUCCESS;
+}
+
+// Reads the keys of the regions written to since the last refresh, the ones
+// that changed are added to the recent run with a new sequence
+static int field_index_refresh(const CigWorld *w, struct field_index *index) {
+  const uint64_t now = atomic_fetch_add(&change_clock, 1);
+
+  const struct index_record none = {0};
+  while (vector_len(&index->records) < vector_len(&w->entities))
+    if (vector_append(&index->records, &none))
+      return EXIT_FAILURE;
+
+  const size_t recent = vector_len(&index->recent);
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct storage *storage = kv->value;
+    if (!bitset_has(&storage->mask, index->id))
+      continue;
+
+    size_t len;
+    const struct column_layout column =
+        layout_bytes(&storage->layout, get_type_index(storage, index->id),
+                     index->offset, &len);
+
+    for (const LinkedListNode *node = storage->regions.first; node;
+         node = node->next) {
+      const struct region *region = node->data;
+      if (!region->ptr || region->changed < index->seen)
+        continue;
+
+      const CigEntity *ids = region_entities(storage, region);
+      for (size_t i = 0; i < region->count; i++) {
+        if (!is_family_owned(w, storage, region, i))
+          continue;
+
+        const uint64_t key =
+            index_key(index->kind, region->ptr + column_at(&column, i));
+        struct index_record *record = vector_get(&index->records, ids[i]);
+        if (record->sequence && record->key == key)
+          continue;
+
+        const struct index_entry entry = {key, ids[i], ++index->sequence};
+        if (vector_append(&index->recent, &entry))
+          return EXIT_FAILURE;
+        *record = (struct index_record){key, entry.sequence};
+      }
+    }
+  }
+
+  if (vector_len(&index->recent) > recent)
+    qsort(index->recent.data, vector_len(&index->recent),
+          sizeof(struct index_entry), index_entry_cmp);
+
+  // The recent run is kept small enough to be cheap to sort and search
+  if (vector_len(&index->recent) * 8 > vector_len(&index->entries) &&
+      field_index_merge(w, index))
+    return EXIT_FAILURE;
+
+  index->seen = now + 1;
+  return EXIT_SUCCESS;
+}
+
+int cig_world_register_index(CigWorld *w, CigIndexDesc *desc) {
+  assert(w != NULL);
+  assert(desc != NULL);
+  assert(desc->identifier != NULL);
+  assert(desc->field != NULL);
+
+  if (find_index(w, desc->identifier)) {
+    fprintf(stderr,
+            "%s(): An index with the identifier (%s) is already registered.\n",
+            __func__, desc->identifier);
+    return EXIT_FAILURE;
+  }
+
+  int32_t field;
+  const int32_t id = get_field_id(w, desc->field, &field);
+  if (id < 0) {
+    fprintf(stderr, "%s(): There is no type or field (%s).\n", __func__,
+            desc->field);
+    return EXIT_FAILURE;
+  }
+
+  size_t offset;
+  if (field_offset(w, id, field, desc->field, &offset))
+    return EXIT_FAILURE;
+
+  const CigTypeDesc *type = get_type(w, id);
+  const size_t size = field < 0 ? type->size : type->fields[field].size;
+  if (size != key_size(desc->kind)) {
+    fprintf(stderr, "%s(): The key is not the size of (%s).\n", __func__,
+            desc->field);
+    return EXIT_FAILURE;
+  }
+
+  struct field_index *index = calloc(1, sizeof(struct field_index));
+  if (!index)
+    return EXIT_FAILURE;
+
+  index->identifier = strdup(desc->identifier);
+  index->field = strdup(desc->field);
+  index->id = id;
+  index->offset = offset;
+  index->kind = desc->kind;
+  if (!index->identifier || !index->field ||
+      vector_init(&index->entries, sizeof(struct index_entry)) ||
+      vector_init(&index->recent, sizeof(struct index_entry)) ||
+      vector_init(&index->records, sizeof(struct index_record)) ||
+      field_index_refresh(w, index) ||
+      vector_append(&w->indexes, &index)) {
+    field_index_deinit(index);
+    return EXIT_FAILURE;
+  }
+
+#ifdef DEBUG
+  printf("%s(): Index (%s) registered with (%zu) entities.\n", __func__,
+         desc->identifier, vector_len(&index->entries));
+#endif
+
+  return EXIT_SUCCESS;
+}
+
+int cig_world_index_range(const CigWorld *w, const char *identifier,
+                          const void *min, const void *max,
+                          CigIndexRange *range) {
+  assert(w != NULL);
+  assert(identifier != NULL);
+  assert(range != NULL);
+
+  struct field_index *index = find_index(w, identifier);
+  if (!index) {
+    fprintf(stderr,
+            "%s(): There is no index registered with the identifier (%s).\n",
+            __func__, identifier);
+    return EXIT_FAILURE;
+  }
+
+  if (field_index_refresh(w, index))
+    return EXIT_FAILURE;
+
+  const uint64_t low = min ? index_key(index->kind, min) : 0;
+  *range = (CigIndexRange){
+      .w = w,
+      .index = index,
+      .next = {index_lower_bound(&index->entries, low),
+               index_lower_bound(&index->recent, low)},
+      .max = max ? index_key(index->kind, max) : UINT64_MAX};
+
+  return EXIT_SUCCESS;
+}
+
+int cig_index_next(CigIndexRange *range, CigEntity *e, void **component) {
+  assert(range != NULL);
+  assert(e != NULL);
+
+  const struct field_index *index = range->index;
+  const Vector *runs[] = {&index->entries, &index->recent};
+  while (1) {
+    // The lower of the next entries of both runs
+    const struct index_entry *next = NULL;
+    size_t run = 0;
+    for (size_t i = 0; i < 2; i++) {
+      if (range->next[i] >= vector_len(runs[i]))
+        continue;
+
+      const struct index_entry *entry =
+          vector_get_const(runs[i], range->next[i]);
+      if (entry->key <= range->max &&
+          (!next || index_entry_cmp(entry, next) < 0)) {
+        next = entry;
+        run = i;
+      }
+    }
+
+    if (!next)
+      return 0;
+
+    range->next[run]++;
+    if (!index_entry_live(range->w, index, next))
+      continue;
+
+    // Paged out entities keep their entries until they are paged back in
+    const struct entity_internal *internal =
+        vector_get_const(&range->w->entities, next->entity);
+    if (!internal->region->ptr)
+      continue;
+
+    *e = next->entity;
+    if (component)
+      *component = cig_world_get_component(range->w, *e, index->field);
+    return 1;
+  }
+}
+
+struct shm_directory {
+  uint64_t *ptr, *end;
+};
+
+// Words past the end are counted but not written
+static void shm_put(struct shm_directory *directory, uint64_t value) {
+  if (directory->ptr < directory->end)
+    *directory->ptr = value;
+  directory->ptr++;
+}
+
+static void shm_put_string(struct shm_directory *directory, const char *str) {
+  const size_t len = strlen(str);
+  shm_put(directory, len);
+  for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    memcpy(&word, str + i, len - i < sizeof(word) ? len - i : sizeof(word));
+    shm_put(directory, word);
+  }
+}
+
+static void shm_put_column(struct shm_directory *directory,
+                           struct column_layout column) {
+  shm_put(directory, column.offset);
+  shm_put(directory, column.stride);
+  shm_put(directory, column.block_width);
+  shm_put(directory, column.block_size);
+}
+
+// The entry of the first field of the type, after "entity" the fields of
+// every type are listed in order
+static size_t shm_first_field(const CigWorld *w, int32_t id) {
+  size_t result = vector_len(&w->types) + 1;
+  for (int32_t i = 0; i < id; i++)
+    result += get_type(w, i)->field_count;
+  return result;
+}
+
+static void shm_put_storage(struct shm_directory *directory,
+                            const CigWorld *w, const struct storage *storage) {
+  const struct storage_layout *layout = &storage->layout;
+  size_t column_count = layout->count + 1;
+  for (size_t i = 0; i < layout->count; i++)
+    column_count += get_type(w, layout->types[i].id)->field_count -
+                    (layout->types[i].field_count > 0);
+  shm_put(directory, column_count);
+
+  for (size_t i = 0; i < layout->count; i++) {
+    const CigTypeDesc *type = get_type(w, layout->types[i].id);
+    // A split type can only be read a field at a time
+    if (layout->types[i].field_count == 0) {
+      shm_put(directory, layout->types[i].id);
+      shm_put_column(directory, layout_column(layout, i));
+    }
+
+    const size_t first = shm_first_field(w, layout->types[i].id);
+    for (size_t j = 0; j < type->field_count; j++) {
+      size_t len;
+      shm_put(directory, first + j);
+      shm_put_column(directory,
+                     layout_bytes(layout, i, type->fields[j].offset, &len));
+    }
+  }
+
+  // The entity ids are described as the type after the registered ones
+  shm_put(directory, vector_len(&w->types));
+  shm_put_column(directory, layout_entities(layout));
+
+  uint64_t *region_count = directory->ptr;
+  uint64_t n = 0;
+  shm_put(directory, 0);
+  for (LinkedListNode *node = storage->regions.first; node;
+       node = node->next) {
+    const struct region *region = node->data;
+    if (!region->ptr || region->count == 0 ||
+        chunk_segment(region->refs) != w->shm)
+      continue;
+
+    shm_put(directory, (uint8_t *)region->ptr - (uint8_t *)w->shm->ptr);
+    shm_put(directory, region->count);
+    n++;
+  }
+
+  if (region_count < directory->end)
+    *region_count = n;
+}
+
+// Writes the directory of storages into the segment and ends the write. The
+// directory is made of `uint64_t` words:
+//   type count, for each type: size, identifier length, the identifier padded
+//   to whole words. The registered types are followed by "entity" and then
+//   by every field as "type.field".
+//   storage count, for each storage:
+//     column count, for each column: type, offset, stride, block width and
+//     block size, see `struct column_layout`
+//     region count, for each region: chunk offset and family count
+static int shm_publish(const CigWorld *w) {
+  struct shm_segment *segment = w->shm;
+  struct shm_header *header = segment->header;
+
+  // Nothing was written since the last publish
+  const uint_least64_t sequence = atomic_load(&header->sequence);
+  if (!(sequence & 1))
+    return EXIT_SUCCESS;
+
+  uint64_t *start = segment->ptr + header->directory_offset;
+  struct shm_directory directory = {
+      .ptr = start,
+      .end = start + header->directory_capacity / sizeof(uint64_t)};
+
+  const CigTypeDesc *types = w->types.data;
+  const size_t type_count = vector_len(&w->types);
+  shm_put(&directory, shm_first_field(w, type_count));
+  for (size_t i = 0; i < type_count; i++) {
+    shm_put(&directory, types[i].size);
+    shm_put_string(&directory, types[i].identifier);
+  }
+  shm_put(&directory, sizeof(CigEntity));
+  shm_put_string(&directory, "entity");
+
+  for (size_t i = 0; i < type_count; i++)
+    for (size_t j = 0; j < types[i].field_count; j++) {
+      char *identifier = get_field_name(&types[i], j);
+      if (!identifier)
+        return EXIT_FAILURE;
+      shm_put(&directory, types[i].fields[j].size);
+      shm_put_string(&directory, identifier);
+      free(identifier);
+    }
+
+  uint64_t *storage_count = directory.ptr;
+  uint64_t n = 0;
+  shm_put(&directory, 0);
 
-int cig_world_register_system(CigWorld *w, CigSystemDesc *desc) {
-  struct system system;
-  if (system_init(w, &system, desc))
-    return EXIT_FAILURE;
+  HashMapIterator it = hash_map_iter(&w->storages);
+  const HashMapKV *kv;
+  while ((kv = hash_map_next(&it))) {
+    const struct storage *storage = kv->value;
+    if (storage->count == 0)
+      continue;
 
-  if (hash_map_put(&w->systems, &system.identifier, &system)) {
-    system_deinit(&system);
-    return EXIT_FAILURE;
+    shm_put_storage(&directory, w, storage);
+    n++;
   }
 
-  if (system_find_matches(w, &system)) {
-    hash_map_delete(&w->systems, &system.identifier);
-    system_deinit(&system);
+  if (directory.ptr > directory.end) {
+    fprintf(stderr, "%s(): The directory of (%s) is full.\n", __func__,
+            segment->name);
     return EXIT_FAILURE;
   }
 
+  *storage_count = n;
+  header->directory_size = (directory.ptr - start) * sizeof(uint64_t);
+  atomic_store(&header->sequence, sequence + 1);
+
 #ifdef DEBUG
-  printf("%s(): System registered (%s).\n", __func__, desc->identifier);
+  printf("%s(): Published (%zu) storages to (%s).\n", __func__, (size_t)n,
+         segment->name);
 #endif
 
   return EXIT_SUCCESS;
 }
 
-static int generate_entity_mask(Bitset *mask, const char *type,
-                                const char *token, int32_t id, void *e) {
-  if (strcmp(token, type) == 0) {
-    bitset_incl(mask, id);
-    return EXIT_SUCCESS;
-  }
-
-  return EXIT_FAILURE;
+int cig_world_publish(CigWorld *w) {
+  assert(w != NULL);
+  return w->shm ? shm_publish(w) : EXIT_SUCCESS;
 }
 
-static size_t get_offset(const CigWorld *w, struct storage *storage,
-                         int32_t id) {
-  // Iterate the storage's layout to find the id
-  for (int32_t i = 0; i < storage->layout.count; i++)
-    if (id == storage->layout.types[i].id)
-      return storage->layout.types[i].offset;
+static void extract_section_deinit(struct extract_section *section) {
+  for (size_t i = 0; i < vector_len(&section->regions); i++)
+    region_deinit(vector_get(&section->regions, i));
+  vector_deinit(&section->regions);
+  free(section->strides);
+  free(section->offsets);
+}
 
-#ifdef DEBUG
-  fprintf(stderr, "%s(): Storage does not contain a type with the ID (%i).\n",
-          __func__, id);
-#endif
-  return -1;
+static void pipeline_release(struct pipeline *pipeline) {
+  struct extract_job *jobs = pipeline->jobs.data;
+  for (size_t i = 0; i < vector_len(&pipeline->jobs); i++) {
+    struct extract_section *sections = jobs[i].sections.data;
+    for (size_t j = 0; j < vector_len(&jobs[i].sections); j++)
+      extract_section_deinit(&sections[j]);
+    vector_deinit(&jobs[i].sections);
+  }
+  vector_resize(&pipeline->jobs, 0);
 }
 
-static int assign_regions(CigWorld *w, struct storage *storage, Bitset mask,
-                          size_t count) {
-  struct storage_regions_request request;
-  if (storage_request_regions(storage, &request, count))
+// Takes a reference to every chunk the system reads, the next step then
+// copies a chunk before it writes to it
+static int extract_job_freeze(const CigWorld *w, struct extract_job *job) {
+  const struct system *system = job->system;
+
+  // Contains `const HashMapKV *`, the storages matched with the system
+  Vector storages;
+  if (system_storages(w, system, &storages))
     return EXIT_FAILURE;
 
-  size_t i = 0;
-  for (size_t k = 0; k < vector_len(&request.regions); k++) {
-    struct region *region = vector_get(&request.regions, k);
+  const HashMapKV **kvs = storages.data;
+  for (size_t i = 0; i < vector_len(&storages); i++) {
+    struct storage *storage = *(struct storage **)kvs[i]->key;
+
+    struct extract_section section = {.storage = storage};
+    section.offsets = calloc(system->types_len, sizeof(size_t));
+    section.strides = calloc(system->types_len, sizeof(size_t));
+    if (((!section.offsets || !section.strides) && system->types_len > 0) ||
+        vector_init(&section.regions, sizeof(struct region))) {
+      free(section.strides);
+      free(section.offsets);
+      goto err;
+    }
 
-    size_t j = 0;
-    while (j < region->count) {
-      struct entity_internal *e = vector_get(&w->entities, w->last_spawned[i]);
+    set_offsets(w, system, storage, section.offsets, section.strides);
 
-      // Check if the entity has existing storage, this means that there may be
-      // types that need to be moved into the new storage
-      if (e->storage) {
-        struct storage *old_storage = e->storage;
+    for (LinkedListNode *node = storage->regions.first; node;
+         node = node->next) {
+      const struct region *region = node->data;
+      if (!region->ptr || region->count == 0 ||
+          !system_wants_region(system, storage, region))
+        continue;
 
-        // Get the intersection between the old and new storage masks
-        Bitset intersection;
-        if (bitset_intersect(&old_storage->mask, &storage->mask, &intersection))
-          goto err;
+      if (vector_append(&section.regions, region)) {
+        extract_section_deinit(&section);
+        goto err;
+      }
+      atomic_fetch_add(region->refs, 1);
+    }
 
-        // For each of the intersecting types, copy the type from the old
-        // storage to the new storage
-        for (size_t id = 0; bitset_next(&intersection, &id); id++) {
-          void *src = e->ptr + get_offset(w, old_storage, id);
-          void *dest = e->ptr + get_offset(w, storage, id);
+    if (vector_append(&job->sections, &section)) {
+      extract_section_deinit(&section);
+      goto err;
+    }
+  }
 
-          // Get the size of the type to copy
-          size_t size = get_size(w, id);
-          memcpy(src, dest, size);
-        }
+  vector_deinit(&storages);
+  return EXIT_SUCCESS;
 
-        bitset_deinit(&intersection);
-      }
+err:
+  vector_deinit(&storages);
+  return EXIT_FAILURE;
+}
 
-      // Assign the entities new components and storage pointers
-      size_t offset = j * storage->layout.family_size;
+static void extract_job_run(void *pipeline_ptr, size_t index, size_t slot) {
+  struct pipeline *pipeline = pipeline_ptr;
+  struct extract_job *job = vector_get(&pipeline->jobs, index);
+  const struct system *system = job->system;
+
+  const uint64_t start = now_ns();
+  size_t families = 0;
+  if (system->accumulators)
+    system_reduction_begin(system);
+
+  CigSystemCtx ctx =
+      (CigSystemCtx){.user_data = system->user_data,
+                     .accumulator = system_get_accumulator(system, slot)};
+  const struct extract_section *sections = job->sections.data;
+  for (size_t i = 0; i < vector_len(&job->sections); i++) {
+    ctx.offsets = sections[i].offsets;
+    ctx.strides = sections[i].strides;
+    const struct region *regions = sections[i].regions.data;
+    for (size_t j = 0; j < vector_len(&sections[i].regions); j++) {
+      ctx.group = regions[j].group;
+      system_run_families(system, &ctx, sections[i].storage, &regions[j],
+                          pipeline->delta_time);
+      families += regions[j].count;
+    }
+  }
 
-      e->ptr = region->ptr + offset;
-      e->storage = storage;
+  system_reduction_end(system);
+  histogram_record(system->latency, now_ns() - start);
+  system->stats->runs++;
+  system->stats->families += families;
 
-      i++;
-      j++;
+  atomic_fetch_sub(&pipeline->left, 1);
+}
+
+// Freezes what the extraction systems read and hands them to the workers
+static int pipeline_start(const CigWorld *w, struct pipeline *pipeline,
+                          double delta_time) {
+  struct system **systems = w->system_order.data;
+  for (size_t i = 0; i < vector_len(&w->system_order); i++) {
+    struct system *system = systems[i];
+    if (!system->extract)
+      continue;
+
+    struct extract_job job = {.system = system};
+    if (vector_init(&job.sections, sizeof(struct extract_section)))
+      goto err;
+    if (vector_append(&pipeline->jobs, &job)) {
+      vector_deinit(&job.sections);
+      goto err;
     }
+
+    if (extract_job_freeze(
+            w, vector_get(&pipeline->jobs, vector_len(&pipeline->jobs) - 1)))
+      goto err;
   }
 
-  storage_regions_request_commit(&request, 1);
+  pipeline->delta_time = delta_time;
+  pipeline->batch = (struct thread_pool_batch){
+      .func = extract_job_run,
+      .arg = pipeline,
+      .count = vector_len(&pipeline->jobs)};
+  atomic_store(&pipeline->left, pipeline->batch.count);
+  pipeline->running = 1;
+  thread_pool_submit(w->pool, &pipeline->batch);
+
   return EXIT_SUCCESS;
 
 err:
-  storage_regions_request_commit(&request, 0);
+  pipeline_release(pipeline);
   return EXIT_FAILURE;
 }
 
-const CigEntity *cig_world_spawn(CigWorld *w, size_t count,
-                                 const char *types_str) {
-  assert(w != NULL);
-  assert(types_str != NULL);
+static void pipeline_wait(const CigWorld *w, struct pipeline *pipeline) {
+  if (!pipeline->running)
+    return;
 
-  size_t types_count = count_char(types_str, ',') + 1;
+  thread_pool_wait(w->pool, &pipeline->left);
+  thread_pool_batch_wait(&pipeline->batch);
+  pipeline->running = 0;
 
-  CigEntity *result = realloc(w->last_spawned, sizeof(CigEntity) * count);
-  if (!result)
-    return NULL;
+  pipeline_release(pipeline);
+}
 
-  Bitset mask;
-  if (bitset_init(&mask, types_count))
-    goto err;
+// Runs the extraction systems straight away on the chunks of the step
+static int world_extract(const CigWorld *w, double delta_time) {
+  struct system **systems = w->system_order.data;
+  for (size_t i = 0; i < vector_len(&w->system_order); i++)
+    if (systems[i]->extract && system_run(w, systems[i], 0, delta_time))
+      return EXIT_FAILURE;
 
-  if (populate_mask(w, &mask, generate_entity_mask, types_str, NULL))
-    goto err;
+  return EXIT_SUCCESS;
+}
 
-  struct storage *storage = get_storage(w, mask);
-  if (!storage)
-    goto err;
+static int world_step(const CigWorld *w, double delta_time) {
+  // Before the tasks are handed to the workers, the matching runs on them too
+  if (world_match_storages(w))
+    return EXIT_FAILURE;
 
-  const size_t unassigned_count = vector_len(&w->unassigned);
-  size_t new_unassigned_count = unassigned_count;
+  if (w->tasks)
+    tasks_begin(w->tasks, w->pool);
 
-  // `i` is used to keep track of how many entities we have sorted out
-  size_t i = 0;
-  // Take as many entities as possible from world->recycled first
-  while (new_unassigned_count > 0)
-    result[i++] =
-        *((CigEntity *)vector_get(&w->unassigned, --new_unassigned_count));
+  int result = EXIT_SUCCESS;
+  struct system **systems = w->system_order.data;
+  for (size_t i = 0; i < vector_len(&w->system_order); i++) {
+    const struct system *system = systems[i];
 
-  // Make space for the new entities
-  if (vector_resize(&w->entities, vector_len(&w->entities) + (count - i)))
-    goto err;
+    // Fused systems are run by the head of their chain, extraction systems
+    // after the others
+    if (system->fused || system->extract)
+      continue;
 
-  struct entity_internal e = {0};
-  while (i < count) {
-    vector_append(&w->entities, &e);
-    // Make sure `next_entity` is iterated
-    result[i++] = w->next_entity++;
+#ifdef DEBUG
+    printf("%s(): Running system (%s).\n", __func__, system->identifier);
+#endif
+
+    // After a failure the systems are skipped, but the tasks still run so that
+    // none are left behind in the pool
+    if (!result && system_run(w, system, 1, delta_time))
+      result = EXIT_FAILURE;
+
+    if (w->tasks)
+      for (const struct system *s = system; s; s = s->fused_next)
+        tasks_release(&s->tasks);
   }
 
-  w->last_spawned = result;
+  if (w->tasks)
+    tasks_end(w->tasks);
+  if (result)
+    return EXIT_FAILURE;
 
-  // How many did we take from recycled
-  size_t recycled_count = unassigned_count - new_unassigned_count;
-  size_t new_count = count - recycled_count;
-  if (assign_regions(w, storage, mask, count)) {
-    // Reset everything back to what it was before.
-    vector_resize(&w->entities, vector_len(&w->entities) - new_count);
-    w->next_entity -= new_count;
-    goto err;
+  // The last extraction is done with its chunks by the time this step's are
+  // frozen, so there are never more than two copies of a chunk
+  if (w->pipeline) {
+    pipeline_wait(w, w->pipeline);
+    if (pipeline_start(w, w->pipeline, delta_time))
+      return EXIT_FAILURE;
+  } else if (world_extract(w, delta_time)) {
+    return EXIT_FAILURE;
   }
 
-  // If we took anything from recycled then be sure to shrink it down to it's
-  // new capacity
-  if (recycled_count > 0)
-    vector_resize(&w->unassigned, new_unassigned_count);
+  // The end of the frame is a group commit of its journal records, a record
+  // that couldn't be buffered or written fails the step
+  if (w->journal) {
+    journal_commit(w->journal);
+    if (w->journal->failed) {
+      fprintf(stderr, "%s(): The journal has failed.\n", __func__);
+      return EXIT_FAILURE;
+    }
+  }
 
-#ifdef DEBUG
-  printf("%s(): Spawned (%zu) entities with types [%s].\nRecycled: %zu\nNew: "
-         "%zu\n",
-         __func__, count, types_str, recycled_count, new_count);
-#endif
-  return w->last_spawned;
+  // And what readers of a shared world see
+  if (w->shm && shm_publish(w))
+    return EXIT_FAILURE;
 
-err:
-  bitset_deinit(&mask);
-  free(result);
+  return EXIT_SUCCESS;
+}
 
-  return NULL;
+int cig_world_step(const CigWorld *w, double delta_time) {
+  assert(w != NULL);
+
+  CIG_PROBE1(step_begin, w);
+  const uint64_t start = now_ns();
+  const int result = world_step(w, delta_time);
+  histogram_record(w->step_latency, now_ns() - start);
+  CIG_PROBE2(step_end, w, result);
+
+  return result;
 }
 
-void *cig_world_get_component(const CigWorld *w, const CigEntity e,
-                              const char *type_str) {
+int cig_world_set_pipelined(CigWorld *w, int enable) {
   assert(w != NULL);
-  assert(type_str != NULL);
 
-  const struct entity_internal *e_internal = vector_get_const(&w->entities, e);
-  if (!e_internal->ptr) {
-#ifdef DEBUG
-    fprintf(stderr, "%s(): Entity (%zu) contains no components.\n", __func__,
-            e);
-#endif
-    return NULL;
+  if (!enable) {
+    if (w->pipeline) {
+      pipeline_wait(w, w->pipeline);
+      vector_deinit(&w->pipeline->jobs);
+      free(w->pipeline);
+      w->pipeline = NULL;
+    }
+    return EXIT_SUCCESS;
   }
 
-  // If the entity has components, there should also be a storage
-  assert(e_internal->storage != NULL);
+  if (w->pipeline)
+    return EXIT_SUCCESS;
 
-  const int32_t id = get_id(w, type_str);
-  if (id < 0) {
-#ifdef DEBUG
+  if (!w->pool) {
     fprintf(stderr,
-            "%s(): Attempted to get component from entity (%zu), there is no "
-            "type with the identifier (%s).\n",
-            __func__, e, type_str);
-#endif
+            "%s(): Pipelining needs workers to extract on, see "
+            "cig_world_set_threads().\n",
+            __func__);
+    return EXIT_FAILURE;
+  }
+
+  w->pipeline = calloc(1, sizeof(struct pipeline));
+  if (!w->pipeline ||
+      vector_init(&w->pipeline->jobs, sizeof(struct extract_job))) {
+    free(w->pipeline);
+    w->pipeline = NULL;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+void cig_world_wait_extraction(CigWorld *w) {
+  assert(w != NULL);
+
+  if (w->pipeline)
+    pipeline_wait(w, w->pipeline);
+}
+
+typedef struct CigSharedView {
+  const uint8_t *ptr;
+  size_t size;
+} CigSharedView;
+
+CigSharedView *cig_shared_open(const char *name) {
+  assert(name != NULL);
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    fprintf(stderr, "%s(): Failed to open (%s).\n", __func__, name);
     return NULL;
   }
 
-  if (!bitset_has(&e_internal->storage->mask, id)) {
-#ifdef DEBUG
-    fprintf(stderr, "%s(): Entity (%zu) does not have the component type (%s)",
-            __func__, e, type_str);
-#endif
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct shm_header)) {
+    close(fd);
     return NULL;
   }
 
-  const size_t offset = get_offset(w, e_internal->storage, id);
-  if (offset == -1)
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
     return NULL;
 
-#ifdef DEBUG
-  printf("%s(): Returning pointer to component type (%s) belonging to entity "
-         "(%zu).\n",
-         __func__, type_str, e);
-#endif
+  const struct shm_header *header = map;
+  CigSharedView *result = malloc(sizeof(CigSharedView));
+  if (!result || memcmp(header->magic, "CIGM", 4) != 0 ||
+      header->version != 2) {
+    fprintf(stderr, "%s(): (%s) is not a shared world.\n", __func__, name);
+    munmap(map, st.st_size);
+    free(result);
+    return NULL;
+  }
 
-  return e_internal->ptr + offset;
+  *result = (CigSharedView){.ptr = map, .size = st.st_size};
+  return result;
 }
 
-int cig_world_run(const CigWorld *w, const char *identifier,
-                  double delta_time) {
-  assert(w != NULL);
-  assert(identifier != NULL);
+void cig_shared_close(CigSharedView *view) {
+  if (view == NULL)
+    return;
 
-  const struct system *system = hash_map_get_value(&w->systems, &identifier);
-  if (!system) {
-    fprintf(stderr,
-            "%s(): There is no system registered with the identifier (%s).\n",
-            __func__, identifier);
-    return EXIT_FAILURE;
-  }
+  munmap((void *)view->ptr, view->size);
+  free(view);
+}
 
-#ifdef DEBUG
-  printf("%s(): Running system (%s).\n", __func__, identifier);
-#endif
+static atomic_uint_least64_t *shared_sequence(const CigSharedView *view) {
+  return &((struct shm_header *)view->ptr)->sequence;
+}
 
-  return system_run(system, delta_time);
+uint64_t cig_shared_begin(const CigSharedView *view) {
+  assert(view != NULL);
+  return atomic_load_explicit(shared_sequence(view), memory_order_acquire);
 }
 
-int cig_world_step(const CigWorld *w, double delta_time) {
-  assert(w != NULL);
+int cig_shared_validate(const CigSharedView *view, uint64_t sequence) {
+  assert(view != NULL);
 
-  HashMapIterator it = hash_map_iter(&w->systems);
-  HashMapKV *kv;
-  while ((kv = hash_map_next(&it))) {
-#ifdef DEBUG
-    printf("%s(): Running system (%s).\n", __func__, *(char **)kv->key);
-#endif
+  // Order the reads of the components before the second load
+  atomic_thread_fence(memory_order_acquire);
+  return !(sequence & 1) &&
+         atomic_load_explicit(shared_sequence(view), memory_order_relaxed) ==
+             sequence;
+}
 
-    if (system_run(kv->value, delta_time))
-      return EXIT_FAILURE;
+// The directory may be rewritten while it is read, everything is bounds checked
+// and the reader throws the result away unless it validates
+size_t cig_shared_runs(const CigSharedView *view, const char *type,
+                       CigSharedRun *runs, size_t capacity) {
+  assert(view != NULL);
+  assert(type != NULL);
+  assert(runs != NULL || capacity == 0);
+
+  const struct shm_header *header = (const struct shm_header *)view->ptr;
+  const uint64_t offset = header->directory_offset;
+  const uint64_t size = header->directory_size;
+  if (offset > view->size || size > view->size - offset)
+    return 0;
+
+  struct import_reader reader = {.ptr = view->ptr + offset,
+                                 .end = view->ptr + offset + size};
+
+  uint64_t type_count, match = UINT64_MAX, match_size = 0;
+  if (journal_read(&reader, &type_count, sizeof(type_count)))
+    return 0;
+
+  const size_t len = strlen(type);
+  for (uint64_t i = 0; i < type_count; i++) {
+    uint64_t desc[2];
+    if (journal_read(&reader, desc, sizeof(desc)) || desc[1] > size)
+      return 0;
+
+    const char *identifier = import_read(&reader, round_up(desc[1], 8));
+    if (!identifier)
+      return 0;
+
+    if (desc[1] == len && memcmp(identifier, type, len) == 0) {
+      match = i;
+      match_size = desc[0];
+    }
   }
 
-  return EXIT_SUCCESS;
+  uint64_t storage_count;
+  if (match == UINT64_MAX ||
+      journal_read(&reader, &storage_count, sizeof(storage_count)))
+    return 0;
+
+  size_t result = 0;
+  for (uint64_t i = 0; i < storage_count; i++) {
+    uint64_t column_count, column[5], found[5] = {0}, region_count;
+    int has = 0;
+    if (journal_read(&reader, &column_count, sizeof(column_count)))
+      return 0;
+
+    for (uint64_t j = 0; j < column_count; j++) {
+      if (journal_read(&reader, column, sizeof(column)))
+        return 0;
+      if (column[0] == match) {
+        memcpy(found, column, sizeof(found));
+        has = 1;
+      }
+    }
+
+    if (journal_read(&reader, &region_count, sizeof(region_count)))
+      return 0;
+
+    // Packed families are a single run per region, otherwise a run per block
+    const struct column_layout layout = {.offset = found[1],
+                                         .stride = found[2],
+                                         .block_width = found[3],
+                                         .block_size = found[4]};
+    if (has && (layout.block_width == 0 || layout.block_width > view->size ||
+                layout.offset > view->size || layout.stride > view->size ||
+                layout.block_size > view->size))
+      return 0;
+
+    for (uint64_t j = 0; j < region_count; j++) {
+      uint64_t region[2];
+      if (journal_read(&reader, region, sizeof(region)))
+        return 0;
+      if (!has || region[1] == 0)
+        continue;
+      if (region[0] > view->size || region[1] > view->size)
+        return 0;
+
+      for (uint64_t k = 0, n; k < region[1]; k += n) {
+        size_t stride;
+        n = column_run(&layout, k, region[1] - k, &stride);
+
+        // The last component of the run has to be inside the segment
+        const uint64_t first = region[0] + column_at(&layout, k);
+        if (first > view->size ||
+            stride * (n - 1) + match_size > view->size - first)
+          return 0;
+
+        if (result < capacity)
+          runs[result] = (CigSharedRun){
+              .data = view->ptr + first, .count = n, .stride = stride};
+        result++;
+      }
+    }
+  }
+
+  return result;
 }
 
 void *cig_system_get_component(const CigSystemCtx *ctx, size_t idx) {
   assert(ctx != NULL);
-  return ctx->ptr + ctx->offsets[idx];
+
+  // Only the first of each is written, so the workers share the cache line
+  if (ctx->touched) {
+    const uint_least64_t bit = (uint_least64_t)1 << (idx < 63 ? idx : 63);
+    if (!(atomic_load_explicit(ctx->touched, memory_order_relaxed) & bit))
+      atomic_fetch_or_explicit(ctx->touched, bit, memory_order_relaxed);
+  }
+
+  return ctx->ptr + ctx->offsets[idx] + ctx->strides[idx] * ctx->lane;
 }
 
 void *cig_system_get_user_data(const CigSystemCtx *ctx) {
   return ctx->user_data;
 }
+
+void *cig_system_get_accumulator(const CigSystemCtx *ctx) {
+  assert(ctx != NULL);
+  return ctx->accumulator;
+}
+
+uint64_t cig_system_get_group(const CigSystemCtx *ctx) {
+  assert(ctx != NULL);
+  return ctx->group;
+}
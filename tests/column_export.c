@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void read_exact(FILE *f, void *dest, size_t size) {
+  assert(fread(dest, 1, size, f) == size);
+}
+
+// Where the value of family `i` is in a chunk
+static uint64_t column_at(const uint64_t *desc, uint64_t i) {
+  return desc[1] + desc[4] * (i / desc[3]) + desc[2] * (i % desc[3]);
+}
+
+int main() {
+  const char *path = "column_export.bin";
+
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc double_desc = {"double", sizeof(double), _Alignof(double)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &double_desc));
+
+  // Merging into a world with another registry copies the families and keeps
+  // the emptied regions, they are then reused with fewer families than they
+  // held
+  CigWorld *merged = cig_world_init();
+  assert(merged != NULL);
+  assert(!cig_world_register_type(merged, &double_desc));
+  assert(!cig_world_register_type(merged, &int_desc));
+
+  const CigEntity *e = cig_world_spawn(w, 3000, "int, double");
+  assert(e != NULL);
+  for (size_t i = 0; i < 3000; i++) {
+    *(int *)cig_world_get_component(w, e[i], "int") = -1;
+    *(double *)cig_world_get_component(w, e[i], "double") = -1.0;
+  }
+  assert(!cig_world_merge(merged, w, NULL));
+  cig_world_deinit(merged);
+
+  const size_t count = 1000;
+  e = cig_world_spawn(w, count, "int, double");
+  assert(e != NULL);
+  for (size_t i = 0; i < count; i++) {
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)e[i];
+    *(double *)cig_world_get_component(w, e[i], "double") = e[i] * 0.5;
+  }
+  const CigEntity first = e[0];
+  assert(cig_world_spawn(w, 5, "int"));
+
+  CigExport *export = cig_world_export(w, "int, double", path);
+  assert(export != NULL);
+
+  // The export works on a snapshot, so the world can be written to meanwhile
+  *(int *)cig_world_get_component(w, first, "int") = -1;
+
+  assert(!cig_export_wait(export));
+
+  FILE *f = fopen(path, "rb");
+  assert(f != NULL);
+
+  char magic[4];
+  uint32_t header[2];
+  read_exact(f, magic, sizeof(magic));
+  read_exact(f, header, sizeof(header));
+  assert(memcmp(magic, "CIGC", 4) == 0);
+  assert(header[0] == 2 && header[1] == 1);
+
+  uint32_t section[2];
+  uint64_t region_count;
+  read_exact(f, section, sizeof(section));
+  read_exact(f, &region_count, sizeof(region_count));
+  assert(section[0] == 3);
+
+  uint64_t int_desc_out[5] = {0}, double_desc_out[5] = {0},
+           entity_desc_out[5] = {0};
+  for (uint32_t i = 0; i < section[0]; i++) {
+    uint32_t len;
+    char name[32] = {0};
+    uint64_t desc[5];
+    read_exact(f, &len, sizeof(len));
+    assert(len < sizeof(name));
+    read_exact(f, name, len);
+    read_exact(f, desc, sizeof(desc));
+
+    if (strcmp(name, "int") == 0)
+      memcpy(int_desc_out, desc, sizeof(desc));
+    else if (strcmp(name, "double") == 0)
+      memcpy(double_desc_out, desc, sizeof(desc));
+    else if (strcmp(name, "entity") == 0)
+      memcpy(entity_desc_out, desc, sizeof(desc));
+  }
+  assert(int_desc_out[0] == sizeof(int));
+  assert(double_desc_out[0] == sizeof(double));
+  assert(entity_desc_out[0] == sizeof(CigEntity));
+
+  size_t seen = 0;
+  char *chunk = malloc(section[1]);
+  assert(chunk != NULL);
+  for (uint64_t r = 0; r < region_count; r++) {
+    uint64_t families;
+    read_exact(f, &families, sizeof(families));
+    read_exact(f, chunk, section[1]);
+
+    for (uint64_t i = 0; i < families; i++) {
+      CigEntity id;
+      int value;
+      double d;
+      memcpy(&id, chunk + column_at(entity_desc_out, i), sizeof(id));
+      memcpy(&value, chunk + column_at(int_desc_out, i), sizeof(value));
+      memcpy(&d, chunk + column_at(double_desc_out, i), sizeof(d));
+      assert(value == (int)id);
+      assert(d == id * 0.5);
+      seen++;
+    }
+
+    // Capacity that isn't used is written out as zeroes, even where the
+    // region held families before
+    for (uint64_t i = families;
+         column_at(int_desc_out, i) + sizeof(int) <= entity_desc_out[1]; i++) {
+      CigEntity id;
+      int value;
+      memcpy(&id, chunk + column_at(entity_desc_out, i), sizeof(id));
+      memcpy(&value, chunk + column_at(int_desc_out, i), sizeof(value));
+      assert(id == 0 && value == 0);
+    }
+  }
+  assert(seen == count);
+
+  free(chunk);
+  fclose(f);
+  remove(path);
+
+  assert(*(int *)cig_world_get_component(w, first, "int") == -1);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+typedef struct Row {
+  int id;
+  Vec2 position;
+} Row;
+
+// Writes a single section with an "int" column of `stride` and an "entity"
+// column, followed by one region of `families`. Without the "int" column the
+// section only holds entities.
+static void write_section(const char *path, int with_int, uint64_t offset,
+                          uint64_t stride, uint64_t families) {
+  FILE *file = fopen(path, "wb");
+  assert(file != NULL);
+
+  const uint32_t chunk_size = 64;
+  const uint32_t header[2] = {2, 1};
+  const uint32_t section[2] = {with_int ? 2 : 1, chunk_size};
+  const uint64_t region_count = 1;
+  fwrite("CIGC", 1, 4, file);
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(section, sizeof(section), 1, file);
+  fwrite(&region_count, sizeof(region_count), 1, file);
+
+  if (with_int) {
+    const uint32_t len = 3;
+    const uint64_t desc[5] = {sizeof(int), offset, stride, 1, stride};
+    fwrite(&len, sizeof(len), 1, file);
+    fwrite("int", 1, len, file);
+    fwrite(desc, sizeof(desc), 1, file);
+  }
+
+  const uint32_t len = 6;
+  const uint64_t desc[5] = {sizeof(CigEntity), 32, sizeof(CigEntity), 1,
+                            sizeof(CigEntity)};
+  fwrite(&len, sizeof(len), 1, file);
+  fwrite("entity", 1, len, file);
+  fwrite(desc, sizeof(desc), 1, file);
+
+  const char chunk[64] = {0};
+  fwrite(&families, sizeof(families), 1, file);
+  fwrite(chunk, 1, chunk_size, file);
+  assert(!fclose(file));
+}
+
+int main() {
+  const char *path = "column_import.bin";
+
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &vec2_desc));
+
+  const size_t count = 5000;
+  Row *rows = malloc(count * sizeof(Row));
+  assert(rows != NULL);
+  for (size_t i = 0; i < count; i++)
+    rows[i] = (Row){.id = (int)i, .position = {(float)i, -(float)i}};
+
+  // Packed and strided columns can be mixed
+  int *ids = malloc(count * sizeof(int));
+  assert(ids != NULL);
+  for (size_t i = 0; i < count; i++)
+    ids[i] = (int)i * 2;
+
+  CigColumnDesc columns[] = {
+      {"int", ids, 0},
+      {"vec2", &rows[0].position, sizeof(Row)},
+  };
+
+  // Spawn some zeroed entities into the same storage first
+  assert(cig_world_spawn(w, 10, "int, vec2"));
+
+  const CigEntity *e = cig_world_spawn_columns(w, count, columns, 2);
+  assert(e != NULL);
+  for (size_t i = 0; i < count; i++) {
+    assert(*(int *)cig_world_get_component(w, e[i], "int") == (int)i * 2);
+    const Vec2 *v = cig_world_get_component(w, e[i], "vec2");
+    assert(v->x == (float)i && v->y == -(float)i);
+  }
+
+  // Normal spawns into the same region are still zeroed
+  e = cig_world_spawn(w, 1, "int, vec2");
+  assert(*(int *)cig_world_get_component(w, e[0], "int") == 0);
+
+  // Unknown and duplicated types are rejected
+  CigColumnDesc unknown[] = {{"float", ids, 0}};
+  assert(!cig_world_spawn_columns(w, count, unknown, 1));
+  CigColumnDesc duplicated[] = {{"int", ids, 0}, {"int", ids, 0}};
+  assert(!cig_world_spawn_columns(w, count, duplicated, 2));
+
+  // An exported world can be imported from the file
+  assert(!cig_export_wait(cig_world_export(w, "int", path)));
+
+  CigWorld *imported = cig_world_init();
+  assert(imported != NULL);
+  assert(!cig_world_register_type(imported, &vec2_desc));
+  assert(!cig_world_register_type(imported, &int_desc));
+  assert(!cig_world_import(imported, path));
+  assert(cig_query_count(imported, "int, vec2") == count + 11);
+
+  cig_world_deinit(imported);
+
+  // Hand written sections, the chunk holds 4 entity ids
+  imported = cig_world_init();
+  assert(imported != NULL);
+  assert(!cig_world_register_type(imported, &int_desc));
+  write_section(path, 1, 0, sizeof(int), 4);
+  assert(!cig_world_import(imported, path));
+  assert(cig_query_count(imported, "int") == 4);
+
+  // A column can't wrap around the chunk, nor can a region hold more
+  // families than entity ids, even when the other columns are repeated
+  write_section(path, 1, UINT64_MAX, sizeof(int), 1);
+  assert(cig_world_import(imported, path));
+  write_section(path, 1, 0, 0, 5);
+  assert(cig_world_import(imported, path));
+  write_section(path, 1, 0, UINT64_MAX / 2, 2);
+  assert(cig_world_import(imported, path));
+
+  // Sections without components are refused
+  write_section(path, 0, 0, 0, 1);
+  assert(cig_world_import(imported, path));
+  assert(cig_query_count(imported, "int") == 4);
+
+  cig_world_deinit(imported);
+  remove(path);
+
+  free(ids);
+  free(rows);
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static CigWorld *create_world() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+  CigTypeDesc char_desc = {"char", sizeof(char), _Alignof(char)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &float_desc));
+  assert(!cig_world_register_type(w, &char_desc));
+  return w;
+}
+
+int main() {
+  const char *path = "despawn_query.bin";
+  const char *journal_path = "despawn_query.journal";
+
+  CigWorld *w = create_world();
+
+  const size_t count = 3000;
+  const CigEntity *e = cig_world_spawn(w, count, "int");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  e = cig_world_spawn(w, 1000, "int, float");
+  assert(e != NULL);
+  const CigEntity other = e[0];
+  for (CigEntity i = first; i < other + 1000; i++)
+    *(int *)cig_world_get_component(w, i, "int") = (int)i;
+  assert(cig_world_spawn(w, 500, "float, char"));
+
+  assert(cig_world_despawn_query(w, "unknown"));
+
+  // A fork keeps its own entities and the chunks it shares
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+
+  assert(!cig_world_despawn_query(w, "int, !float"));
+  assert(cig_query_count(w, "int") == 1000);
+  assert(cig_query_count(w, "float") == 1500);
+  assert(!cig_world_get_component(w, first, "int"));
+  for (CigEntity i = other; i < other + 1000; i++)
+    assert(*(int *)cig_world_get_component(w, i, "int") == (int)i);
+
+  assert(cig_query_count(fork, "int") == count + 1000);
+  for (CigEntity i = first; i < other + 1000; i++)
+    assert(*(int *)cig_world_get_component(fork, i, "int") == (int)i);
+  cig_world_deinit(fork);
+
+  // The ids are handed out again
+  e = cig_world_spawn(w, count, "char");
+  assert(e != NULL);
+  for (size_t i = 0; i < count; i++) {
+    assert(e[i] >= first && e[i] < first + count);
+    assert(*(char *)cig_world_get_component(w, e[i], "char") == 0);
+  }
+
+  assert(!cig_world_despawn_query(w, "float"));
+  assert(cig_query_count(w, "float") == 0);
+  assert(cig_query_count(w, "char") == count);
+  assert(!cig_world_despawn_query(w, "float"));
+
+  // Replaying gives later spawns the same ids
+  assert(!cig_world_snapshot(w, path));
+  assert(!cig_world_journal_open(w, journal_path));
+  assert(!cig_world_despawn_query(w, "char"));
+  e = cig_world_spawn(w, 100, "int");
+  assert(e != NULL);
+  for (int i = 0; i < 100; i++)
+    assert(!cig_world_set_component(w, e[i], "int", &i));
+  assert(!cig_world_journal_close(w));
+
+  CigWorld *restored = create_world();
+  assert(!cig_world_restore(restored, path));
+  assert(!cig_world_replay(restored, journal_path));
+  assert(cig_query_count(restored, "char") == 0);
+  assert(cig_query_count(restored, "int") == 100);
+  for (int i = 0; i < 100; i++)
+    assert(*(int *)cig_world_get_component(restored, e[i], "int") == i);
+  cig_world_deinit(restored);
+  remove(journal_path);
+  remove(path);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static void sum_init(void *acc) { *(float *)acc = 0.0f; }
+
+static void sum_combine(void *dst, const void *src) {
+  *(float *)dst += *(const float *)src;
+}
+
+static void sum(CigSystemCtx *ctx, double dt) {
+  const float *value = cig_system_get_component(ctx, 0);
+  *(float *)cig_system_get_accumulator(ctx) += *value;
+}
+
+static void grow(CigSystemCtx *ctx, double dt) {
+  float *value = cig_system_get_component(ctx, 0);
+  *value = *value * 1.001f + (float)dt;
+}
+
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+// Steps a new world on `threads` threads, the hash covers every value and the
+// sum of each step
+static uint32_t run(size_t threads) {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &float_desc));
+  assert(!cig_world_register_type(w, &int_desc));
+
+  CigReductionDesc sum_desc = {sizeof(float), _Alignof(float), sum_init,
+                               sum_combine};
+  CigSystemDesc sum_system_desc = {"sum", "float", .func = sum,
+                                   .reduction = &sum_desc};
+  CigSystemDesc grow_desc = {"grow", "float", grow};
+  assert(!cig_world_register_system(w, &sum_system_desc));
+  assert(!cig_world_register_system(w, &grow_desc));
+
+  assert(!cig_world_set_deterministic(w, 1));
+  assert(!cig_world_set_threads(w, threads, NULL));
+
+  // Values of very different sizes, so the sum depends on the order it is
+  // added up in
+  const size_t count = 100000;
+  const CigEntity *e = cig_world_spawn(w, count, "float");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  for (size_t i = 0; i < count; i++)
+    *(float *)cig_world_get_component(w, e[i], "float") =
+        i % 7 ? 1.0f / (float)(i + 1) : 1e6f;
+
+  e = cig_world_spawn(w, count, "float, int");
+  assert(e != NULL);
+  for (size_t i = 0; i < count; i++)
+    *(float *)cig_world_get_component(w, e[i], "float") = (float)i * 0.3f;
+
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < 4; i++) {
+    assert(!cig_world_step(w, 0.25));
+    hash = hash_bytes(hash, cig_world_get_reduction(w, "sum"), sizeof(float));
+  }
+
+  for (CigEntity i = first; i < first + 2 * count; i++)
+    hash = hash_bytes(hash, cig_world_get_component(w, i, "float"),
+                      sizeof(float));
+
+  cig_world_deinit(w);
+  return hash;
+}
+
+int main() {
+  const uint32_t expected = run(1);
+  assert(run(2) == expected);
+  assert(run(3) == expected);
+  assert(run(8) == expected);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+static void heal(CigSystemCtx *ctx, double dt) {
+  (*(int *)cig_system_get_component(ctx, 0))++;
+}
+
+// Counts the entities of the range, checking they come in order of their
+// health and are within `min` and `max`
+static size_t count_health(const CigWorld *w, int min, int max) {
+  CigIndexRange range;
+  assert(!cig_world_index_range(w, "health", &min, &max, &range));
+
+  size_t result = 0;
+  int last = min;
+  CigEntity e;
+  void *component;
+  while (cig_index_next(&range, &e, &component)) {
+    const int health = *(int *)component;
+    assert(component == cig_world_get_component(w, e, "health"));
+    assert(health >= last && health <= max);
+    last = health;
+    result++;
+  }
+  return result;
+}
+
+static size_t count_x(const CigWorld *w, float min, float max) {
+  CigIndexRange range;
+  assert(!cig_world_index_range(w, "x", &min, &max, &range));
+
+  size_t result = 0;
+  float last = min;
+  CigEntity e;
+  void *component;
+  while (cig_index_next(&range, &e, &component)) {
+    const float x = *(float *)component;
+    assert(x >= last && x <= max);
+    last = x;
+    result++;
+  }
+  return result;
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigFieldDesc fields[] = {{"x", offsetof(Vec2, x), sizeof(float)},
+                           {"y", offsetof(Vec2, y), sizeof(float)}};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2), fields, 2};
+  CigTypeDesc health_desc = {"health", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &vec2_desc));
+  assert(!cig_world_register_type(w, &health_desc));
+
+  const size_t count = 10000;
+  const CigEntity *e = cig_world_spawn(w, count, "health, vec2");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  for (size_t i = 0; i < count; i++) {
+    *(int *)cig_world_get_component(w, e[i], "health") = (int)(i % 100) - 50;
+    const Vec2 v = {((float)i - 100.0f) * 0.5f, 0.0f};
+    assert(!cig_world_set_component(w, e[i], "vec2", &v));
+  }
+
+  // Keys have to be the size of the field, split types are indexed a field at
+  // a time
+  CigIndexDesc bad_desc = {"bad", "health", CIG_KEY_DOUBLE};
+  assert(cig_world_register_index(w, &bad_desc));
+  bad_desc = (CigIndexDesc){"bad", "vec2", CIG_KEY_INT64};
+  assert(cig_world_register_index(w, &bad_desc));
+
+  CigIndexDesc health_index = {"health", "health", CIG_KEY_INT32};
+  CigIndexDesc x_index = {"x", "vec2.x", CIG_KEY_FLOAT};
+  assert(!cig_world_register_index(w, &health_index));
+  assert(cig_world_register_index(w, &health_index));
+  assert(!cig_world_register_index(w, &x_index));
+
+  // Both ends are included, negative keys come first
+  assert(count_health(w, -50, -31) == 20 * count / 100);
+  assert(count_x(w, -10.0f, 10.0f) == 41);
+
+  // A system writing to the health is picked up by the next range
+  CigSystemDesc heal_desc = {"heal", "health", heal};
+  assert(!cig_world_register_system(w, &heal_desc));
+  assert(!cig_world_step(w, 1.0));
+  assert(count_health(w, -50, -31) == 19 * count / 100);
+
+  // As are components that were set, and new entities
+  const int strong = 1000;
+  assert(!cig_world_set_component(w, first + 7, "health", &strong));
+  *(int *)cig_world_get_component(w, first + 8, "health") = strong + 1;
+  e = cig_world_spawn(w, 3, "health");
+  assert(e != NULL);
+  for (size_t i = 0; i < 3; i++)
+    *(int *)cig_world_get_component(w, e[i], "health") = strong;
+  assert(count_health(w, strong, strong) == 4);
+  assert(count_health(w, strong, strong + 1) == 5);
+
+  // The old key of a changed entity is left out
+  assert(!cig_world_set_component(w, first + 7, "health", &(int){-50}));
+  assert(count_health(w, strong, strong + 1) == 4);
+
+  // Unbounded ends
+  CigIndexRange range;
+  assert(!cig_world_index_range(w, "health", NULL, NULL, &range));
+  size_t total = 0;
+  CigEntity entity;
+  while (cig_index_next(&range, &entity, NULL))
+    total++;
+  assert(total == count + 3);
+
+  // Fields keep their keys when they are split into their own columns
+  assert(!cig_world_set_layout(w, "health, vec2", 8, 1));
+  assert(count_x(w, -10.0f, 10.0f) == 41);
+  assert(count_health(w, strong, strong + 1) == 4);
+
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  assert(count_x(fork, -10.0f, 10.0f) == 41);
+  assert(count_health(fork, strong, strong + 1) == 4);
+  cig_world_deinit(fork);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
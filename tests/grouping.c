@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+// Cells are 10 wide along x
+static uint64_t cell(const void *x, void *user_data) {
+  return (uint64_t)(*(const float *)x / 10.0f);
+}
+
+static int third_cell(uint64_t group, void *user_data) { return group == 3; }
+
+// Cleared once the storage is no longer grouped
+static int grouped = 1;
+
+static void check_cell(CigSystemCtx *ctx, double dt) {
+  const float *x = cig_system_get_component(ctx, 0);
+  assert(!grouped || cell(x, NULL) == cig_system_get_group(ctx));
+}
+
+static void count_init(void *acc) { *(long *)acc = 0; }
+
+static void count_combine(void *dst, const void *src) {
+  *(long *)dst += *(const long *)src;
+}
+
+static void count(CigSystemCtx *ctx, double dt) {
+  (*(long *)cig_system_get_accumulator(ctx))++;
+}
+
+static void move(CigSystemCtx *ctx, double dt) {
+  float *x = cig_system_get_component(ctx, 0);
+  *x = *x + 10.0f < 100.0f ? *x + 10.0f : *x - 90.0f;
+}
+
+// The `n`th entity from `first` holds `n` in "int", and is in cell
+// `(n * 7 + shift) % 10`
+static void check(const CigWorld *w, CigEntity first, size_t count,
+                  int shift) {
+  for (CigEntity i = first; i < first + count; i++) {
+    const int n = *(int *)cig_world_get_component(w, i, "int");
+    assert(n == (int)(i - first));
+    const float x = *(float *)cig_world_get_component(w, i, "vec2.x");
+    assert(cell(&x, NULL) == (uint64_t)((n * 7 + shift) % 10));
+  }
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigFieldDesc fields[] = {{"x", offsetof(Vec2, x), sizeof(float)},
+                           {"y", offsetof(Vec2, y), sizeof(float)}};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2), fields, 2};
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &vec2_desc));
+  assert(!cig_world_register_type(w, &int_desc));
+
+  // Neighbouring entities are spread over every cell
+  const size_t total = 5000;
+  const CigEntity *e = cig_world_spawn(w, total, "vec2, int");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  for (size_t i = 0; i < total; i++) {
+    const Vec2 v = {(float)((i * 7) % 10) * 10.0f + 5.0f, 0.0f};
+    assert(!cig_world_set_component(w, e[i], "vec2", &v));
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)i;
+  }
+
+  CigGroupDesc bad_desc = {"vec2", cell};
+  assert(cig_world_set_grouping(w, "vec2, int", &bad_desc));
+  CigGroupDesc group_desc = {"vec2.x", cell};
+  assert(!cig_world_set_grouping(w, "vec2, int", &group_desc));
+  check(w, first, total, 0);
+
+  CigSystemDesc check_desc = {"check", "vec2.x", check_cell, .read_only = 1};
+  CigReductionDesc count_desc = {sizeof(long), _Alignof(long), count_init,
+                                 count_combine};
+  CigSystemDesc count_system_desc = {"count", "vec2.x", count,
+                                     .reduction = &count_desc,
+                                     .read_only = 1,
+                                     .group_filter = third_cell};
+  assert(!cig_world_register_system(w, &check_desc));
+  assert(!cig_world_register_system(w, &count_system_desc));
+
+  // Only the regions of the third cell are run, and every family in them is
+  // in the cell
+  assert(!cig_world_step(w, 1.0));
+  assert(*(const long *)cig_world_get_reduction(w, "count") == total / 10);
+  CigSystemStats stats;
+  assert(!cig_world_get_system_stats(w, "count", &stats));
+  assert(stats.families == total / 10);
+
+  // Families that move to another cell are regrouped by the next pass
+  CigSystemDesc move_desc = {"move", "vec2.x", move};
+  assert(!cig_world_register_system(w, &move_desc));
+  assert(!cig_world_step(w, 1.0));
+  assert(!cig_world_regroup(w));
+  check(w, first, total, 1);
+
+  // The fork keeps the grouping of its storages
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  assert(!cig_world_step(fork, 1.0));
+  assert(!cig_world_regroup(fork));
+  check(fork, first, total, 2);
+  check(w, first, total, 1);
+  cig_world_deinit(fork);
+
+  // Split fields are grouped too, new entities join the regions of their cell
+  assert(!cig_world_set_layout(w, "vec2, int", 8, 1));
+  assert(!cig_world_regroup(w));
+  e = cig_world_spawn(w, 10, "vec2, int");
+  assert(e != NULL);
+  for (size_t i = 0; i < 10; i++) {
+    const Vec2 v = {(float)(((e[i] - first) * 7 + 1) % 10) * 10.0f + 5.0f,
+                    0.0f};
+    assert(!cig_world_set_component(w, e[i], "vec2", &v));
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)(e[i] - first);
+  }
+  assert(!cig_world_regroup(w));
+  check(w, first, total + 10, 1);
+  assert(!cig_world_step(w, 1.0));
+  assert(*(const long *)cig_world_get_reduction(w, "count") ==
+         (total + 10) / 10);
+
+  assert(!cig_world_set_grouping(w, "vec2, int", NULL));
+  grouped = 0;
+  assert(!cig_world_step(w, 1.0));
+  assert(*(const long *)cig_world_get_reduction(w, "count") == total + 10);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+typedef struct Inventory {
+  int slots[16];
+} Inventory;
+
+// Asks for the whole inventory but only ever touches the x of the position
+static void drift(CigSystemCtx *ctx, double dt) {
+  float *x = cig_system_get_component(ctx, 0);
+  *x += 1.0f;
+}
+
+static void count_items(CigSystemCtx *ctx, double dt) {
+  const Inventory *inventory = cig_system_get_component(ctx, 0);
+  int *health = cig_system_get_component(ctx, 1);
+  *health = inventory->slots[0];
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigFieldDesc fields[] = {{"x", offsetof(Vec2, x), sizeof(float)},
+                           {"y", offsetof(Vec2, y), sizeof(float)}};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2), fields, 2};
+  CigTypeDesc health_desc = {"health", sizeof(int), _Alignof(int)};
+  CigTypeDesc inventory_desc = {"inventory", sizeof(Inventory),
+                                _Alignof(Inventory)};
+  assert(!cig_world_register_type(w, &vec2_desc));
+  assert(!cig_world_register_type(w, &health_desc));
+  assert(!cig_world_register_type(w, &inventory_desc));
+
+  const size_t count = 4000;
+  const CigEntity *e = cig_world_spawn(w, count, "vec2, health, inventory");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  for (size_t i = 0; i < count; i++) {
+    const Vec2 v = {(float)i, -(float)i};
+    assert(!cig_world_set_component(w, e[i], "vec2", &v));
+    Inventory *inventory = cig_world_get_component(w, e[i], "inventory");
+    inventory->slots[0] = (int)i;
+  }
+
+  // Only the health and inventory are touched together
+  e = cig_world_spawn(w, count, "health, inventory");
+  assert(e != NULL);
+  const CigEntity other = e[0];
+
+  CigSystemDesc drift_desc = {"drift", "vec2.x, inventory", drift};
+  assert(!cig_world_register_system(w, &drift_desc));
+  CigSystemDesc count_desc = {"count items", "inventory, health",
+                              count_items};
+  assert(!cig_world_register_system(w, &count_desc));
+
+  // Nothing is recorded until tuning is enabled
+  assert(!cig_world_step(w, 1.0));
+  assert(!cig_world_tune_layouts(w, 8));
+  assert(cig_world_get_component(w, first, "vec2") != NULL);
+
+  // The workers record what the systems touch as well
+  assert(!cig_world_set_threads(w, 4, NULL));
+  assert(!cig_world_enable_layout_tuning(w, 1));
+  for (int i = 0; i < 3; i++)
+    assert(!cig_world_step(w, 1.0));
+  assert(!cig_world_tune_layouts(w, 8));
+
+  // Each x is next to the x of the next family, split from the ys
+  assert(!cig_world_get_component(w, first, "vec2"));
+  const float *x = cig_world_get_component(w, first, "vec2.x");
+  assert((const float *)cig_world_get_component(w, first + 1, "vec2.x") ==
+         x + 1);
+
+  // The inventory is read whole, the whole family was in the cache anyway
+  const char *a = cig_world_get_component(w, other, "inventory");
+  const char *b = cig_world_get_component(w, other + 1, "inventory");
+  assert(b - a == sizeof(Inventory) + sizeof(int));
+
+  for (size_t i = 0; i < count; i++) {
+    assert(*(float *)cig_world_get_component(w, first + i, "vec2.x") ==
+           (float)i + 4.0f);
+    assert(*(float *)cig_world_get_component(w, first + i, "vec2.y") ==
+           -(float)i);
+    assert(*(int *)cig_world_get_component(w, first + i, "health") == (int)i);
+  }
+
+  // The systems keep running on the new layout, and a second pass with the
+  // same access leaves it alone
+  for (int i = 0; i < 3; i++)
+    assert(!cig_world_step(w, 1.0));
+  assert(!cig_world_tune_layouts(w, 8));
+  assert(cig_world_get_component(w, first + 1, "vec2.x") == x + 1);
+  assert(*(float *)cig_world_get_component(w, first, "vec2.x") == 7.0f);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
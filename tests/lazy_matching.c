@@ -0,0 +1,78 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void count_init(void *acc) { *(long *)acc = 0; }
+
+void count_combine(void *dst, const void *src) {
+  *(long *)dst += *(const long *)src;
+}
+
+void count(CigSystemCtx *ctx, double dt) {
+  (*(long *)cig_system_get_accumulator(ctx))++;
+}
+
+// Spawns 3 entities for each combination of the types that has "t7" when
+// `with_last` is set, or doesn't when it isn't
+static void spawn_combinations(CigWorld *w, int with_last) {
+  for (int bits = 1; bits < 256; bits++) {
+    if (!(bits & 128) != !with_last)
+      continue;
+
+    char types[64] = "";
+    for (int i = 0; i < 8; i++) {
+      if (!(bits & (1 << i)))
+        continue;
+      char type[8];
+      snprintf(type, sizeof(type), "%st%d", types[0] ? ", " : "", i);
+      strcat(types, type);
+    }
+    assert(cig_world_spawn(w, 3, types));
+  }
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  char *names[] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7"};
+  for (int i = 0; i < 8; i++) {
+    CigTypeDesc desc = {names[i], sizeof(int), _Alignof(int)};
+    assert(!cig_world_register_type(w, &desc));
+  }
+
+  CigReductionDesc count_desc = {sizeof(long), _Alignof(long), count_init,
+                                 count_combine};
+  CigSystemDesc first_desc = {"first", "t0, !t1", .func = count,
+                              .reduction = &count_desc};
+  assert(!cig_world_register_system(w, &first_desc));
+
+  // The storages are matched on the workers
+  assert(!cig_world_set_threads(w, 4, NULL));
+  spawn_combinations(w, 0);
+
+  // Registering a system matches the storages that were waiting first
+  CigSystemDesc last_desc = {"last", "t7", .func = count,
+                             .reduction = &count_desc};
+  assert(!cig_world_register_system(w, &last_desc));
+  spawn_combinations(w, 1);
+
+  assert(!cig_world_run(w, "last", 1.0));
+  assert(*(const long *)cig_world_get_reduction(w, "last") == 128 * 3);
+
+  assert(!cig_world_step(w, 1.0));
+  assert(*(const long *)cig_world_get_reduction(w, "first") == 64 * 3);
+  assert(*(const long *)cig_world_get_reduction(w, "last") == 128 * 3);
+
+  // A fork matches its own storages
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  assert(!cig_world_step(fork, 1.0));
+  assert(*(const long *)cig_world_get_reduction(fork, "first") == 64 * 3);
+  cig_world_deinit(fork);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
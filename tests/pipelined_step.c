@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STEPS 20
+
+// How many entities each extraction saw at each position
+static atomic_int seen[STEPS + 1];
+
+void move(CigSystemCtx *ctx, double dt) {
+  (*(int *)cig_system_get_component(ctx, 0))++;
+}
+
+void extract(CigSystemCtx *ctx, double dt) {
+  const int position = *(int *)cig_system_get_component(ctx, 0);
+  const int id = *(int *)cig_system_get_component(ctx, 1);
+
+  // Slow enough that the next step moves the entities in the meantime
+  if (id % 2000 == 0)
+    nanosleep(&(struct timespec){0, 200000}, NULL);
+
+  atomic_fetch_add(&seen[position], 1);
+}
+
+// Counts the entities each extraction ran on
+void tally(CigSystemCtx *ctx, double dt) {
+  (*(long *)cig_system_get_accumulator(ctx))++;
+}
+
+void tally_init(void *acc) { *(long *)acc = 0; }
+
+void tally_combine(void *dst, const void *src) {
+  *(long *)dst += *(const long *)src;
+}
+
+void noop(void *user_data) {}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc position_desc = {"position", sizeof(int), _Alignof(int)};
+  CigTypeDesc id_desc = {"id", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &position_desc));
+  assert(!cig_world_register_type(w, &id_desc));
+
+  CigSystemDesc move_desc = {"move", "position", move};
+  CigSystemDesc extract_desc = {"extract", "position, id", extract,
+                                .extract = 1};
+  assert(!cig_world_register_system(w, &move_desc));
+  assert(!cig_world_register_system(w, &extract_desc));
+  CigReductionDesc tally_reduction = {sizeof(long), _Alignof(long),
+                                      tally_init, tally_combine};
+  CigSystemDesc tally_desc = {"tally", "position", tally, .extract = 1,
+                              .reduction = &tally_reduction};
+  assert(!cig_world_register_system(w, &tally_desc));
+
+  // Extraction runs outside of the step's systems and tasks
+  CigSystemDesc fused_desc = {"fused", "position, id", move,
+                              .fuse_after = "extract"};
+  assert(cig_world_register_system(w, &fused_desc));
+  CigTaskDesc task_desc = {"after extract", noop, .after = "extract"};
+  assert(cig_world_register_task(w, &task_desc));
+
+  const int count = 10000;
+  const CigEntity *e = cig_world_spawn(w, count, "position, id");
+  assert(e != NULL);
+  for (int i = 0; i < count; i++) {
+    *(int *)cig_world_get_component(w, e[i], "position") = 0;
+    *(int *)cig_world_get_component(w, e[i], "id") = i;
+  }
+
+  // Without workers extraction runs straight after the other systems
+  assert(cig_world_set_pipelined(w, 1));
+  assert(!cig_world_step(w, 1.0));
+  assert(atomic_load(&seen[1]) == count);
+
+  assert(!cig_world_set_threads(w, 4, NULL));
+  assert(!cig_world_set_pipelined(w, 1));
+  assert(cig_world_set_threads(w, 1, NULL));
+
+  // Each extraction sees its own step, never the next one half done. Reading
+  // a reduction waits for the extraction that writes it.
+  for (int i = 2; i <= STEPS; i++) {
+    assert(!cig_world_step(w, 1.0));
+    assert(*(const long *)cig_world_get_reduction(w, "tally") == count);
+  }
+  cig_world_wait_extraction(w);
+
+  for (int i = 1; i <= STEPS; i++)
+    assert(atomic_load(&seen[i]) == count);
+  assert(*(int *)cig_world_get_component(w, e[0], "position") == STEPS);
+
+  // Turning it off waits for the last extraction
+  assert(!cig_world_set_pipelined(w, 0));
+  assert(!cig_world_set_threads(w, 1, NULL));
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
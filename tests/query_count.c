@@ -0,0 +1,33 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+  CigTypeDesc char_desc = {"char", sizeof(char), _Alignof(char)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &float_desc));
+  assert(!cig_world_register_type(w, &char_desc));
+
+  assert(cig_query_count(w, "int") == 0);
+
+  assert(cig_world_spawn(w, 1000, "int"));
+  assert(cig_world_spawn(w, 200, "int, float"));
+  assert(cig_world_spawn(w, 30, "float, char"));
+  assert(cig_world_spawn(w, 4, "char"));
+
+  assert(cig_query_count(w, "int") == 1200);
+  assert(cig_query_count(w, "float") == 230);
+  assert(cig_query_count(w, "int, float") == 200);
+  assert(cig_query_count(w, "int, !float") == 1000);
+  assert(cig_query_count(w, "char, !int") == 34);
+  assert(cig_query_count(w, "!int") == 34);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+static void integrate(CigSystemCtx *ctx, double dt) {
+  Vec2 *v = cig_system_get_component(ctx, 0);
+  v->x += 1.0f;
+}
+
+// Reads every position, the read is retried until it was consistent
+static size_t read_positions(const CigSharedView *view, double *sum) {
+  CigSharedRun runs[512];
+  size_t count, run_count;
+  uint64_t sequence;
+  do {
+    sequence = cig_shared_begin(view);
+    run_count = cig_shared_runs(view, "vec2", runs, 512);
+    assert(run_count <= 512);
+
+    count = 0;
+    *sum = 0;
+    for (size_t i = 0; i < run_count; i++)
+      for (size_t j = 0; j < runs[i].count; j++) {
+        const Vec2 *v = runs[i].data + runs[i].stride * j;
+        *sum += v->x;
+        count++;
+      }
+  } while (!cig_shared_validate(view, sequence));
+
+  return count;
+}
+
+int main() {
+  char name[64];
+  snprintf(name, sizeof(name), "/ciggurat_shared_%d", (int)getpid());
+
+  CigWorld *w = cig_world_init_shared(name, 16 * 1024 * 1024);
+  assert(w != NULL);
+
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2)};
+  assert(!cig_world_register_type(w, &vec2_desc));
+
+  CigSystemDesc system_desc = {"integrate", "vec2", integrate};
+  assert(!cig_world_register_system(w, &system_desc));
+
+  const size_t count = 5000;
+  assert(cig_world_spawn(w, count, "vec2"));
+
+  CigSharedView *view = cig_shared_open(name);
+  assert(view != NULL);
+
+  // Nothing is readable until the spawn is published
+  assert(!cig_shared_validate(view, cig_shared_begin(view)));
+
+  assert(!cig_world_step(w, 1.0));
+  double sum;
+  assert(read_positions(view, &sum) == count);
+  assert(sum == (double)count);
+
+  // The entity ids are a column too
+  CigSharedRun runs[64];
+  const size_t run_count = cig_shared_runs(view, "entity", runs, 64);
+  size_t ids = 0;
+  for (size_t i = 0; i < run_count; i++)
+    ids += runs[i].count;
+  assert(ids == count);
+  assert(cig_shared_runs(view, "float", runs, 64) == 0);
+
+  // Writes outside of a step are published explicitly
+  const CigEntity *e = cig_world_spawn(w, 10, "vec2");
+  assert(e != NULL);
+  const CigEntity moved = e[0];
+  Vec2 v = {100.0f, 0.0f};
+  assert(!cig_world_set_component(w, moved, "vec2", &v));
+  assert(!cig_shared_validate(view, cig_shared_begin(view)));
+  assert(!cig_world_publish(w));
+  assert(read_positions(view, &sum) == count + 10);
+  assert(sum == (double)count + 100.0);
+
+  // A tiled storage is read a block at a time
+  assert(!cig_world_set_layout(w, "vec2", 16, 0));
+  assert(!cig_world_publish(w));
+  assert(read_positions(view, &sum) == count + 10);
+  assert(sum == (double)count + 100.0);
+
+  // A fork keeps the shared chunks alive after the world is gone
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  cig_world_deinit(w);
+  assert(((Vec2 *)cig_world_get_component(fork, moved, "vec2"))->x == 100.0f);
+  cig_world_deinit(fork);
+
+  // The view stays mapped, but a world that is gone is never consistent
+  assert(!cig_shared_validate(view, cig_shared_begin(view)));
+  cig_shared_close(view);
+  assert(cig_shared_open(name) == NULL);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+static void integrate(CigSystemCtx *ctx, double dt) {
+  float *x = cig_system_get_component(ctx, 0);
+  const float *speed = cig_system_get_component(ctx, 1);
+  *x += *speed;
+}
+
+static void whole(CigSystemCtx *ctx, double dt) {}
+
+static CigWorld *create_world() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigFieldDesc fields[] = {{"x", offsetof(Vec2, x), sizeof(float)},
+                           {"y", offsetof(Vec2, y), sizeof(float)}};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2), fields, 2};
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &vec2_desc));
+  assert(!cig_world_register_type(w, &int_desc));
+  return w;
+}
+
+// The `n`th entity from `first` is at `scale * n, -n` and holds `n` in "int"
+static void check(CigWorld *w, CigEntity first, size_t count, float scale) {
+  for (CigEntity i = first; i < first + count; i++) {
+    assert(*(float *)cig_world_get_component(w, i, "vec2.x") ==
+           scale * (i - first));
+    assert(*(float *)cig_world_get_component(w, i, "vec2.y") ==
+           -(float)(i - first));
+    assert(*(int *)cig_world_get_component(w, i, "int") == (int)(i - first));
+  }
+}
+
+int main() {
+  const char *path = "split_fields.bin";
+
+  CigWorld *w = create_world();
+
+  // Fields have to be inside the type and can't be named like a requirement
+  CigFieldDesc bad_fields[] = {{"x.y", 0, sizeof(float)}};
+  CigTypeDesc bad_desc = {"bad", sizeof(float), _Alignof(float), bad_fields,
+                          1};
+  assert(cig_world_register_type(w, &bad_desc));
+  bad_fields[0] = (CigFieldDesc){"x", sizeof(float), sizeof(float)};
+  assert(cig_world_register_type(w, &bad_desc));
+
+  const size_t count = 1000;
+  const CigEntity *e = cig_world_spawn(w, count, "vec2, int");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  for (size_t i = 0; i < count; i++) {
+    const Vec2 v = {(float)i, -(float)i};
+    assert(!cig_world_set_component(w, e[i], "vec2", &v));
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)i;
+  }
+
+  // A field of a packed type is a pointer into the whole value
+  const Vec2 *v = cig_world_get_component(w, first + 1, "vec2");
+  assert((const float *)cig_world_get_component(w, first + 1, "vec2.y") ==
+         &v->y);
+  assert(!cig_world_get_component(w, first, "vec2.z"));
+
+  // Systems can't be given the whole of a split type
+  CigSystemDesc whole_desc = {"whole", "vec2", whole};
+  CigWorld *other = create_world();
+  assert(cig_world_spawn(other, 1, "vec2, int"));
+  assert(!cig_world_register_system(other, &whole_desc));
+  assert(cig_world_set_layout(other, "vec2, int", 8, 1));
+  cig_world_deinit(other);
+
+  // Every x of a block is side by side, and the ys after them
+  assert(!cig_world_set_layout(w, "vec2, int", 8, 1));
+  check(w, first, count, 1.0f);
+  assert(!cig_world_get_component(w, first, "vec2"));
+  const float *x = cig_world_get_component(w, first, "vec2.x");
+  assert((const float *)cig_world_get_component(w, first + 1, "vec2.x") ==
+         x + 1);
+  assert((const float *)cig_world_get_component(w, first, "vec2.y") == x + 8);
+
+  assert(cig_world_register_system(w, &whole_desc));
+  CigSystemDesc system_desc = {"integrate", "vec2.x, vec2.y", integrate};
+  assert(!cig_world_register_system(w, &system_desc));
+  assert(!cig_world_step(w, 1.0));
+
+  // Each x was moved by its y, back to zero
+  for (size_t i = 0; i < count; i++)
+    assert(*(float *)cig_world_get_component(w, first + i, "vec2.x") == 0.0f);
+
+  const Vec2 moved = {2.0f, 0.0f};
+  assert(!cig_world_set_component(w, first + 1, "vec2", &moved));
+  assert(*(float *)cig_world_get_component(w, first + 1, "vec2.x") == 2.0f);
+  assert(*(float *)cig_world_get_component(w, first + 1, "vec2.y") == 0.0f);
+  const Vec2 back = {0.0f, -1.0f};
+  assert(!cig_world_set_component(w, first + 1, "vec2", &back));
+
+  // New families are zeroed a field at a time
+  e = cig_world_spawn(w, 3, "vec2, int");
+  assert(e != NULL);
+  for (size_t i = 0; i < 3; i++) {
+    assert(*(float *)cig_world_get_component(w, e[i], "vec2.y") == 0.0f);
+    const Vec2 v = {0.0f, -(float)(e[i] - first)};
+    assert(!cig_world_set_component(w, e[i], "vec2", &v));
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)(e[i] - first);
+  }
+  check(w, first, count + 3, 0.0f);
+
+  // Snapshots and exports of split types are read into packed storages
+  assert(!cig_world_snapshot(w, path));
+  CigWorld *restored = create_world();
+  assert(!cig_world_restore(restored, path));
+  check(restored, first, count + 3, 0.0f);
+  cig_world_deinit(restored);
+
+  CigExport *export = cig_world_export(w, "vec2, int", path);
+  assert(export != NULL);
+  assert(!cig_export_wait(export));
+  CigWorld *imported = create_world();
+  assert(!cig_world_import(imported, path));
+  assert(cig_query_count(imported, "vec2, int") == count + 3);
+  for (CigEntity i = 0; i < count + 3; i++) {
+    const Vec2 *v = cig_world_get_component(imported, i, "vec2");
+    const int n = *(int *)cig_world_get_component(imported, i, "int");
+    assert(v->x == 0.0f && v->y == -(float)n);
+  }
+  cig_world_deinit(imported);
+  remove(path);
+
+  // And back to whole values
+  assert(!cig_world_set_layout(w, "vec2, int", 8, 0));
+  assert(cig_world_get_component(w, first, "vec2") != NULL);
+  check(w, first, count + 3, 0.0f);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void sleepy(CigSystemCtx *ctx, double dt) {
+  // Only one entity sleeps, so the system takes about 1ms a step
+  if (*(int *)cig_system_get_component(ctx, 0) == 0)
+    nanosleep(&(struct timespec){0, 1000000}, NULL);
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &int_desc));
+
+  CigSystemDesc system_desc = {"sleepy", "int", sleepy};
+  assert(!cig_world_register_system(w, &system_desc));
+
+  const CigEntity *e = cig_world_spawn(w, 10, "int");
+  assert(e != NULL);
+  for (int i = 0; i < 10; i++)
+    *(int *)cig_world_get_component(w, e[i], "int") = i;
+
+  CigLatency latency;
+  cig_world_get_step_latency(w, &latency);
+  assert(latency.count == 0 && latency.max == 0);
+
+  for (int i = 0; i < 20; i++)
+    assert(!cig_world_step(w, 1.0));
+
+  cig_world_get_step_latency(w, &latency);
+  assert(latency.count == 20);
+  assert(latency.p50 >= 1000000);
+  assert(latency.p50 <= latency.p99 && latency.p99 <= latency.p999);
+  assert(latency.p999 <= latency.max);
+
+  CigLatency system_latency;
+  assert(!cig_world_get_system_latency(w, "sleepy", &system_latency));
+  assert(system_latency.count == 20);
+  assert(system_latency.p50 >= 1000000);
+  assert(system_latency.max <= latency.max);
+  assert(cig_world_get_system_latency(w, "missing", &system_latency));
+
+  cig_world_reset_latency(w);
+  cig_world_get_step_latency(w, &latency);
+  assert(latency.count == 0 && latency.p99 == 0);
+  assert(!cig_world_get_system_latency(w, "sleepy", &system_latency));
+  assert(system_latency.count == 0);
+
+  assert(!cig_world_step(w, 1.0));
+  cig_world_get_step_latency(w, &latency);
+  assert(latency.count == 1 && latency.p50 == latency.max);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+static void integrate(CigSystemCtx *ctx, double dt) {
+  Vec2 *position = cig_system_get_component(ctx, 0);
+  const Vec2 *velocity = cig_system_get_component(ctx, 1);
+  position->x += velocity->x * dt;
+  position->y += velocity->y * dt;
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc position_desc = {"position", sizeof(Vec2), _Alignof(Vec2)};
+  CigTypeDesc velocity_desc = {"velocity", sizeof(Vec2), _Alignof(Vec2)};
+  assert(!cig_world_register_type(w, &position_desc));
+  assert(!cig_world_register_type(w, &velocity_desc));
+
+  CigSystemDesc system_desc = {"integrate", "position, velocity", integrate};
+  assert(!cig_world_register_system(w, &system_desc));
+
+  const size_t count = 10000;
+  assert(cig_world_spawn(w, count, "position, velocity"));
+
+  // Runs and entities are always counted
+  for (int i = 0; i < 3; i++)
+    assert(!cig_world_step(w, 1.0));
+
+  CigSystemStats stats;
+  assert(!cig_world_get_system_stats(w, "integrate", &stats));
+  assert(stats.runs == 3 && stats.families == 3 * count);
+  assert(stats.cycles == 0);
+  assert(cig_world_get_system_stats(w, "missing", &stats));
+
+  // The counters only see the calling thread, so not the workers
+  assert(!cig_world_set_threads(w, 4, NULL));
+  assert(cig_world_enable_counters(w, 1));
+  assert(!cig_world_set_threads(w, 1, NULL));
+
+  // Hardware counters may not be available, e.g. in a virtual machine
+  if (cig_world_enable_counters(w, 1)) {
+    cig_world_deinit(w);
+    return 77;
+  }
+
+  for (int i = 0; i < 3; i++)
+    assert(!cig_world_step(w, 1.0));
+
+  assert(!cig_world_get_system_stats(w, "integrate", &stats));
+  assert(stats.runs == 6);
+  assert(stats.cycles > 0 && stats.instructions > 0);
+  cig_world_print_system_stats(w);
+  assert(cig_world_set_threads(w, 4, NULL));
+
+  assert(!cig_world_enable_counters(w, 0));
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
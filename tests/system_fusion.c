@@ -0,0 +1,56 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void integrate(CigSystemCtx *ctx, double dt) {
+  int *i = cig_system_get_component(ctx, 0);
+  *i += 3;
+}
+
+void clamp(CigSystemCtx *ctx, double dt) {
+  int *i = cig_system_get_component(ctx, 0);
+  if (*i > 2)
+    *i = 2;
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &float_desc));
+
+  CigSystemDesc integrate_desc = {"integrate", "int, float",
+                                  .func = integrate};
+  CigSystemDesc clamp_desc = {"clamp", "int, float", .func = clamp,
+                              .fuse_after = "integrate"};
+  CigSystemDesc mismatched_desc = {"mismatched", "int", .func = clamp,
+                                   .fuse_after = "integrate"};
+  CigSystemDesc missing_desc = {"missing", "int, float", .func = clamp,
+                                .fuse_after = "missing target"};
+  assert(!cig_world_register_system(w, &integrate_desc));
+  assert(!cig_world_register_system(w, &clamp_desc));
+  assert(cig_world_register_system(w, &mismatched_desc));
+  assert(cig_world_register_system(w, &missing_desc));
+
+  const size_t count = 100000;
+  const CigEntity *e = cig_world_spawn(w, count, "int, float");
+  assert(e != NULL);
+
+  CigEntity first = e[0], last = e[count - 1];
+
+  // The clamp must always observe the result of integrate
+  assert(!cig_world_step(w, 0));
+  assert(*(int *)cig_world_get_component(w, first, "int") == 2);
+  assert(*(int *)cig_world_get_component(w, last, "int") == 2);
+
+  // Running the head directly does not run the fused systems
+  assert(!cig_world_run(w, "integrate", 0));
+  assert(*(int *)cig_world_get_component(w, first, "int") == 5);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Bounds {
+  long sum;
+  int min, max;
+} Bounds;
+
+void bounds_init(void *acc) {
+  *(Bounds *)acc = (Bounds){.sum = 0, .min = 1 << 30, .max = -(1 << 30)};
+}
+
+void bounds_combine(void *dst_ptr, const void *src_ptr) {
+  Bounds *dst = dst_ptr;
+  const Bounds *src = src_ptr;
+  dst->sum += src->sum;
+  if (src->min < dst->min)
+    dst->min = src->min;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+void bounds(CigSystemCtx *ctx, double dt) {
+  int *i = cig_system_get_component(ctx, 0);
+  Bounds *acc = cig_system_get_accumulator(ctx);
+  acc->sum += *i;
+  if (*i < acc->min)
+    acc->min = *i;
+  if (*i > acc->max)
+    acc->max = *i;
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &int_desc));
+
+  CigReductionDesc bounds_desc = {sizeof(Bounds), _Alignof(Bounds),
+                                  bounds_init, bounds_combine};
+  CigSystemDesc bounds_system_desc = {"bounds", "int", .func = bounds,
+                                      .reduction = &bounds_desc};
+  assert(!cig_world_register_system(w, &bounds_system_desc));
+
+  const size_t count = 10000;
+  const CigEntity *e = cig_world_spawn(w, count, "int");
+  assert(e != NULL);
+  for (size_t i = 0; i < count; i++)
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)i - 100;
+
+  // Running twice must not accumulate across runs
+  for (int i = 0; i < 2; i++) {
+    assert(!cig_world_run(w, "bounds", 0));
+
+    const Bounds *result = cig_world_get_reduction(w, "bounds");
+    assert(result != NULL);
+    assert(result->sum == (long)count * (count - 1) / 2 - 100 * (long)count);
+    assert(result->min == -100);
+    assert(result->max == (int)count - 101);
+  }
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
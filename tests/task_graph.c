@@ -0,0 +1,92 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct Frame {
+  // Bumped by each system and task in turn, so each one records where in the
+  // frame it ran
+  atomic_int clock;
+  int physics, mix, flush, send;
+} Frame;
+
+static Frame frame;
+
+void physics(CigSystemCtx *ctx, double dt) {
+  (*(int *)cig_system_get_component(ctx, 0))++;
+}
+
+void physics_done(CigSystemCtx *ctx, double dt) {
+  frame.physics = atomic_fetch_add(&frame.clock, 1);
+}
+
+void mix(void *user_data) { frame.mix = atomic_fetch_add(&frame.clock, 1); }
+
+void flush(void *user_data) {
+  frame.flush = atomic_fetch_add(&frame.clock, 1);
+}
+
+void send(void *user_data) {
+  frame.send = atomic_fetch_add(&frame.clock, 1);
+  (*(int *)user_data)++;
+}
+
+static void check_frame(CigWorld *w, int *sent, int expected) {
+  atomic_store(&frame.clock, 0);
+  assert(!cig_world_step(w, 1.0));
+
+  // Every system and task ran exactly once
+  assert(atomic_load(&frame.clock) == 4);
+  assert(*sent == expected);
+
+  assert(frame.flush > frame.physics);
+  assert(frame.send > frame.flush && frame.send > frame.mix);
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  assert(!cig_world_register_type(w, &int_desc));
+
+  CigSystemDesc physics_desc = {"physics", "int", physics};
+  CigSystemDesc physics_done_desc = {"physics_done", "int", physics_done,
+                                     .fuse_after = "physics"};
+  assert(!cig_world_register_system(w, &physics_desc));
+  assert(!cig_world_register_system(w, &physics_done_desc));
+
+  // A single entity, so the end of physics is marked once a step
+  assert(cig_world_spawn(w, 1, "int"));
+
+  int sent = 0;
+  CigTaskDesc mix_desc = {"mix", mix};
+  CigTaskDesc flush_desc = {"flush", flush, .after = "physics_done"};
+  CigTaskDesc send_desc = {"send", send, &sent, "flush, mix"};
+  assert(!cig_world_register_task(w, &mix_desc));
+  assert(!cig_world_register_task(w, &flush_desc));
+  assert(!cig_world_register_task(w, &send_desc));
+
+  // Identifiers are shared with systems and dependencies must exist
+  CigTaskDesc bad_desc = {"physics", mix};
+  assert(cig_world_register_task(w, &bad_desc));
+  bad_desc = (CigTaskDesc){"late", mix, .after = "mix, missing"};
+  assert(cig_world_register_task(w, &bad_desc));
+  CigSystemDesc clash_desc = {"mix", "int", physics};
+  assert(cig_world_register_system(w, &clash_desc));
+
+  check_frame(w, &sent, 1);
+
+  // The tasks run on the same workers as the systems
+  assert(!cig_world_set_threads(w, 4, NULL));
+  for (int i = 2; i < 200; i++)
+    check_frame(w, &sent, i);
+
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  check_frame(fork, &sent, 200);
+  cig_world_deinit(fork);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+static void integrate(CigSystemCtx *ctx, double dt) {
+  Vec2 *v = cig_system_get_component(ctx, 0);
+  const int *speed = cig_system_get_component(ctx, 1);
+  v->x += *speed;
+}
+
+static CigWorld *create_world() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2)};
+  CigTypeDesc flag_desc = {"flag", sizeof(char), _Alignof(char)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &vec2_desc));
+  assert(!cig_world_register_type(w, &flag_desc));
+  return w;
+}
+
+// The `n`th entity from `first` holds `n` in "int" and `scale * n, 2 * n` in
+// "vec2"
+static void check(const CigWorld *w, CigEntity first, size_t count,
+                  float scale) {
+  for (CigEntity i = first; i < first + count; i++) {
+    assert(*(int *)cig_world_get_component(w, i, "int") == (int)(i - first));
+    const Vec2 *v = cig_world_get_component(w, i, "vec2");
+    assert(v->x == scale * (i - first));
+    assert(v->y == 2.0f * (i - first));
+    assert(*(char *)cig_world_get_component(w, i, "flag") == (char)i);
+  }
+}
+
+int main() {
+  const char *path = "tiled_layout.bin";
+
+  CigWorld *w = create_world();
+
+  const size_t count = 3000;
+  const CigEntity *e = cig_world_spawn(w, count, "int, vec2, flag");
+  assert(e != NULL);
+  const CigEntity first = e[0];
+  for (size_t i = 0; i < count; i++) {
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)i;
+    *(Vec2 *)cig_world_get_component(w, e[i], "vec2") =
+        (Vec2){(float)i, 2.0f * i};
+    *(char *)cig_world_get_component(w, e[i], "flag") = (char)e[i];
+  }
+
+  assert(cig_world_set_layout(w, "int, vec2, flag", 3, 0));
+  assert(cig_world_set_layout(w, "int, vec2, flag", 1 << 20, 0));
+
+  // The existing families are moved into blocks of 8
+  assert(!cig_world_set_layout(w, "int, vec2, flag", 8, 0));
+  assert(cig_query_count(w, "int, vec2, flag") == count);
+  check(w, first, count, 1.0f);
+
+  // Values of a type are side by side within a block
+  const char *a = cig_world_get_component(w, first, "vec2");
+  const char *b = cig_world_get_component(w, first + 1, "vec2");
+  assert(b - a == sizeof(Vec2));
+
+  CigSystemDesc system_desc = {"integrate", "vec2, int", integrate};
+  assert(!cig_world_register_system(w, &system_desc));
+  assert(!cig_world_step(w, 1.0));
+  check(w, first, count, 2.0f);
+
+  // New families are zeroed in every block
+  e = cig_world_spawn(w, 13, "int, vec2, flag");
+  assert(e != NULL);
+  for (size_t i = 0; i < 13; i++) {
+    assert(*(int *)cig_world_get_component(w, e[i], "int") == 0);
+    *(char *)cig_world_get_component(w, e[i], "flag") = (char)e[i];
+    *(Vec2 *)cig_world_get_component(w, e[i], "vec2") =
+        (Vec2){2.0f * (e[i] - first), 2.0f * (e[i] - first)};
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)(e[i] - first);
+  }
+  check(w, first, count + 13, 2.0f);
+
+  // A fork shares the tiled chunks until it writes to them
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  check(fork, first, count + 13, 2.0f);
+  assert(!cig_world_step(fork, 1.0));
+  check(fork, first, count + 13, 3.0f);
+  check(w, first, count + 13, 2.0f);
+  cig_world_deinit(fork);
+
+  // Snapshots and exports don't depend on the layout
+  assert(!cig_world_snapshot(w, path));
+  CigWorld *restored = create_world();
+  assert(!cig_world_restore(restored, path));
+  check(restored, first, count + 13, 2.0f);
+  cig_world_deinit(restored);
+
+  CigExport *export = cig_world_export(w, "int, vec2, flag", path);
+  assert(export != NULL);
+  assert(!cig_export_wait(export));
+  CigWorld *imported = create_world();
+  assert(!cig_world_import(imported, path));
+  assert(cig_query_count(imported, "int, vec2, flag") == count + 13);
+  long long sum = 0;
+  for (CigEntity i = 0; i < count + 13; i++)
+    sum += *(int *)cig_world_get_component(imported, i, "int");
+  assert(sum == (long long)(count + 13) * (count + 12) / 2);
+  cig_world_deinit(imported);
+  remove(path);
+
+  // Packed families are copied into a tiled storage instead of spliced
+  CigWorld *staging = create_world();
+  e = cig_world_spawn(staging, 20, "int, vec2, flag");
+  assert(e != NULL);
+  for (size_t i = 0; i < 20; i++)
+    *(int *)cig_world_get_component(staging, e[i], "int") = -1;
+  CigEntity merged;
+  assert(!cig_world_merge(w, staging, &merged));
+  for (CigEntity i = merged; i < merged + 20; i++)
+    assert(*(int *)cig_world_get_component(w, i, "int") == -1);
+  cig_world_deinit(staging);
+
+  // And back to packed families
+  assert(!cig_world_set_layout(w, "int, vec2, flag", 1, 0));
+  check(w, first, count + 13, 2.0f);
+  assert(cig_query_count(w, "int, vec2, flag") == count + 33);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
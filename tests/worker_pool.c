@@ -0,0 +1,80 @@
+// sched_getaffinity() is not part of POSIX
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <ciggurat.h>
+#include <sched.h>
+#include <stdlib.h>
+
+void sum_init(void *acc) { *(long *)acc = 0; }
+
+void sum_combine(void *dst, const void *src) {
+  *(long *)dst += *(const long *)src;
+}
+
+void increment(CigSystemCtx *ctx, double dt) {
+  (*(int *)cig_system_get_component(ctx, 0))++;
+}
+
+void sum(CigSystemCtx *ctx, double dt) {
+  *(long *)cig_system_get_accumulator(ctx) +=
+      *(int *)cig_system_get_component(ctx, 0);
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &float_desc));
+
+  // Registered before the threads, so its accumulators have to grow
+  CigReductionDesc sum_desc = {sizeof(long), _Alignof(long), sum_init,
+                               sum_combine};
+  CigSystemDesc sum_system_desc = {"sum", "int", .func = sum,
+                                   .reduction = &sum_desc};
+  assert(!cig_world_register_system(w, &sum_system_desc));
+
+  // Pinned to a CPU the test is allowed to run on
+  cpu_set_t allowed;
+  assert(!sched_getaffinity(0, sizeof(allowed), &allowed));
+  int cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed))
+    cpu++;
+  const int cpus[] = {cpu, -1, cpu};
+  assert(!cig_world_set_threads(w, 4, cpus));
+
+  CigSystemDesc increment_desc = {"increment", "int", increment};
+  assert(!cig_world_register_system(w, &increment_desc));
+
+  // Enough entities for many regions in two storages
+  const size_t count = 100000;
+  assert(cig_world_spawn(w, count, "int"));
+  assert(cig_world_spawn(w, count, "int, float"));
+
+  assert(!cig_world_run(w, "sum", 1.0));
+  const long first = *(const long *)cig_world_get_reduction(w, "sum");
+
+  const long total = 2 * (long)count;
+  for (int i = 1; i <= 3; i++) {
+    assert(!cig_world_run(w, "increment", 1.0));
+    assert(!cig_world_run(w, "sum", 1.0));
+    assert(*(const long *)cig_world_get_reduction(w, "sum") ==
+           first + total * i);
+  }
+
+  // Back to the calling thread only
+  assert(!cig_world_set_threads(w, 1, NULL));
+  assert(!cig_world_run(w, "increment", 1.0));
+  assert(!cig_world_run(w, "sum", 1.0));
+  assert(*(const long *)cig_world_get_reduction(w, "sum") == first + total * 4);
+
+  assert(!cig_world_set_threads(w, 8, NULL));
+  for (int i = 0; i < 100; i++)
+    assert(!cig_world_step(w, 1.0));
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
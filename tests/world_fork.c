@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void increment(CigSystemCtx *ctx, double dt) {
+  int *i = cig_system_get_component(ctx, 0);
+  *i += 1;
+}
+
+void sum_init(void *acc) { *(long *)acc = 0; }
+
+void sum_combine(void *dst, const void *src) {
+  *(long *)dst += *(const long *)src;
+}
+
+void sum(CigSystemCtx *ctx, double dt) {
+  int *i = cig_system_get_component(ctx, 0);
+  *(long *)cig_system_get_accumulator(ctx) += *i;
+}
+
+int main() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &float_desc));
+
+  CigReductionDesc sum_desc = {sizeof(long), _Alignof(long), sum_init,
+                               sum_combine};
+  CigSystemDesc increment_desc = {"increment", "int", .func = increment};
+  CigSystemDesc sum_system_desc = {"sum", "int", .func = sum,
+                                   .reduction = &sum_desc, .read_only = 1};
+  assert(!cig_world_register_system(w, &increment_desc));
+  assert(!cig_world_register_system(w, &sum_system_desc));
+
+  const size_t count = 50000;
+  const CigEntity *e = cig_world_spawn(w, count, "int, float");
+  assert(e != NULL);
+  const CigEntity first = e[0], last = e[count - 1];
+  *(int *)cig_world_get_component(w, last, "int") = 10;
+
+  CigWorld *fork = cig_world_fork(w);
+  assert(fork != NULL);
+  assert(cig_query_count(fork, "int, float") == count);
+
+  // Reading from the fork sees the parent's state
+  assert(!cig_world_run(fork, "sum", 0));
+  assert(*(const long *)cig_world_get_reduction(fork, "sum") == 10);
+
+  // Writes in the fork are not visible to the parent
+  assert(!cig_world_run(fork, "increment", 0));
+  assert(*(int *)cig_world_get_component(fork, first, "int") == 1);
+  assert(*(int *)cig_world_get_component(fork, last, "int") == 11);
+  assert(*(int *)cig_world_get_component(w, first, "int") == 0);
+  assert(*(int *)cig_world_get_component(w, last, "int") == 10);
+
+  // Nor the other way around
+  *(int *)cig_world_get_component(w, first, "int") = 5;
+  assert(*(int *)cig_world_get_component(fork, first, "int") == 1);
+
+  // Spawning into a fork leaves the parent's regions alone
+  assert(cig_world_spawn(fork, 10, "int, float"));
+  assert(cig_query_count(fork, "int") == count + 10);
+  assert(cig_query_count(w, "int") == count);
+
+  // A fork of a fork, discarded before its parent
+  CigWorld *nested = cig_world_fork(fork);
+  assert(nested != NULL);
+  assert(!cig_world_run(nested, "increment", 0));
+  assert(*(int *)cig_world_get_component(nested, last, "int") == 12);
+  cig_world_deinit(nested);
+
+  assert(*(int *)cig_world_get_component(fork, last, "int") == 11);
+
+  cig_world_deinit(w);
+  assert(!cig_world_run(fork, "sum", 0));
+  assert(*(const long *)cig_world_get_reduction(fork, "sum") ==
+         (long)count + 10);
+  cig_world_deinit(fork);
+
+  return EXIT_SUCCESS;
+}
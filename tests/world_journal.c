@@ -0,0 +1,100 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+static void integrate(CigSystemCtx *ctx, double dt) {
+  Vec2 *v = cig_system_get_component(ctx, 0);
+  v->x += 1.0f;
+}
+
+static CigWorld *create_world() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &vec2_desc));
+  return w;
+}
+
+int main() {
+  const char *path = "world_journal.bin";
+
+  CigWorld *w = create_world();
+  assert(!cig_world_journal_open(w, path));
+  assert(cig_world_journal_open(w, path));
+
+  CigSystemDesc system_desc = {"integrate", "vec2", integrate};
+  assert(!cig_world_register_system(w, &system_desc));
+
+  const size_t count = 3000;
+  int *ids = malloc(count * sizeof(int));
+  assert(ids != NULL);
+  for (size_t i = 0; i < count; i++)
+    ids[i] = (int)i;
+
+  CigColumnDesc columns[] = {{"int", ids, 0}};
+  const CigEntity *e = cig_world_spawn_columns(w, count, columns, 1);
+  assert(e != NULL);
+  const CigEntity first = e[0];
+
+  // Component writes through pointers aren't journaled, so the steps are lost
+  e = cig_world_spawn(w, 10, "int, vec2");
+  assert(e != NULL);
+  const CigEntity moving = e[0];
+  assert(!cig_world_step(w, 1.0));
+  assert(!cig_world_step(w, 1.0));
+
+  Vec2 v = {5.0f, 6.0f};
+  assert(!cig_world_set_component(w, moving, "vec2", &v));
+  assert(!cig_world_journal_sync(w));
+
+  v.x = 7.0f;
+  assert(!cig_world_set_component(w, moving, "vec2", &v));
+  assert(!cig_world_journal_close(w));
+
+  CigWorld *replayed = create_world();
+  assert(!cig_world_replay(replayed, path));
+  assert(cig_query_count(replayed, "int") == count + 10);
+  for (size_t i = 0; i < count; i++)
+    assert(*(int *)cig_world_get_component(replayed, first + i, "int") ==
+           (int)i);
+  assert(((Vec2 *)cig_world_get_component(replayed, moving, "vec2"))->x ==
+         7.0f);
+  cig_world_deinit(replayed);
+
+  // A record cut short by a crash is dropped
+  struct stat st;
+  assert(!stat(path, &st));
+  assert(!truncate(path, st.st_size - 1));
+
+  replayed = create_world();
+  assert(!cig_world_replay(replayed, path));
+  assert(((Vec2 *)cig_world_get_component(replayed, moving, "vec2"))->x ==
+         5.0f);
+  cig_world_deinit(replayed);
+
+  // Once a write has failed nothing more is written and the steps fail
+  if (access("/dev/full", W_OK) == 0) {
+    CigWorld *full = create_world();
+    assert(!cig_world_journal_open(full, "/dev/full"));
+    assert(cig_world_spawn(full, 10, "int"));
+    assert(cig_world_journal_sync(full));
+    assert(cig_world_step(full, 1.0));
+    assert(cig_world_journal_close(full));
+    cig_world_deinit(full);
+  }
+
+  remove(path);
+  free(ids);
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main() {
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc float_desc = {"float", sizeof(float), _Alignof(float)};
+
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &float_desc));
+
+  const CigEntity *e = cig_world_spawn(w, 100, "int");
+  assert(e != NULL);
+  const CigEntity existing = e[99];
+  *(int *)cig_world_get_component(w, existing, "int") = -1;
+
+  // A staging world with the same registry has its regions spliced in
+  {
+    CigWorld *staging = cig_world_init();
+    assert(staging != NULL);
+    assert(!cig_world_register_type(staging, &int_desc));
+    assert(!cig_world_register_type(staging, &float_desc));
+
+    const size_t count = 5000;
+    e = cig_world_spawn(staging, count, "int, float");
+    assert(e != NULL);
+    for (size_t i = 0; i < count; i++)
+      *(int *)cig_world_get_component(staging, e[i], "int") = (int)e[i];
+
+    CigEntity first;
+    assert(!cig_world_merge(w, staging, &first));
+    assert(cig_query_count(staging, "int") == 0);
+    assert(cig_query_count(w, "int, float") == count);
+    assert(cig_query_count(w, "int") == count + 100);
+
+    for (CigEntity i = 0; i < count; i++)
+      assert(*(int *)cig_world_get_component(w, first + i, "int") == (int)i);
+
+    // The staging world can be reused for the next batch
+    assert(cig_world_spawn(staging, 10, "int"));
+    assert(!cig_world_merge(w, staging, NULL));
+    assert(cig_query_count(w, "int") == count + 110);
+
+    cig_world_deinit(staging);
+  }
+
+  // Otherwise the families are copied, matching types by identifier
+  {
+    CigWorld *staging = cig_world_init();
+    assert(staging != NULL);
+    assert(!cig_world_register_type(staging, &float_desc));
+    assert(!cig_world_register_type(staging, &int_desc));
+
+    e = cig_world_spawn(staging, 3, "float, int");
+    assert(e != NULL);
+    for (size_t i = 0; i < 3; i++) {
+      *(int *)cig_world_get_component(staging, e[i], "int") = 7 * (int)i;
+      *(float *)cig_world_get_component(staging, e[i], "float") = 0.5f;
+    }
+
+    CigEntity first;
+    assert(!cig_world_merge(w, staging, &first));
+    for (CigEntity i = 0; i < 3; i++) {
+      assert(*(int *)cig_world_get_component(w, first + i, "int") == 7 * i);
+      assert(*(float *)cig_world_get_component(w, first + i, "float") == 0.5f);
+    }
+
+    cig_world_deinit(staging);
+  }
+
+  // Chunks shared with a fork are copied as they are spliced
+  {
+    CigWorld *staging = cig_world_init();
+    assert(staging != NULL);
+    assert(!cig_world_register_type(staging, &int_desc));
+    assert(!cig_world_register_type(staging, &float_desc));
+
+    e = cig_world_spawn(staging, 3, "int");
+    assert(e != NULL);
+    for (size_t i = 0; i < 3; i++)
+      *(int *)cig_world_get_component(staging, e[i], "int") = (int)i + 1;
+
+    CigWorld *fork = cig_world_fork(staging);
+    assert(fork != NULL);
+
+    CigEntity first;
+    assert(!cig_world_merge(w, fork, &first));
+    for (CigEntity i = 0; i < 3; i++) {
+      assert(*(int *)cig_world_get_component(w, first + i, "int") == i + 1);
+      assert(*(int *)cig_world_get_component(staging, i, "int") == i + 1);
+    }
+
+    cig_world_deinit(fork);
+    cig_world_deinit(staging);
+  }
+
+  // A type missing from the destination fails the merge before either world
+  // is changed
+  {
+    CigWorld *staging = cig_world_init();
+    assert(staging != NULL);
+    CigTypeDesc short_desc = {"short", sizeof(short), _Alignof(short)};
+    assert(!cig_world_register_type(staging, &float_desc));
+    assert(!cig_world_register_type(staging, &int_desc));
+    assert(!cig_world_register_type(staging, &short_desc));
+
+    assert(cig_world_spawn(staging, 3, "int"));
+    assert(cig_world_spawn(staging, 3, "int, float"));
+    e = cig_world_spawn(staging, 3, "short");
+    assert(e != NULL);
+    const CigEntity last = e[2];
+    assert(cig_world_spawn(staging, 3, "float"));
+
+    const size_t count = cig_query_count(w, "int");
+    e = cig_world_spawn(w, 1, "float");
+    assert(e != NULL);
+    const CigEntity next = e[0] + 1;
+
+    assert(cig_world_merge(w, staging, NULL));
+    assert(cig_query_count(w, "int") == count);
+    assert(cig_query_count(w, "float") == cig_query_count(w, "int, float") + 1);
+    e = cig_world_spawn(w, 1, "float");
+    assert(e != NULL && e[0] == next);
+
+    assert(cig_query_count(staging, "int") == 6);
+    assert(cig_query_count(staging, "float") == 6);
+    assert(cig_world_get_component(staging, last, "short") != NULL);
+
+    cig_world_deinit(staging);
+  }
+
+  // Ids that were free in the staging world are handed out again
+  {
+    CigWorld *staging = cig_world_init();
+    assert(staging != NULL);
+    assert(!cig_world_register_type(staging, &int_desc));
+    assert(!cig_world_register_type(staging, &float_desc));
+
+    assert(cig_world_spawn(staging, 4, "float"));
+    assert(!cig_world_despawn_query(staging, "float"));
+    assert(cig_world_spawn(staging, 2, "int"));
+
+    CigEntity first;
+    assert(!cig_world_merge(w, staging, &first));
+    e = cig_world_spawn(w, 4, "float");
+    assert(e != NULL);
+    for (size_t i = 0; i < 4; i++)
+      assert(e[i] >= first && e[i] < first + 6);
+
+    cig_world_deinit(staging);
+  }
+
+  assert(*(int *)cig_world_get_component(w, existing, "int") == -1);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
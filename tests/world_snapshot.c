@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Vec2 {
+  float x, y;
+} Vec2;
+
+typedef struct Flags {
+  unsigned char a, b, c;
+} Flags;
+
+static CigWorld *create_world() {
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc vec2_desc = {"vec2", sizeof(Vec2), _Alignof(Vec2)};
+  CigTypeDesc flags_desc = {"flags", sizeof(Flags), _Alignof(Flags)};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &vec2_desc));
+  assert(!cig_world_register_type(w, &flags_desc));
+  return w;
+}
+
+// Writes a snapshot of `entities` ids, none of them unassigned, with a section
+// of `count` families without types and no lanes
+static void write_snapshot(const char *path, uint64_t entities,
+                           uint64_t count) {
+  FILE *file = fopen(path, "wb");
+  assert(file != NULL);
+
+  const uint32_t header[2] = {1, 1};
+  const uint64_t ids[2] = {entities, 0};
+  const uint32_t type_count = 0;
+  fwrite("CIGS", 1, 4, file);
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(ids, sizeof(ids), 1, file);
+  fwrite(&type_count, sizeof(type_count), 1, file);
+  fwrite(&count, sizeof(count), 1, file);
+  assert(!fclose(file));
+}
+
+int main() {
+  const char *path = "world_snapshot.bin";
+  const char *journal_path = "world_snapshot.journal";
+
+  CigWorld *w = create_world();
+
+  const size_t count = 20000;
+  const CigEntity *e = cig_world_spawn(w, count, "int, vec2, flags");
+  assert(e != NULL);
+  for (size_t i = 0; i < count; i++) {
+    // Smooth, random and mostly zero columns
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)i * 3 - 7;
+    *(Vec2 *)cig_world_get_component(w, e[i], "vec2") =
+        (Vec2){(float)i * 0.5f, (float)rand()};
+    if (i % 1000 == 0)
+      *(Flags *)cig_world_get_component(w, e[i], "flags") = (Flags){1, 2, 3};
+  }
+
+  e = cig_world_spawn(w, 100, "int");
+  assert(e != NULL);
+  const CigEntity last = e[99];
+  *(int *)cig_world_get_component(w, last, "int") = -1;
+
+  assert(!cig_world_snapshot(w, path));
+
+  // Changes after the snapshot are kept in the journal
+  assert(!cig_world_journal_open(w, journal_path));
+  const int value = 42;
+  assert(!cig_world_set_component(w, last, "int", &value));
+  assert(cig_world_spawn(w, 5, "vec2"));
+  assert(!cig_world_journal_close(w));
+
+  CigWorld *restored = create_world();
+  assert(!cig_world_restore(restored, path));
+  assert(cig_world_restore(restored, path));
+  assert(cig_query_count(restored, "int, vec2, flags") == count);
+  assert(cig_query_count(restored, "int") == count + 100);
+
+  for (CigEntity i = 0; i < count; i++) {
+    assert(*(int *)cig_world_get_component(restored, i, "int") ==
+           *(int *)cig_world_get_component(w, i, "int"));
+
+    const Vec2 *a = cig_world_get_component(restored, i, "vec2");
+    const Vec2 *b = cig_world_get_component(w, i, "vec2");
+    assert(a->x == b->x && a->y == b->y);
+
+    const Flags *f = cig_world_get_component(restored, i, "flags");
+    assert(f->c == (i % 1000 == 0 ? 3 : 0));
+  }
+  assert(*(int *)cig_world_get_component(restored, last, "int") == -1);
+
+  // Replaying the journal brings it up to date
+  assert(!cig_world_replay(restored, journal_path));
+  assert(*(int *)cig_world_get_component(restored, last, "int") == 42);
+  assert(cig_query_count(restored, "vec2") == count + 5);
+
+  cig_world_deinit(restored);
+  remove(journal_path);
+
+  // A snapshot can't ask for more entities or families than it can describe
+  write_snapshot(path, UINT64_MAX / 2, 0);
+  restored = create_world();
+  assert(cig_world_restore(restored, path));
+  cig_world_deinit(restored);
+
+  write_snapshot(path, 8, UINT64_MAX / 2);
+  restored = create_world();
+  assert(cig_world_restore(restored, path));
+  cig_world_deinit(restored);
+  remove(path);
+
+  cig_world_deinit(w);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <ciggurat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+void increment(CigSystemCtx *ctx, double dt) {
+  int *i = cig_system_get_component(ctx, 0);
+  *i += 1;
+}
+
+static void wait_for(CigWorld *w, const char *zone, CigZoneState state) {
+  const struct timespec delay = {.tv_nsec = 1000000};
+  while (cig_world_zone_state(w, zone) != state) {
+    assert(!cig_world_poll_zones(w));
+    nanosleep(&delay, NULL);
+  }
+}
+
+int main() {
+  const char *path = "zone_streaming.bin";
+
+  CigWorld *w = cig_world_init();
+  assert(w != NULL);
+
+  CigTypeDesc int_desc = {"int", sizeof(int), _Alignof(int)};
+  CigTypeDesc zone_desc = {"zone_a", 0, 1};
+  assert(!cig_world_register_type(w, &int_desc));
+  assert(!cig_world_register_type(w, &zone_desc));
+
+  CigSystemDesc increment_desc = {"increment", "int", .func = increment};
+  assert(!cig_world_register_system(w, &increment_desc));
+
+  const size_t count = 20000;
+  const CigEntity *e = cig_world_spawn(w, count, "int, zone_a");
+  assert(e != NULL);
+  const CigEntity first = e[0], last = e[count - 1];
+  for (size_t i = 0; i < count; i++)
+    *(int *)cig_world_get_component(w, e[i], "int") = (int)i;
+
+  e = cig_world_spawn(w, 10, "int");
+  assert(e != NULL);
+  const CigEntity outside = e[0];
+
+  assert(!cig_world_page_out(w, "zone_a", path));
+  assert(cig_world_page_out(w, "zone_a", path));
+  wait_for(w, "zone_a", CIG_ZONE_PAGED_OUT);
+
+  // Paged out entities keep their ids, but are skipped by systems
+  assert(cig_world_get_component(w, first, "int") == NULL);
+  assert(!cig_world_step(w, 0));
+  assert(*(int *)cig_world_get_component(w, outside, "int") == 1);
+
+  // Paged out families can't be carried into another world
+  assert(cig_world_fork(w) == NULL);
+  CigWorld *dst = cig_world_init();
+  assert(dst != NULL);
+  assert(!cig_world_register_type(dst, &int_desc));
+  assert(!cig_world_register_type(dst, &zone_desc));
+  assert(cig_world_spawn(dst, 3, "int"));
+  CigEntity merged;
+  assert(cig_world_merge(dst, w, &merged));
+  assert(cig_query_count(dst, "int") == 3);
+  cig_world_deinit(dst);
+
+  // New entities in the zone are resident straight away
+  e = cig_world_spawn(w, 1, "int, zone_a");
+  assert(e != NULL);
+  assert(*(int *)cig_world_get_component(w, e[0], "int") == 0);
+
+  assert(!cig_world_page_in(w, "zone_a"));
+  wait_for(w, "zone_a", CIG_ZONE_RESIDENT);
+
+  assert(*(int *)cig_world_get_component(w, first, "int") == 0);
+  assert(*(int *)cig_world_get_component(w, last, "int") == (int)count - 1);
+  assert(!cig_world_step(w, 0));
+  assert(*(int *)cig_world_get_component(w, last, "int") == (int)count);
+
+  // Discarding the world while a zone is in flight
+  assert(!cig_world_page_out(w, "zone_a", path));
+  cig_world_deinit(w);
+
+  remove(path);
+  return EXIT_SUCCESS;
+}